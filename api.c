@@ -25,6 +25,8 @@
 #include "miner.h"
 #include "util.h"
 #include "klist.h"
+#include "trace.h"
+#include "verify.h"
 
 #if defined(USE_BFLSC) || defined(USE_AVALON) || defined(USE_AVALON2) || \
 	defined(USE_HASHFAST) || defined(USE_BITFURY) || defined(USE_KLONDIKE) || \
@@ -133,7 +135,7 @@ static const char SEPARATOR = '|';
 #define JOIN_CMD "CMD="
 #define BETWEEN_JOIN SEPSTR
 
-static const char *APIVERSION = "3.4";
+static const char *APIVERSION = "3.5";
 static const char *DEAD = "Dead";
 static const char *SICK = "Sick";
 static const char *NOSTART = "NoStart";
@@ -260,6 +262,8 @@ static const char *OSINFO =
 #define _SETCONFIG	"SETCONFIG"
 #define _USBSTATS	"USBSTATS"
 #define _LCD		"LCD"
+#define _LOCKSTATS	"LOCKSTATS"
+#define _VERIFY		"VERIFY"
 
 static const char ISJSON = '{';
 #define JSON0		"{"
@@ -301,12 +305,17 @@ static const char ISJSON = '{';
 #define JSON_SETCONFIG	JSON1 _SETCONFIG JSON2
 #define JSON_USBSTATS	JSON1 _USBSTATS JSON2
 #define JSON_LCD	JSON1 _LCD JSON2
+#define JSON_LOCKSTATS	JSON1 _LOCKSTATS JSON2
+#define JSON_VERIFY	JSON1 _VERIFY JSON2
 #define JSON_END	JSON4 JSON5
 #define JSON_END_TRUNCATED	JSON4_TRUNCATED JSON5
 #define JSON_BETWEEN_JOIN	","
 
 static const char *JSON_COMMAND = "command";
 static const char *JSON_PARAMETER = "parameter";
+static const char *JSON_ENCODING = "encoding";
+
+static const char *CBORSTR = "cbor";
 
 #define MSG_POOL 7
 #define MSG_NOPOOL 8
@@ -429,6 +438,9 @@ static const char *JSON_PARAMETER = "parameter";
 #define MSG_LOCKOK 123
 #define MSG_LOCKDIS 124
 #define MSG_LCD 125
+#define MSG_TRACE 126
+#define MSG_TRACEDIS 127
+#define MSG_VERIFY 128
 
 enum code_severity {
 	SEVERITY_ERR,
@@ -597,6 +609,9 @@ struct CODES {
  { SEVERITY_SUCC,  MSG_LCD,	PARAM_NONE,	"LCD" },
  { SEVERITY_SUCC,  MSG_LOCKOK,	PARAM_NONE,	"Lock stats created" },
  { SEVERITY_WARN,  MSG_LOCKDIS,	PARAM_NONE,	"Lock stats not enabled" },
+ { SEVERITY_SUCC,  MSG_TRACE,	PARAM_STR,	"Trace written to file '%s'" },
+ { SEVERITY_WARN,  MSG_TRACEDIS,	PARAM_NONE,	"Trace not enabled" },
+ { SEVERITY_SUCC,  MSG_VERIFY,	PARAM_NONE,	"Verify stats" },
  { SEVERITY_FAIL, 0, 0, NULL }
 };
 
@@ -642,6 +657,10 @@ struct io_data {
 	char *cur;
 	bool sock;
 	bool close;
+	// JSON replies are transcoded to CBOR in bin before sending
+	bool cbor;
+	unsigned char *bin;
+	size_t binsiz;
 };
 
 struct io_list {
@@ -689,6 +708,9 @@ static struct io_data *_io_new(size_t initial, bool socket_buf)
 	io_data->ptr = malloc(initial);
 	io_data->siz = initial;
 	io_data->sock = socket_buf;
+	io_data->cbor = false;
+	io_data->bin = NULL;
+	io_data->binsiz = 0;
 	io_reinit(io_data);
 
 	io_list = malloc(sizeof(*io_list));
@@ -756,6 +778,7 @@ static void io_free()
 			io_next = io_list->next;
 
 			free(io_list->io_data->ptr);
+			free(io_list->io_data->bin);
 			free(io_list->io_data);
 			free(io_list);
 
@@ -1906,6 +1929,481 @@ void show_locks()
 
 	lockunlock();
 }
+#elif LOCK_PROFILING
+
+/*
+ * Each thread has its own table of lock sites, so recording a lock needs no
+ * shared locking at all - only the API lockstats command reads all the tables
+ * The counters are only ever written by the owning thread, so the totals
+ * shown may be very slightly behind, but they are 64 bit so are updated and
+ * read with atomics to not tear on 32 bit targets
+ */
+
+// Per thread lock call sites, must be a power of 2
+#define LOCKPROF_SITES 512
+// Locks a thread can hold at once that will have their hold time recorded
+#define LOCKPROF_HELD 16
+// Histogram buckets of log2(microseconds), the last is everything larger
+#define LOCKPROF_HIST 16
+// Lock inits remembered, to show where each lock was created
+#define LOCKPROF_INITS 1024
+
+#define LOCKPROF_ADD(_v, _n) __sync_fetch_and_add(&(_v), (_n))
+#define LOCKPROF_GET(_v) __sync_fetch_and_add(&(_v), 0)
+// Only the owning thread updates a max so it can test it without an atomic
+#define LOCKPROF_MAX(_v, _n) do { \
+		if ((_n) > (_v)) \
+			__sync_lock_test_and_set(&(_v), (_n)); \
+	} while (0)
+
+typedef struct lockprofsite {
+	void *lock;
+	const char *file;
+	const char *func;
+	int linenum;
+	uint64_t gets;
+	uint64_t tries;
+	uint64_t fails;
+	uint64_t unlocks;
+	uint64_t wait_ns;
+	uint64_t wait_max;
+	uint64_t hold_ns;
+	uint64_t hold_max;
+	uint64_t wait_hist[LOCKPROF_HIST];
+	uint64_t hold_hist[LOCKPROF_HIST];
+} LOCKPROFSITE;
+
+typedef struct lockprofheld {
+	void *lock;
+	LOCKPROFSITE *site;
+	uint64_t got;
+} LOCKPROFHELD;
+
+typedef struct lockprofthr {
+	LOCKPROFSITE sites[LOCKPROF_SITES];
+	LOCKPROFHELD held[LOCKPROF_HELD];
+	int nheld;
+	// Lock calls not recorded due to a full site table or held list
+	uint64_t nosite;
+	uint64_t noheld;
+	struct lockprofthr *next;
+} LOCKPROFTHR;
+
+typedef struct lockprofinit {
+	void *lock;
+	enum cglock_typ typ;
+	const char *file;
+	const char *func;
+	int linenum;
+} LOCKPROFINIT;
+
+static __thread LOCKPROFTHR *lockprof_thr;
+static LOCKPROFTHR *lockprof_head;
+static int lockprof_threads;
+
+static LOCKPROFINIT lockprof_inits[LOCKPROF_INITS];
+static int lockprof_ninits;
+
+static uint64_t lockprof_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	cgtime(&tv);
+	return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000ULL;
+#endif
+}
+
+// Yes this uses locks also ... but only once per thread and per lock init
+static void lockproflock()
+{
+	if (unlikely(pthread_mutex_lock(&lockstat_lock)))
+		quithere(1, "WTF MUTEX ERROR ON LOCK! errno=%d", errno);
+}
+
+static void lockprofunlock()
+{
+	if (unlikely(pthread_mutex_unlock(&lockstat_lock)))
+		quithere(1, "WTF MUTEX ERROR ON UNLOCK! errno=%d", errno);
+}
+
+static LOCKPROFTHR *lockprof_mythr()
+{
+	LOCKPROFTHR *thr = lockprof_thr;
+
+	if (unlikely(!thr)) {
+		thr = calloc(1, sizeof(*thr));
+		if (unlikely(!thr))
+			quithere(1, "OOM lockprof thr");
+
+		// Threads are never removed so their totals remain after they exit
+		lockproflock();
+		thr->next = lockprof_head;
+		lockprof_head = thr;
+		lockprof_threads++;
+		lockprofunlock();
+
+		lockprof_thr = thr;
+	}
+
+	return thr;
+}
+
+static LOCKPROFSITE *lockprof_site(LOCKPROFTHR *thr, void *lock, const char *file, const char *func, const int linenum)
+{
+	LOCKPROFSITE *site;
+	uintptr_t hash;
+	int i, slot;
+
+	hash = (uintptr_t)lock ^ ((uintptr_t)file >> 3) ^ ((uintptr_t)linenum * 2654435761U);
+	hash ^= hash >> 16;
+
+	for (i = 0; i < LOCKPROF_SITES; i++) {
+		slot = (int)((hash + i) & (LOCKPROF_SITES - 1));
+		site = &(thr->sites[slot]);
+		if (likely(site->lock == lock && site->linenum == linenum && site->file == file))
+			return site;
+		if (!site->lock) {
+			site->file = file;
+			site->func = func;
+			site->linenum = linenum;
+			// The API may be reading the table, so it must see the
+			// site details before it sees the site is in use
+			__sync_synchronize();
+			site->lock = lock;
+			return site;
+		}
+	}
+
+	LOCKPROF_ADD(thr->nosite, 1);
+	return NULL;
+}
+
+static int lockprof_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	int bucket = 0;
+
+	while (us && bucket < (LOCKPROF_HIST - 1)) {
+		us >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static void lockprof_held(LOCKPROFTHR *thr, LOCKPROFSITE *site, void *lock, uint64_t now)
+{
+	if (unlikely(thr->nheld >= LOCKPROF_HELD)) {
+		LOCKPROF_ADD(thr->noheld, 1);
+		return;
+	}
+
+	thr->held[thr->nheld].lock = lock;
+	thr->held[thr->nheld].site = site;
+	thr->held[thr->nheld].got = now;
+	thr->nheld++;
+}
+
+// The id returned is the time the get started
+uint64_t api_getlock(__maybe_unused void *lock, __maybe_unused const char *file, __maybe_unused const char *func, __maybe_unused const int linenum)
+{
+	return lockprof_ns();
+}
+
+void api_gotlock(uint64_t id, void *lock, const char *file, const char *func, const int linenum)
+{
+	LOCKPROFTHR *thr = lockprof_mythr();
+	LOCKPROFSITE *site;
+	uint64_t now, wait;
+
+	site = lockprof_site(thr, lock, file, func, linenum);
+	if (unlikely(!site))
+		return;
+
+	now = lockprof_ns();
+	wait = now - id;
+
+	LOCKPROF_ADD(site->gets, 1);
+	LOCKPROF_ADD(site->wait_ns, wait);
+	LOCKPROF_MAX(site->wait_max, wait);
+	LOCKPROF_ADD(site->wait_hist[lockprof_bucket(wait)], 1);
+
+	lockprof_held(thr, site, lock, now);
+}
+
+uint64_t api_trylock(__maybe_unused void *lock, __maybe_unused const char *file, __maybe_unused const char *func, __maybe_unused const int linenum)
+{
+	return 0;
+}
+
+void api_didlock(__maybe_unused uint64_t id, int ret, void *lock, const char *file, const char *func, const int linenum)
+{
+	LOCKPROFTHR *thr = lockprof_mythr();
+	LOCKPROFSITE *site;
+
+	site = lockprof_site(thr, lock, file, func, linenum);
+	if (unlikely(!site))
+		return;
+
+	LOCKPROF_ADD(site->tries, 1);
+	if (ret)
+		LOCKPROF_ADD(site->fails, 1);
+	else
+		lockprof_held(thr, site, lock, lockprof_ns());
+}
+
+void api_gunlock(void *lock, __maybe_unused const char *file, __maybe_unused const char *func, __maybe_unused const int linenum)
+{
+	LOCKPROFTHR *thr = lockprof_mythr();
+	LOCKPROFSITE *site;
+	uint64_t hold;
+	int i;
+
+	// The hold time is counted against the site that got the lock
+	for (i = thr->nheld - 1; i >= 0; i--) {
+		if (thr->held[i].lock == lock)
+			break;
+	}
+
+	// Unlocked by a different thread than locked it, or not recorded
+	if (i < 0)
+		return;
+
+	site = thr->held[i].site;
+	hold = lockprof_ns() - thr->held[i].got;
+
+	LOCKPROF_ADD(site->unlocks, 1);
+	LOCKPROF_ADD(site->hold_ns, hold);
+	LOCKPROF_MAX(site->hold_max, hold);
+	LOCKPROF_ADD(site->hold_hist[lockprof_bucket(hold)], 1);
+
+	thr->nheld--;
+	if (i < thr->nheld)
+		memmove(&(thr->held[i]), &(thr->held[i+1]), (thr->nheld - i) * sizeof(thr->held[0]));
+}
+
+void api_initlock(void *lock, enum cglock_typ typ, const char *file, const char *func, const int linenum)
+{
+	int i;
+
+	lockproflock();
+
+	// A lock can be destroyed and a new one created at the same address
+	for (i = 0; i < lockprof_ninits; i++) {
+		if (lockprof_inits[i].lock == lock)
+			break;
+	}
+
+	if (i < LOCKPROF_INITS) {
+		lockprof_inits[i].lock = lock;
+		lockprof_inits[i].typ = typ;
+		lockprof_inits[i].file = file;
+		lockprof_inits[i].func = func;
+		lockprof_inits[i].linenum = linenum;
+		if (i == lockprof_ninits)
+			lockprof_ninits++;
+	}
+
+	lockprofunlock();
+}
+
+static int lockprof_cmp(const void *a, const void *b)
+{
+	const LOCKPROFSITE *sa = (const LOCKPROFSITE *)a;
+	const LOCKPROFSITE *sb = (const LOCKPROFSITE *)b;
+
+	// Most total time waiting first
+	if (sa->wait_ns < sb->wait_ns)
+		return 1;
+	if (sa->wait_ns > sb->wait_ns)
+		return -1;
+	return 0;
+}
+
+static void lockprof_hist(char *buf, size_t siz, uint64_t *hist)
+{
+	size_t len = 0;
+	int i;
+
+	buf[0] = '\0';
+	for (i = 0; i < LOCKPROF_HIST && len < siz; i++)
+		len += snprintf(buf + len, siz - len, "%s%"PRIu64, i ? "/" : "", hist[i]);
+}
+
+/*
+ * Combine every thread's sites into one site per lock per call site
+ * Returns an allocated array of the sites sorted by total wait time
+ */
+static LOCKPROFSITE *lockprof_gather(int *count, int *threads, uint64_t *nosite, uint64_t *noheld)
+{
+	LOCKPROFSITE *all, *site, *to;
+	LOCKPROFTHR *thr, *head;
+	int i, j, k, n, alloc;
+	uint64_t max;
+
+	lockproflock();
+	head = lockprof_head;
+	*threads = lockprof_threads;
+	lockprofunlock();
+
+	alloc = LOCKPROF_SITES;
+	all = malloc(alloc * sizeof(*all));
+	if (unlikely(!all))
+		quithere(1, "OOM lockprof gather");
+	n = 0;
+	*nosite = *noheld = 0;
+
+	// Threads are only ever added at the head, so this list is stable
+	for (thr = head; thr; thr = thr->next) {
+		*nosite += LOCKPROF_GET(thr->nosite);
+		*noheld += LOCKPROF_GET(thr->noheld);
+		for (i = 0; i < LOCKPROF_SITES; i++) {
+			site = &(thr->sites[i]);
+			if (!site->lock)
+				continue;
+			__sync_synchronize();
+
+			for (j = 0; j < n; j++) {
+				if (all[j].lock == site->lock && all[j].linenum == site->linenum &&
+				    all[j].file == site->file)
+					break;
+			}
+
+			to = &(all[j]);
+			if (j == n) {
+				if (n >= alloc) {
+					alloc += LOCKPROF_SITES;
+					all = realloc(all, alloc * sizeof(*all));
+					if (unlikely(!all))
+						quithere(1, "OOM lockprof gather");
+					to = &(all[j]);
+				}
+				memset(to, 0, sizeof(*to));
+				to->lock = site->lock;
+				to->file = site->file;
+				to->func = site->func;
+				to->linenum = site->linenum;
+				n++;
+			}
+
+			to->gets += LOCKPROF_GET(site->gets);
+			to->tries += LOCKPROF_GET(site->tries);
+			to->fails += LOCKPROF_GET(site->fails);
+			to->unlocks += LOCKPROF_GET(site->unlocks);
+			to->wait_ns += LOCKPROF_GET(site->wait_ns);
+			max = LOCKPROF_GET(site->wait_max);
+			if (max > to->wait_max)
+				to->wait_max = max;
+			to->hold_ns += LOCKPROF_GET(site->hold_ns);
+			max = LOCKPROF_GET(site->hold_max);
+			if (max > to->hold_max)
+				to->hold_max = max;
+			for (k = 0; k < LOCKPROF_HIST; k++) {
+				to->wait_hist[k] += LOCKPROF_GET(site->wait_hist[k]);
+				to->hold_hist[k] += LOCKPROF_GET(site->hold_hist[k]);
+			}
+		}
+	}
+
+	qsort(all, n, sizeof(*all), lockprof_cmp);
+
+	*count = n;
+	return all;
+}
+
+static void lockprof_stats(struct io_data *io_data, bool isjson)
+{
+	struct api_data *root = NULL;
+	LOCKPROFSITE *all, *site;
+	char lockbuf[32], buf[TMPBUFSIZ];
+	const char *typ;
+	uint64_t nosite, noheld;
+	int count, threads, i, j;
+	bool io_open = false;
+	double secs;
+
+	all = lockprof_gather(&count, &threads, &nosite, &noheld);
+
+	message(io_data, MSG_LOCKOK, 0, NULL, isjson);
+
+	if (isjson)
+		io_open = io_add(io_data, COMSTR JSON_LOCKSTATS);
+
+	root = api_add_int(root, "Threads", &threads, true);
+	root = api_add_int(root, "Sites", &count, true);
+	root = api_add_uint64(root, "Sites Full", &nosite, true);
+	root = api_add_uint64(root, "Held Full", &noheld, true);
+	root = print_data(io_data, root, isjson, false);
+
+	for (i = 0; i < count; i++) {
+		site = &(all[i]);
+
+		snprintf(lockbuf, sizeof(lockbuf), "%p", site->lock);
+		root = api_add_int(root, "SITE", &i, true);
+		root = api_add_string(root, "Lock", lockbuf, true);
+
+		lockproflock();
+		for (j = 0; j < lockprof_ninits; j++) {
+			if (lockprof_inits[j].lock == site->lock)
+				break;
+		}
+		if (j < lockprof_ninits) {
+			switch (lockprof_inits[j].typ) {
+				case CGLOCK_MUTEX:
+					typ = "mutex";
+					break;
+				case CGLOCK_RW:
+					typ = "rwlock";
+					break;
+				default:
+					typ = UNKNOWN;
+					break;
+			}
+			snprintf(buf, sizeof(buf), "%s %s():%d",
+				 lockprof_inits[j].file,
+				 lockprof_inits[j].func,
+				 lockprof_inits[j].linenum);
+		} else {
+			typ = UNKNOWN;
+			strcpy(buf, UNKNOWN);
+		}
+		lockprofunlock();
+
+		root = api_add_const(root, "Type", typ, false);
+		root = api_add_string(root, "Created", buf, true);
+		snprintf(buf, sizeof(buf), "%s %s():%d", site->file, site->func, site->linenum);
+		root = api_add_string(root, "Site", buf, true);
+		root = api_add_uint64(root, "Gets", &(site->gets), true);
+		root = api_add_uint64(root, "Tries", &(site->tries), true);
+		root = api_add_uint64(root, "Try Fails", &(site->fails), true);
+		root = api_add_uint64(root, "Unlocks", &(site->unlocks), true);
+		secs = (double)(site->wait_ns) / 1000000000.0;
+		root = api_add_double(root, "Wait Total", &secs, true);
+		secs = (double)(site->wait_max) / 1000000000.0;
+		root = api_add_double(root, "Wait Max", &secs, true);
+		secs = (double)(site->hold_ns) / 1000000000.0;
+		root = api_add_double(root, "Hold Total", &secs, true);
+		secs = (double)(site->hold_max) / 1000000000.0;
+		root = api_add_double(root, "Hold Max", &secs, true);
+		lockprof_hist(buf, sizeof(buf), site->wait_hist);
+		root = api_add_string(root, "Wait uS Log2 Hist", buf, true);
+		lockprof_hist(buf, sizeof(buf), site->hold_hist);
+		root = api_add_string(root, "Hold uS Log2 Hist", buf, true);
+
+		root = print_data(io_data, root, isjson, isjson);
+	}
+
+	if (isjson && io_open)
+		io_close(io_data);
+
+	free(all);
+}
 #endif
 
 static void lockstats(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __maybe_unused char *param, bool isjson, __maybe_unused char group)
@@ -1913,11 +2411,45 @@ static void lockstats(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __ma
 #if LOCK_TRACKING
 	show_locks();
 	message(io_data, MSG_LOCKOK, 0, NULL, isjson);
+#elif LOCK_PROFILING
+	lockprof_stats(io_data, isjson);
 #else
 	message(io_data, MSG_LOCKDIS, 0, NULL, isjson);
 #endif
 }
 
+static void dotrace(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __maybe_unused char *param, bool isjson, __maybe_unused char group)
+{
+#if WORK_TRACING
+	FILE *ftrace;
+	char *ptr;
+
+	if (param == NULL || *param == '\0')
+		param = DEFAULT_TRACE_FILE;
+
+	ftrace = fopen(param, "w");
+	if (!ftrace) {
+		ptr = escape_string(param, isjson);
+		message(io_data, MSG_BADFN, 0, ptr, isjson);
+		if (ptr != param)
+			free(ptr);
+		ptr = NULL;
+		return;
+	}
+
+	trace_write(ftrace);
+	fclose(ftrace);
+
+	ptr = escape_string(param, isjson);
+	message(io_data, MSG_TRACE, 0, ptr, isjson);
+	if (ptr != param)
+		free(ptr);
+	ptr = NULL;
+#else
+	message(io_data, MSG_TRACEDIS, 0, NULL, isjson);
+#endif
+}
+
 static void apiversion(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __maybe_unused char *param, bool isjson, __maybe_unused char group)
 {
 	struct api_data *root = NULL;
@@ -2572,6 +3104,10 @@ static void poolstatus(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __m
 		double stalep = (pool->diff_accepted + pool->diff_rejected + pool->diff_stale) ?
 				(double)(pool->diff_stale) / (double)(pool->diff_accepted + pool->diff_rejected + pool->diff_stale) : 0;
 		root = api_add_percent(root, "Pool Stale%", &stalep, false);
+		double target, actual;
+		pool_split(pool, &target, &actual);
+		root = api_add_percent(root, "Target Split%", &target, false);
+		root = api_add_percent(root, "Actual Split%", &actual, false);
 
 		root = print_data(io_data, root, isjson, isjson && (i > 0));
 	}
@@ -3540,6 +4076,50 @@ static void setconfig(struct io_data *io_data, __maybe_unused SOCKETTYPE c, char
 	message(io_data, MSG_SETCONFIG, value, param, isjson);
 }
 
+static void verifystats(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __maybe_unused char *param, bool isjson, __maybe_unused char group)
+{
+	struct verify_stats stats[DRIVER_MAX];
+	struct api_data *root = NULL;
+	bool io_open = false;
+	double avg;
+	int i, n;
+
+	verify_stats_copy(stats);
+
+	message(io_data, MSG_VERIFY, 0, NULL, isjson);
+
+	if (isjson)
+		io_open = io_add(io_data, COMSTR JSON_VERIFY);
+
+	root = api_add_int(root, "Threads", &opt_verify_threads, false);
+	n = VERIFY_QUEUE;
+	root = api_add_int(root, "Queue Size", &n, true);
+	root = print_data(io_data, root, isjson, false);
+
+	n = 0;
+	for (i = 0; i < DRIVER_MAX; i++) {
+		if (!stats[i].name)
+			continue;
+
+		root = api_add_int(root, "DRIVER", &n, true);
+		root = api_add_const(root, "Name", stats[i].name, true);
+		root = api_add_uint64(root, "Queued", &(stats[i].queued), true);
+		root = api_add_uint64(root, "Queue Full", &(stats[i].full), true);
+		root = api_add_int(root, "Depth", &(stats[i].depth), true);
+		root = api_add_int(root, "Max Depth", &(stats[i].max_depth), true);
+		root = api_add_uint64(root, "Verified", &(stats[i].verified), true);
+		root = api_add_uint64(root, "Valid", &(stats[i].valid), true);
+		avg = stats[i].verified ? stats[i].total_latency / (double)(stats[i].verified) : 0;
+		root = api_add_double(root, "Latency Avg", &avg, true);
+		root = api_add_double(root, "Latency Max", &(stats[i].max_latency), true);
+		root = print_data(io_data, root, isjson, isjson);
+		n++;
+	}
+
+	if (isjson && io_open)
+		io_close(io_data);
+}
+
 static void usbstats(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __maybe_unused char *param, bool isjson, __maybe_unused char group)
 {
 	struct api_data *root = NULL;
@@ -4109,6 +4689,8 @@ struct CMDS {
 	{ "asccount",		asccount,	false,	true },
 	{ "lcd",		lcddata,	false,	true },
 	{ "lockstats",		lockstats,	true,	true },
+	{ "trace",		dotrace,	true,	false },
+	{ "verify",		verifystats,	false,	true },
 	{ NULL,			NULL,		false,	false }
 };
 
@@ -4193,6 +4775,292 @@ static void tail_join(struct io_data *io_data, bool isjson)
 	}
 }
 
+/*
+ * CBOR (RFC 7049) encoding of a JSON reply
+ * The JSON built by the commands is transcoded in a single pass, so the
+ * CBOR reply has exactly the same content, order and names as the JSON
+ * reply, including any duplicate names
+ * Objects and arrays use the indefinite length encoding so no look ahead
+ * is required, and numbers are sent in binary rather than as text
+ */
+#define CBOR_UINT	0x00
+#define CBOR_NINT	0x20
+#define CBOR_TEXT	0x60
+#define CBOR_ARRAY	0x80
+#define CBOR_MAP	0xa0
+#define CBOR_SIMPLE	0xe0
+#define CBOR_INDEF	0x1f
+#define CBOR_FALSE	(CBOR_SIMPLE | 20)
+#define CBOR_TRUE	(CBOR_SIMPLE | 21)
+#define CBOR_NULL	(CBOR_SIMPLE | 22)
+#define CBOR_FLOAT32	(CBOR_SIMPLE | 26)
+#define CBOR_FLOAT64	(CBOR_SIMPLE | 27)
+#define CBOR_BREAK	0xff
+
+// Largest head is 1 + 8 bytes
+#define CBOR_HEADMAX	9
+
+static void cbor_byte(struct io_data *io_data, size_t *len, unsigned char byte)
+{
+	io_data->bin[(*len)++] = byte;
+}
+
+static void cbor_head(struct io_data *io_data, size_t *len, unsigned char major, uint64_t val)
+{
+	int bytes, i;
+
+	if (val < 24) {
+		cbor_byte(io_data, len, major | (unsigned char)val);
+		return;
+	}
+
+	if (val <= 0xff) {
+		cbor_byte(io_data, len, major | 24);
+		bytes = 1;
+	} else if (val <= 0xffff) {
+		cbor_byte(io_data, len, major | 25);
+		bytes = 2;
+	} else if (val <= 0xffffffffULL) {
+		cbor_byte(io_data, len, major | 26);
+		bytes = 4;
+	} else {
+		cbor_byte(io_data, len, major | 27);
+		bytes = 8;
+	}
+
+	for (i = bytes - 1; i >= 0; i--)
+		cbor_byte(io_data, len, (unsigned char)(val >> (i * 8)));
+}
+
+static int cbor_hexval(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+// Unescape a JSON string into the CBOR buffer, returns the end of the string
+static char *cbor_text(struct io_data *io_data, size_t *len, char *ptr)
+{
+	unsigned char *out;
+	size_t start;
+	uint32_t uc;
+	int i, v;
+
+	// The text can't be longer than the JSON string, so unescape it after
+	// the maximum head size and then move it down once the size is known
+	start = *len;
+	out = io_data->bin + start + CBOR_HEADMAX;
+
+	while (*ptr != '"') {
+		if (!*ptr)
+			return NULL;
+
+		if (*ptr != '\\') {
+			*(out++) = (unsigned char)*(ptr++);
+			continue;
+		}
+
+		ptr++;
+		switch (*(ptr++)) {
+			case '"':
+				*(out++) = '"';
+				break;
+			case '\\':
+				*(out++) = '\\';
+				break;
+			case '/':
+				*(out++) = '/';
+				break;
+			case 'b':
+				*(out++) = '\b';
+				break;
+			case 'f':
+				*(out++) = '\f';
+				break;
+			case 'n':
+				*(out++) = '\n';
+				break;
+			case 'r':
+				*(out++) = '\r';
+				break;
+			case 't':
+				*(out++) = '\t';
+				break;
+			case 'u':
+				uc = 0;
+				for (i = 0; i < 4; i++) {
+					if ((v = cbor_hexval(*(ptr++))) < 0)
+						return NULL;
+					uc = (uc << 4) | v;
+				}
+				// \uXXXX is at most 6 bytes so 3 bytes of UTF-8 always fits
+				if (uc < 0x80)
+					*(out++) = (unsigned char)uc;
+				else if (uc < 0x800) {
+					*(out++) = (unsigned char)(0xc0 | (uc >> 6));
+					*(out++) = (unsigned char)(0x80 | (uc & 0x3f));
+				} else {
+					*(out++) = (unsigned char)(0xe0 | (uc >> 12));
+					*(out++) = (unsigned char)(0x80 | ((uc >> 6) & 0x3f));
+					*(out++) = (unsigned char)(0x80 | (uc & 0x3f));
+				}
+				break;
+			default:
+				return NULL;
+		}
+	}
+
+	uc = (uint32_t)(out - (io_data->bin + start + CBOR_HEADMAX));
+	cbor_head(io_data, len, CBOR_TEXT, uc);
+	memmove(io_data->bin + *len, io_data->bin + start + CBOR_HEADMAX, uc);
+	*len += uc;
+
+	return ptr + 1;
+}
+
+static char *cbor_number(struct io_data *io_data, size_t *len, char *ptr)
+{
+	unsigned long long uval;
+	char *end, *num = ptr;
+	bool isreal = false;
+	uint64_t bits;
+	double dval;
+	float fval;
+	int i;
+
+	if (*num == '-')
+		num++;
+
+	for (end = num; *end; end++) {
+		if (*end == '.' || *end == 'e' || *end == 'E')
+			isreal = true;
+		else if (!isdigit(*end) && *end != '+' && *end != '-')
+			break;
+	}
+
+	if (!isreal) {
+		errno = 0;
+		uval = strtoull(num, &end, 10);
+		if (errno == 0 && end != num) {
+			if (num != ptr) {
+				if (uval == 0) {
+					cbor_head(io_data, len, CBOR_UINT, 0);
+					return end;
+				}
+				cbor_head(io_data, len, CBOR_NINT, (uint64_t)(uval - 1));
+			} else
+				cbor_head(io_data, len, CBOR_UINT, (uint64_t)uval);
+			return end;
+		}
+		// Out of range so send it as a real
+	}
+
+	dval = strtod(ptr, &end);
+	if (end == ptr)
+		return NULL;
+
+	fval = (float)dval;
+	if ((double)fval == dval) {
+		uint32_t fbits;
+
+		memcpy(&fbits, &fval, sizeof(fbits));
+		cbor_byte(io_data, len, CBOR_FLOAT32);
+		for (i = 3; i >= 0; i--)
+			cbor_byte(io_data, len, (unsigned char)(fbits >> (i * 8)));
+	} else {
+		memcpy(&bits, &dval, sizeof(bits));
+		cbor_byte(io_data, len, CBOR_FLOAT64);
+		for (i = 7; i >= 0; i--)
+			cbor_byte(io_data, len, (unsigned char)(bits >> (i * 8)));
+	}
+
+	return end;
+}
+
+// Returns the CBOR length or 0 if the JSON couldn't be transcoded
+static size_t json_to_cbor(struct io_data *io_data, char *json)
+{
+	size_t jlen, len = 0;
+	char *ptr = json;
+	int depth = 0;
+
+	// No CBOR item is larger than the JSON it came from, except a 1 or 2
+	// character number could become a 9 byte float64
+	jlen = strlen(json);
+	if (io_data->binsiz < jlen * 5 + CBOR_HEADMAX) {
+		io_data->binsiz = jlen * 5 + CBOR_HEADMAX;
+		io_data->bin = realloc(io_data->bin, io_data->binsiz);
+		if (!io_data->bin)
+			quithere(1, "OOM cbor bin (%d)", (int)(io_data->binsiz));
+	}
+
+	while (*ptr) {
+		switch (*ptr) {
+			case '{':
+				cbor_byte(io_data, &len, CBOR_MAP | CBOR_INDEF);
+				depth++;
+				ptr++;
+				break;
+			case '[':
+				cbor_byte(io_data, &len, CBOR_ARRAY | CBOR_INDEF);
+				depth++;
+				ptr++;
+				break;
+			case '}':
+			case ']':
+				if (--depth < 0)
+					return 0;
+				cbor_byte(io_data, &len, CBOR_BREAK);
+				ptr++;
+				break;
+			case ',':
+			case ':':
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\n':
+				ptr++;
+				break;
+			case '"':
+				ptr = cbor_text(io_data, &len, ptr + 1);
+				break;
+			case 't':
+				if (strncmp(ptr, TRUESTR, strlen(TRUESTR)))
+					return 0;
+				cbor_byte(io_data, &len, CBOR_TRUE);
+				ptr += strlen(TRUESTR);
+				break;
+			case 'f':
+				if (strncmp(ptr, FALSESTR, strlen(FALSESTR)))
+					return 0;
+				cbor_byte(io_data, &len, CBOR_FALSE);
+				ptr += strlen(FALSESTR);
+				break;
+			case 'n':
+				if (strncmp(ptr, "null", 4))
+					return 0;
+				cbor_byte(io_data, &len, CBOR_NULL);
+				ptr += 4;
+				break;
+			default:
+				ptr = cbor_number(io_data, &len, ptr);
+				break;
+		}
+		if (!ptr)
+			return 0;
+	}
+
+	if (depth != 0)
+		return 0;
+
+	return len;
+}
+
 static void send_result(struct io_data *io_data, SOCKETTYPE c, bool isjson)
 {
 	int count, sendc, res, tosend, len, n;
@@ -4209,7 +5077,19 @@ static void send_result(struct io_data *io_data, SOCKETTYPE c, bool isjson)
 	len = strlen(buf);
 	tosend = len+1;
 
-	applog(LOG_DEBUG, "API: send reply: (%d) '%.10s%s'", tosend, buf, len > 10 ? "..." : BLANK);
+	if (isjson && io_data->cbor) {
+		size_t binlen = json_to_cbor(io_data, buf);
+
+		if (binlen > 0) {
+			applog(LOG_DEBUG, "API: send reply: (%d) cbor from (%d) json", (int)binlen, tosend);
+			buf = (char *)(io_data->bin);
+			len = tosend = (int)binlen;
+		} else {
+			applog(LOG_WARNING, "API: cbor encode failed, sending json");
+			applog(LOG_DEBUG, "API: send reply: (%d) '%.10s%s'", tosend, buf, len > 10 ? "..." : BLANK);
+		}
+	} else
+		applog(LOG_DEBUG, "API: send reply: (%d) '%.10s%s'", tosend, buf, len > 10 ? "..." : BLANK);
 
 	count = sendc = 0;
 	while (count < 5 && tosend > 0) {
@@ -4912,6 +5792,7 @@ void api(int api_thr_id)
 				io_reinit(io_data);
 
 				did = false;
+				io_data->cbor = false;
 
 				if (*buf != ISJSON) {
 					isjson = false;
@@ -4946,6 +5827,10 @@ void api(int api_thr_id)
 								did = true;
 							} else {
 								cmd = (char *)json_string_value(json_val);
+								json_val = json_object_get(json_config, JSON_ENCODING);
+								if (json_is_string(json_val) &&
+								    strcasecmp(json_string_value(json_val), CBORSTR) == 0)
+									io_data->cbor = true;
 								json_val = json_object_get(json_config, JSON_PARAMETER);
 								if (json_is_string(json_val))
 									param = (char *)json_string_value(json_val);
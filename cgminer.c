@@ -54,6 +54,9 @@ char *curly = ":D";
 #include "compat.h"
 #include "miner.h"
 #include "bench_block.h"
+#include "trace.h"
+#include "proxy.h"
+#include "verify.h"
 #ifdef USE_USBUTILS
 #include "usbutils.h"
 #endif
@@ -156,6 +159,7 @@ bool opt_compact;
 const int opt_cutofftemp = 95;
 int opt_log_interval = 5;
 int opt_queue = 9999;
+static int opt_submit_threads = 4;
 static int max_queue = 1;
 int opt_scantime = -1;
 int opt_expiry = 120;
@@ -189,6 +193,8 @@ static bool switch_status;
 static bool opt_submit_stale = true;
 static int opt_shares;
 bool opt_fail_only;
+bool opt_extranonce_subscribe;
+bool opt_version_rolling;
 static bool opt_fix_protocol;
 bool opt_lowmem;
 bool opt_autofan;
@@ -257,6 +263,7 @@ int opt_minion_chipreport;
 char *opt_minion_cores;
 char *opt_minion_freq;
 bool opt_minion_idlecount;
+bool opt_minion_interrupt;
 int opt_minion_ledcount;
 int opt_minion_ledlimit = 98;
 bool opt_minion_noautofreq;
@@ -305,7 +312,7 @@ static int new_devices;
 static int new_threads;
 int hotplug_time = 5;
 
-#if LOCK_TRACKING
+#if LOCK_TRACKING || LOCK_PROFILING
 pthread_mutex_t lockstat_lock;
 #endif
 
@@ -314,7 +321,7 @@ static pthread_mutex_t *stgd_lock;
 pthread_mutex_t console_lock;
 cglock_t ch_lock;
 static pthread_rwlock_t blk_lock;
-static pthread_mutex_t sshare_lock;
+pthread_mutex_t sshare_lock;
 
 pthread_rwlock_t netacc_lock;
 pthread_rwlock_t mining_thr_lock;
@@ -638,8 +645,6 @@ void adjust_quota_gcd(void)
 
 	for (i = 0; i < total_pools; i++) {
 		pool = pools[i];
-		pool->quota_used *= global_quota_gcd;
-		pool->quota_used /= gcd;
 		pool->quota_gcd = pool->quota / gcd;
 	}
 
@@ -1288,6 +1293,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--expiry|-E",
 		     set_int_0_to_9999, opt_show_intval, &opt_expiry,
 		     "Upper bound on how many seconds after getting work we consider a share from it stale"),
+	OPT_WITHOUT_ARG("--extranonce-subscribe",
+			opt_set_bool, &opt_extranonce_subscribe,
+			"Ask stratum pools to send extranonce changes instead of reconnecting"),
 	OPT_WITHOUT_ARG("--failover-only",
 			opt_set_bool, &opt_fail_only,
 			"Don't leak work to backup pools when primary pool is lagging"),
@@ -1366,6 +1374,12 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--log|-l",
 		     set_int_0_to_9999, opt_show_intval, &opt_log_interval,
 		     "Interval in seconds between log output"),
+	OPT_WITHOUT_ARG("--log-async",
+			opt_set_bool, &opt_log_async,
+			"Write log messages from a separate thread so logging never waits on output"),
+	OPT_WITH_ARG("--log-rate",
+		     set_int_0_to_9999, opt_show_intval, &opt_log_rate,
+		     "Max messages a second from each per nonce/packet log message, 0 means no limit"),
 	OPT_WITHOUT_ARG("--lowmem",
 			opt_set_bool, &opt_lowmem,
 			"Minimise caching of shares for low memory applications"),
@@ -1382,6 +1396,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--minion-idlecount",
 		     opt_set_bool, &opt_minion_idlecount,
 		     "Report when IdleCount is >0 or changes"),
+	OPT_WITHOUT_ARG("--minion-interrupt",
+		     opt_set_bool, &opt_minion_interrupt,
+		     "Use the GPIO result interrupt to collect results instead of polling"),
 	OPT_WITH_ARG("--minion-ledcount",
 		     set_int_0_to_100, opt_show_intval, &opt_minion_ledcount,
 		     "Turn off led when more than this many chips below the ledlimit (default: 0)"),
@@ -1497,6 +1514,15 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--socks-proxy",
 		     opt_set_charp, NULL, &opt_socks_proxy,
 		     "Set socks4 proxy (host:port)"),
+	OPT_WITH_ARG("--stratum-server",
+		     set_int_1_to_65535, opt_show_intval, &opt_stratum_server,
+		     "Serve work from the current stratum pool to LAN miners on this port"),
+	OPT_WITH_ARG("--stratum-server-bind",
+		     opt_set_charp, NULL, &opt_stratum_server_bind,
+		     "IP address for the stratum server to listen on (default: 127.0.0.1)"),
+	OPT_WITH_ARG("--submit-threads",
+		     set_int_1_to_10, opt_show_intval, &opt_submit_threads,
+		     "Maximum concurrent share submissions per getwork/GBT pool"),
 #ifdef HAVE_SYSLOG_H
 	OPT_WITHOUT_ARG("--syslog",
 			opt_set_bool, &use_syslog,
@@ -1538,6 +1564,12 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--verbose",
 			opt_set_bool, &opt_log_output,
 			"Log verbose output to stderr as well as status output"),
+	OPT_WITH_ARG("--verify-threads",
+		     set_int_0_to_10, opt_show_intval, &opt_verify_threads,
+		     "Number of threads to verify and submit nonces for drivers that support it, 0 means in the driver thread"),
+	OPT_WITHOUT_ARG("--version-rolling",
+			opt_set_bool, &opt_version_rolling,
+			"Negotiate BIP310 version rolling with stratum pools"),
 	OPT_WITHOUT_ARG("--widescreen",
 			opt_set_bool, &opt_widescreen,
 			"Use extra wide display without toggling"),
@@ -1883,10 +1915,16 @@ static struct work *make_work(void)
  * cleaned to remove any dynamically allocated arrays within the struct */
 void clean_work(struct work *work)
 {
-	free(work->job_id);
-	free(work->ntime);
-	free(work->coinbase);
-	free(work->nonce1);
+	if (work->master) {
+		/* The last view of a master frees the shared strings */
+		if (__sync_sub_and_fetch(&work->master->views, 1) == 0)
+			_free_work(work->master);
+	} else {
+		free(work->job_id);
+		free(work->ntime);
+		free(work->coinbase);
+		free(work->nonce1);
+	}
 	memset(work, 0, sizeof(struct work));
 }
 
@@ -1903,18 +1941,63 @@ static void calc_diff(struct work *work, double known);
 char *workpadding = "000000800000000000000000000000000000000000000000000000000000000000000000000000000000000080020000";
 
 #ifdef HAVE_LIBCURL
+/* A decoded GBT transaction set and its merkle branch. These are built by
+ * gbt_merkle_bins() without holding gbt_lock then swapped into the pool with
+ * __gbt_set_txns() so work generation isn't stalled by large templates */
+struct gbt_txnset {
+	unsigned char *txn_bin;
+	int txn_len;
+	int transactions;
+	unsigned char *txids;
+	int *ofs;
+	int reused;
+	unsigned char merklebin[16 * 32];
+	int merkles;
+};
+
+static void gbt_txnset_free(struct gbt_txnset *set)
+{
+	free(set->txn_bin);
+	set->txn_bin = NULL;
+	free(set->txids);
+	set->txids = NULL;
+	free(set->ofs);
+	set->ofs = NULL;
+}
+
 /* Process transactions with GBT by storing the binary value of the first
  * transaction, and the hashes of the remaining transactions since these
- * remain constant with an altered coinbase when generating work. Must be
- * entered under gbt_lock */
-static void gbt_merkle_bins(struct pool *pool, json_t *transaction_arr);
-
-static void __build_gbt_txns(struct pool *pool, json_t *res_val)
+ * remain constant with an altered coinbase when generating work.
+ * If reuse is set, transactions already in the pool's set are copied from it
+ * rather than decoded again, which is only safe if nothing else can replace
+ * the pool's set while this runs */
+static bool gbt_merkle_bins(struct pool *pool, json_t *transaction_arr, struct gbt_txnset *set,
+			    bool reuse);
+
+/* Must be entered under gbt_lock */
+static void __gbt_set_txns(struct pool *pool, struct gbt_txnset *set)
+{
+	free(pool->txn_bin);
+	pool->txn_bin = set->txn_bin;
+	pool->txn_len = set->txn_len;
+	pool->transactions = set->transactions;
+	free(pool->txn_hashes);
+	pool->txn_hashes = set->txids;
+	free(pool->txn_ofs);
+	pool->txn_ofs = set->ofs;
+	memcpy(pool->merklebin, set->merklebin, sizeof(pool->merklebin));
+	pool->merkles = set->merkles;
+	set->txn_bin = NULL;
+	set->txids = NULL;
+	set->ofs = NULL;
+}
+
+static bool gbt_build_txns(struct pool *pool, json_t *res_val, struct gbt_txnset *set)
 {
 	json_t *txn_array;
 
 	txn_array = json_object_get(res_val, "transactions");
-	gbt_merkle_bins(pool, txn_array);
+	return gbt_merkle_bins(pool, txn_array, set, false);
 }
 
 static void __gbt_merkleroot(struct pool *pool, unsigned char *merkle_root)
@@ -2045,6 +2128,7 @@ static bool gbt_decode(struct pool *pool, json_t *res_val)
 	int cbt_len, orig_len;
 	uint8_t *extra_len;
 	size_t cal_len;
+	struct gbt_txnset set;
 
 	previousblockhash = json_string_value(json_object_get(res_val, "previousblockhash"));
 	target = json_string_value(json_object_get(res_val, "target"));
@@ -2075,6 +2159,9 @@ static bool gbt_decode(struct pool *pool, json_t *res_val)
 	if (workid)
 		applog(LOG_DEBUG, "workid: %s", workid);
 
+	if (unlikely(!gbt_build_txns(pool, res_val, &set)))
+		return false;
+
 	cg_wlock(&pool->gbt_lock);
 	free(pool->coinbasetxn);
 	pool->coinbasetxn = strdup(coinbasetxn);
@@ -2118,7 +2205,7 @@ static bool gbt_decode(struct pool *pool, json_t *res_val)
 
 	hex2bin((unsigned char *)&pool->gbt_bits, bits, 4);
 
-	__build_gbt_txns(pool, res_val);
+	__gbt_set_txns(pool, &set);
 	cg_wunlock(&pool->gbt_lock);
 
 	return true;
@@ -2150,100 +2237,231 @@ static bool pool_localgen(struct pool *pool)
 	return (pool->has_stratum || pool->has_gbt || pool->gbt_solo);
 }
 
-static void gbt_merkle_bins(struct pool *pool, json_t *transaction_arr)
+/* Hash batches of at least MERKLE_THREAD_MIN items are split across
+ * MERKLE_THREADS threads including the caller */
+#define MERKLE_THREADS 4
+#define MERKLE_THREAD_MIN 256
+
+struct merkle_job {
+	unsigned char *dst;
+	unsigned char *src;
+	/* If set, item i is src[ofs[i]] to src[ofs[i + 1]] and is skipped when
+	 * done[i] is set, otherwise item i is the 64 bytes at src + i * 64 */
+	int *ofs;
+	bool *done;
+	int start;
+	int end;
+};
+
+static void *merkle_worker(void *userdata)
+{
+	struct merkle_job *job = (struct merkle_job *)userdata;
+	int i;
+
+	for (i = job->start; i < job->end; i++) {
+		if (job->ofs) {
+			if (!job->done[i]) {
+				gen_hash(job->src + job->ofs[i], job->dst + i * 32,
+					 job->ofs[i + 1] - job->ofs[i]);
+			}
+		} else
+			gen_hash(job->src + i * 64, job->dst + i * 32, 64);
+	}
+	return NULL;
+}
+
+/* gen_hash() items start to end - 1 into dst + i * 32, in parallel for large
+ * batches. Falls back to hashing in the calling thread if a thread can't be
+ * created */
+static void merkle_hash(unsigned char *dst, unsigned char *src, int *ofs, bool *done,
+			int start, int end)
+{
+	struct merkle_job job[MERKLE_THREADS];
+	pthread_t pth[MERKLE_THREADS];
+	bool started[MERKLE_THREADS];
+	int i, threads = 1, per;
+
+	if (end - start >= MERKLE_THREAD_MIN)
+		threads = MERKLE_THREADS;
+	per = (end - start + threads - 1) / threads;
+
+	for (i = 0; i < threads; i++) {
+		job[i].dst = dst;
+		job[i].src = src;
+		job[i].ofs = ofs;
+		job[i].done = done;
+		job[i].start = start + i * per;
+		job[i].end = MIN(job[i].start + per, end);
+		started[i] = false;
+		// The last batch is always done by the caller
+		if (i < threads - 1 &&
+		    likely(!pthread_create(&pth[i], NULL, merkle_worker, (void *)&job[i])))
+			started[i] = true;
+		else
+			merkle_worker((void *)&job[i]);
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (started[i])
+			pthread_join(pth[i], NULL);
+	}
+}
+
+/* Index of the pool's current transactions by txid for gbt_merkle_bins() */
+struct txn_index {
+	unsigned char *txid;
+	int txn;
+	UT_hash_handle hh;
+};
+
+static bool gbt_merkle_bins(struct pool *pool, json_t *transaction_arr, struct gbt_txnset *set,
+			    bool reuse)
 {
-	unsigned char *hashbin;
+	struct txn_index *index = NULL, *items = NULL, *item;
+	unsigned char *hashbin, *nextbin, *tmp;
+	int i, binleft, len = 0;
 	json_t *arr_val;
-	int i, j, binleft, binlen;
-
-	free(pool->txn_data);
-	pool->txn_data = NULL;
-	pool->transactions = 0;
-	pool->merkles = 0;
-	pool->transactions = json_array_size(transaction_arr);
-	binlen = pool->transactions * 32 + 32;
-	hashbin = alloca(binlen + 32);
-	memset(hashbin, 0, 32);
-	binleft = binlen / 32;
-	if (pool->transactions) {
-		int len = 0, ofs = 0;
+	bool *done;
+	int *ofs;
+
+	memset(set, 0, sizeof(*set));
+	if (reuse && pool->txn_bin && pool->txn_hashes && pool->transactions) {
+		items = calloc(pool->transactions, sizeof(*items));
+		if (unlikely(!items))
+			quit(1, "Failed to calloc txn index in gbt_merkle_bins");
+		for (i = 0; i < pool->transactions; i++) {
+			items[i].txid = pool->txn_hashes + i * 32;
+			items[i].txn = i;
+			HASH_ADD_KEYPTR(hh, index, items[i].txid, 32, &items[i]);
+		}
+	}
+	set->transactions = json_array_size(transaction_arr);
+
+	/* Entry 0 is left for the coinbase, then one entry per transaction,
+	 * and room to duplicate the last entry of an odd level */
+	hashbin = calloc(set->transactions + 2, 32);
+	nextbin = calloc(set->transactions + 2, 32);
+	ofs = malloc(sizeof(*ofs) * (set->transactions + 1));
+	done = calloc(set->transactions + 1, sizeof(*done));
+	if (unlikely(!hashbin || !nextbin || !ofs || !done))
+		quit(1, "Failed to alloc merkle arrays in gbt_merkle_bins");
+
+	if (set->transactions) {
 		const char *txn;
 
-		for (i = 0; i < pool->transactions; i++) {
+		/* Decode the transactions once, straight into one binary
+		 * store, so block submission never needs the JSON again */
+		for (i = 0; i < set->transactions; i++) {
 			arr_val = json_array_get(transaction_arr, i);
 			txn = json_string_value(json_object_get(arr_val, "data"));
 			if (!txn) {
 				applog(LOG_ERR, "Pool %d json_string_value fail - cannot find transaction data",
 					pool->pool_no);
-				return;
+				goto failed;
 			}
-			len += strlen(txn);
+			ofs[i] = len;
+			len += strlen(txn) / 2;
 		}
+		ofs[i] = len;
 
-		pool->txn_data = malloc(len + 1);
-		if (unlikely(!pool->txn_data))
-			quit(1, "Failed to calloc txn_data in gbt_merkle_bins");
-		pool->txn_data[len] = '\0';
+		set->txn_bin = malloc(len + 1);
+		if (unlikely(!set->txn_bin))
+			quit(1, "Failed to malloc txn_bin in gbt_merkle_bins");
 
-		for (i = 0; i < pool->transactions; i++) {
+		for (i = 0; i < set->transactions; i++) {
 			unsigned char binswap[32];
 			const char *hash;
 
 			arr_val = json_array_get(transaction_arr, i);
 			hash = json_string_value(json_object_get(arr_val, "hash"));
 			txn = json_string_value(json_object_get(arr_val, "data"));
-			len = strlen(txn);
-			memcpy(pool->txn_data + ofs, txn, len);
-			ofs += len;
-			if (!hash) {
-				unsigned char *txn_bin;
-				int txn_len;
-
-				txn_len = len / 2;
-				txn_bin = malloc(txn_len);
-				if (!txn_bin)
-					quit(1, "Failed to malloc txn_bin in gbt_merkle_bins");
-				hex2bin(txn_bin, txn, txn_len);
-				/* This is needed for pooled mining since only
-				 * transaction data and not hashes are sent */
-				gen_hash(txn_bin, hashbin + 32 + 32 * i, txn_len);
-				continue;
+			/* Transactions without a hash are needed for pooled
+			 * mining since only transaction data and not hashes
+			 * are sent, and are hashed below */
+			if (hash) {
+				if (!hex2bin(binswap, hash, 32)) {
+					applog(LOG_ERR, "Failed to hex2bin hash in gbt_merkle_bins");
+					goto failed;
+				}
+				swab256(hashbin + 32 + 32 * i, binswap);
+				done[i] = true;
+
+				item = NULL;
+				if (index)
+					HASH_FIND(hh, index, hashbin + 32 + 32 * i, 32, item);
+				if (item && pool->txn_ofs[item->txn + 1] - pool->txn_ofs[item->txn] ==
+					    ofs[i + 1] - ofs[i]) {
+					memcpy(set->txn_bin + ofs[i], pool->txn_bin + pool->txn_ofs[item->txn],
+					       ofs[i + 1] - ofs[i]);
+					set->reused++;
+					continue;
+				}
 			}
-			if (!hex2bin(binswap, hash, 32)) {
-				applog(LOG_ERR, "Failed to hex2bin hash in gbt_merkle_bins");
-				return;
+			if (unlikely(!hex2bin(set->txn_bin + ofs[i], txn, ofs[i + 1] - ofs[i]))) {
+				applog(LOG_ERR, "Failed to hex2bin txn in gbt_merkle_bins");
+				goto failed;
 			}
-			swab256(hashbin + 32 + 32 * i, binswap);
 		}
+		set->txn_len = len;
+
+		merkle_hash(hashbin + 32, set->txn_bin, ofs, done, 0, set->transactions);
+
+		set->txids = malloc(set->transactions * 32);
+		if (unlikely(!set->txids))
+			quit(1, "Failed to malloc txids in gbt_merkle_bins");
+		memcpy(set->txids, hashbin + 32, set->transactions * 32);
 	}
-	if (binleft > 1) {
-		while (42) {
-			if (binleft == 1)
-				break;
-			memcpy(pool->merklebin + (pool->merkles * 32), hashbin + 32, 32);
-			pool->merkles++;
-			if (binleft % 2) {
-				memcpy(hashbin + binlen, hashbin + binlen - 32, 32);
-				binlen += 32;
-				binleft++;
-			}
-			for (i = 32, j = 64; j < binlen; i += 32, j += 64) {
-				gen_hash(hashbin + j, hashbin + i, 64);
-			}
-			binleft /= 2;
-			binlen = binleft * 32;
+	set->ofs = ofs;
+
+	/* Each level is hashed from hashbin into nextbin, not in place, so it
+	 * can be split across threads */
+	binleft = set->transactions + 1;
+	while (binleft > 1) {
+		if (unlikely(set->merkles >= (int)(sizeof(set->merklebin) / 32))) {
+			applog(LOG_ERR, "Pool %d too many transactions for merkle branch",
+			       pool->pool_no);
+			goto failed;
 		}
+		memcpy(set->merklebin + (set->merkles * 32), hashbin + 32, 32);
+		set->merkles++;
+		if (binleft % 2) {
+			memcpy(hashbin + binleft * 32, hashbin + (binleft - 1) * 32, 32);
+			binleft++;
+		}
+		binleft /= 2;
+		merkle_hash(nextbin, hashbin, NULL, NULL, 1, binleft);
+		tmp = hashbin;
+		hashbin = nextbin;
+		nextbin = tmp;
 	}
 	if (opt_debug) {
 		char hashhex[68];
 
-		for (i = 0; i < pool->merkles; i++) {
-			__bin2hex(hashhex, pool->merklebin + i * 32, 32);
+		for (i = 0; i < set->merkles; i++) {
+			__bin2hex(hashhex, set->merklebin + i * 32, 32);
 			applog(LOG_DEBUG, "MH%d %s",i, hashhex);
 		}
 	}
-	applog(LOG_INFO, "Stored %d transactions from pool %d", pool->transactions,
-		pool->pool_no);
+	applog(LOG_INFO, "Stored %d transactions (%d bytes, %d reused) from pool %d",
+		set->transactions, set->txn_len, set->reused, pool->pool_no);
+
+	HASH_CLEAR(hh, index);
+	free(items);
+	free(done);
+	free(nextbin);
+	free(hashbin);
+	return true;
+
+failed:
+	HASH_CLEAR(hh, index);
+	free(items);
+	if (set->ofs != ofs)
+		free(ofs);
+	gbt_txnset_free(set);
+	free(done);
+	free(nextbin);
+	free(hashbin);
+	return false;
 }
 
 static double diff_from_target(void *target);
@@ -2261,6 +2479,7 @@ static bool gbt_solo_decode(struct pool *pool, json_t *res_val)
 	uint64_t coinbasevalue;
 	const char *flags;
 	const char *bits;
+	const char *longpollid;
 	char header[228];
 	int ofs = 0, len;
 	uint64_t *u64;
@@ -2268,6 +2487,8 @@ static bool gbt_solo_decode(struct pool *pool, json_t *res_val)
 	int version;
 	int curtime;
 	int height;
+	struct gbt_txnset set;
+	unsigned char prevblock[32];
 
 	previousblockhash = json_string_value(json_object_get(res_val, "previousblockhash"));
 	target = json_string_value(json_object_get(res_val, "target"));
@@ -2279,6 +2500,7 @@ static bool gbt_solo_decode(struct pool *pool, json_t *res_val)
 	coinbasevalue = json_integer_value(json_object_get(res_val, "coinbasevalue"));
 	coinbase_aux = json_object_get(res_val, "coinbaseaux");
 	flags = json_string_value(json_object_get(coinbase_aux, "flags"));
+	longpollid = json_string_value(json_object_get(res_val, "longpollid"));
 
 	if (!previousblockhash || !target || !version || !curtime || !bits || !coinbase_aux || !flags) {
 		applog(LOG_ERR, "Pool %d JSON failed to decode GBT", pool->pool_no);
@@ -2292,12 +2514,53 @@ static bool gbt_solo_decode(struct pool *pool, json_t *res_val)
 	applog(LOG_DEBUG, "bits: %s", bits);
 	applog(LOG_DEBUG, "height: %d", height);
 	applog(LOG_DEBUG, "flags: %s", flags);
+	if (longpollid)
+		applog(LOG_DEBUG, "longpollid: %s", longpollid);
+
+	/* Solo templates are only decoded by the holder of gbt_curl so the
+	 * current transactions can be reused while building the new set */
+	if (unlikely(!gbt_merkle_bins(pool, transaction_arr, &set, true)))
+		return false;
 
-	cg_wlock(&pool->gbt_lock);
 	hex2bin(hash_swap, previousblockhash, 32);
-	swap256(pool->previousblockhash, hash_swap);
+	swap256(prevblock, hash_swap);
+
+	/* If nothing but the time has changed, keep the current template, and
+	 * the work generated from it, and just update the time */
+	if (pool->coinbase && !memcmp(prevblock, pool->previousblockhash, 32) &&
+	    height == pool->height && (int64_t)coinbasevalue == pool->nValue &&
+	    set.transactions == pool->transactions && set.merkles == pool->merkles &&
+	    !memcmp(set.merklebin, pool->merklebin, set.merkles * 32)) {
+		gbt_txnset_free(&set);
+
+		cg_wlock(&pool->gbt_lock);
+		pool->curtime = htobe32(curtime);
+		snprintf(pool->ntime, 9, "%08x", curtime);
+		if (longpollid) {
+			free(pool->longpollid);
+			pool->longpollid = strdup(longpollid);
+		}
+		cg_wunlock(&pool->gbt_lock);
+
+		applog(LOG_DEBUG, "Pool %d template %d unchanged", pool->pool_no, pool->gbt_id);
+		goto out_header;
+	}
+
+	if (memcmp(prevblock, pool->previousblockhash, 32)) {
+		applog(LOG_INFO, "Pool %d new block template with %d transactions",
+		       pool->pool_no, set.transactions);
+	} else {
+		applog(LOG_INFO, "Pool %d template transactions updated, %d of %d reused",
+		       pool->pool_no, set.reused, set.transactions);
+	}
+
+	cg_wlock(&pool->gbt_lock);
+	memcpy(pool->previousblockhash, prevblock, 32);
 	__bin2hex(pool->prev_hash, pool->previousblockhash, 32);
 
+	free(pool->longpollid);
+	pool->longpollid = longpollid ? strdup(longpollid) : NULL;
+
 	hex2bin(hash_swap, target, 32);
 	swab256(pool->gbt_target, hash_swap);
 	pool->sdiff = diff_from_target(pool->gbt_target);
@@ -2309,7 +2572,22 @@ static bool gbt_solo_decode(struct pool *pool, json_t *res_val)
 	snprintf(pool->nbit, 9, "%s", bits);
 	pool->nValue = coinbasevalue;
 	hex2bin((unsigned char *)&pool->gbt_bits, bits, 4);
-	gbt_merkle_bins(pool, transaction_arr);
+
+	/* Keep the outgoing template so a block solved by work already
+	 * generated from it can still be rebuilt on submission */
+	free(pool->gbt_prev.coinbase);
+	free(pool->gbt_prev.txn_bin);
+	pool->gbt_prev.id = pool->gbt_id++;
+	pool->gbt_prev.coinbase = pool->coinbase;
+	pool->gbt_prev.coinbase_len = pool->coinbase_len;
+	pool->gbt_prev.nonce2_offset = pool->nonce2_offset;
+	pool->gbt_prev.n2size = pool->n2size;
+	pool->gbt_prev.txn_bin = pool->txn_bin;
+	pool->gbt_prev.txn_len = pool->txn_len;
+	pool->coinbase = NULL;
+	pool->txn_bin = NULL;
+
+	__gbt_set_txns(pool, &set);
 	pool->height = height;
 
 	memset(pool->scriptsig_base, 0, 42);
@@ -2378,6 +2656,7 @@ static bool gbt_solo_decode(struct pool *pool, json_t *res_val)
 	pool->coinbase_len = 41 + ofs + 4 + 1 + 8 + 1 + 25 + 4;
 	cg_wunlock(&pool->gbt_lock);
 
+out_header:
 	snprintf(header, 225, "%s%s%s%s%s%s%s",
 		 pool->bbversion,
 		 pool->prev_hash,
@@ -3148,6 +3427,127 @@ static void print_status(int thr_id)
 		text_print_status(thr_id);
 }
 
+/* Serialise a GBT submitblock request straight into one buffer sized up front
+ * rather than growing it with realloc_strcat, since with solo mining it carries
+ * every transaction in the template. GBT pools with coinbase/append support
+ * already have the transactions and work carries its own coinbase. Solo work
+ * has its coinbase rebuilt here from the template it was generated from and
+ * its nonce2, and returns NULL if that template is no longer held.
+ * The request is returned with its trailing newline */
+static char *gbt_submitblock(struct pool *pool, struct work *work)
+{
+	static const char prefix[] = "{\"id\": 0, \"method\": \"submitblock\", \"params\": [\"";
+	static const char workid[] = "\", {\"workid\": \"";
+	static const char workid_end[] = "\"}]}\n";
+	static const char end[] = "\"]}\n";
+	unsigned char data[80], varint[5];
+	unsigned char *cbbin = NULL, *txn_bin = NULL;
+	int varlen, cblen, cbbin_len = 0, n2ofs = 0, n2size = 0, txn_len = 0;
+	uint64_t nonce2le;
+	size_t len;
+	char *s, *p;
+
+	flip80(data, work->data);
+
+	if (work->gbt_txns < 0xfd) {
+		varint[0] = work->gbt_txns;
+		varlen = 1;
+	} else if (work->gbt_txns <= 0xffff) {
+		uint16_t val16 = htole16(work->gbt_txns);
+
+		varint[0] = 0xfd;
+		memcpy(varint + 1, &val16, 2);
+		varlen = 3;
+	} else {
+		uint32_t val32 = htole32(work->gbt_txns);
+
+		varint[0] = 0xfe;
+		memcpy(varint + 1, &val32, 4);
+		varlen = 5;
+	}
+
+	cg_rlock(&pool->gbt_lock);
+	if (work->coinbase)
+		cblen = strlen(work->coinbase);
+	else {
+		struct gbt_block *prev = &pool->gbt_prev;
+
+		if (work->gbt_id == pool->gbt_id) {
+			cbbin = pool->coinbase;
+			cbbin_len = pool->coinbase_len;
+			n2ofs = pool->nonce2_offset;
+			n2size = pool->n2size;
+			txn_bin = pool->txn_bin;
+			txn_len = pool->txn_len;
+		} else if (work->gbt_id == prev->id && prev->coinbase) {
+			cbbin = prev->coinbase;
+			cbbin_len = prev->coinbase_len;
+			n2ofs = prev->nonce2_offset;
+			n2size = prev->n2size;
+			txn_bin = prev->txn_bin;
+			txn_len = prev->txn_len;
+		} else {
+			cg_runlock(&pool->gbt_lock);
+			applog(LOG_ERR, "Pool %d template %d for block solve no longer held, unable to submit",
+			       pool->pool_no, work->gbt_id);
+			return NULL;
+		}
+		cblen = cbbin_len * 2;
+		if (!txn_bin)
+			txn_len = 0;
+	}
+
+	len = sizeof(prefix) + 160 + varlen * 2 + cblen + txn_len * 2;
+	if (work->job_id)
+		len += sizeof(workid) + strlen(work->job_id) + sizeof(workid_end);
+	else
+		len += sizeof(end);
+
+	s = malloc(len);
+	if (unlikely(!s))
+		quit(1, "Failed to malloc s in gbt_submitblock");
+
+	p = s;
+	memcpy(p, prefix, sizeof(prefix) - 1);
+	p += sizeof(prefix) - 1;
+	__bin2hex(p, data, 80);
+	p += 160;
+	__bin2hex(p, varint, varlen);
+	p += varlen * 2;
+	if (work->coinbase) {
+		memcpy(p, work->coinbase, cblen);
+		p += cblen;
+	} else {
+		/* The pool coinbase holds whichever nonce2 was used last, so
+		 * put this work's LE encoded nonce2 in its place */
+		nonce2le = htole64(work->nonce2);
+		__bin2hex(p, cbbin, n2ofs);
+		p += n2ofs * 2;
+		__bin2hex(p, (const unsigned char *)&nonce2le, n2size);
+		p += n2size * 2;
+		__bin2hex(p, cbbin + n2ofs + n2size, cbbin_len - n2ofs - n2size);
+		p += (cbbin_len - n2ofs - n2size) * 2;
+	}
+	if (txn_len) {
+		__bin2hex(p, txn_bin, txn_len);
+		p += txn_len * 2;
+	}
+	cg_runlock(&pool->gbt_lock);
+
+	if (work->job_id) {
+		int idlen = strlen(work->job_id);
+
+		memcpy(p, workid, sizeof(workid) - 1);
+		p += sizeof(workid) - 1;
+		memcpy(p, work->job_id, idlen);
+		p += idlen;
+		memcpy(p, workid_end, sizeof(workid_end));
+	} else
+		memcpy(p, end, sizeof(end));
+
+	return s;
+}
+
 static bool submit_upstream_work(struct work *work, CURL *curl, bool resubmit)
 {
 	json_t *val, *res, *err;
@@ -3167,47 +3567,11 @@ static bool submit_upstream_work(struct work *work, CURL *curl, bool resubmit)
 
 	/* build JSON-RPC request */
 	if (work->gbt) {
-		char gbt_block[1024], varint[12];
-		unsigned char data[80];
-
-		flip80(data, work->data);
-		__bin2hex(gbt_block, data, 80); // 160 length
-
-		if (work->gbt_txns < 0xfd) {
-			uint8_t val8 = work->gbt_txns;
-
-			__bin2hex(varint, (const unsigned char *)&val8, 1);
-		} else if (work->gbt_txns <= 0xffff) {
-			uint16_t val16 = htole16(work->gbt_txns);
-
-			strcat(gbt_block, "fd"); // +2
-			__bin2hex(varint, (const unsigned char *)&val16, 2);
-		} else {
-			uint32_t val32 = htole32(work->gbt_txns);
-
-			strcat(gbt_block, "fe"); // +2
-			__bin2hex(varint, (const unsigned char *)&val32, 4);
-		}
-		strcat(gbt_block, varint); // +8 max
-		strcat(gbt_block, work->coinbase);
-
-		s = malloc(1024);
-		if (unlikely(!s))
-			quit(1, "Failed to malloc s in submit_upstream_work");
-		sprintf(s, "{\"id\": 0, \"method\": \"submitblock\", \"params\": [\"%s", gbt_block);
-		/* Has submit/coinbase support */
-		if (!pool->has_gbt) {
-			cg_rlock(&pool->gbt_lock);
-			if (pool->txn_data)
-				s = realloc_strcat(s, pool->txn_data);
-			cg_runlock(&pool->gbt_lock);
+		s = gbt_submitblock(pool, work);
+		if (unlikely(!s)) {
+			rc = true;
+			goto out;
 		}
-		if (work->job_id) {
-			s = realloc_strcat(s, "\", {\"workid\": \"");
-			s = realloc_strcat(s, work->job_id);
-			s = realloc_strcat(s, "\"}]}");
-		} else
-			s = realloc_strcat(s, "\"]}");
 	} else {
 		char *hexstr;
 
@@ -3221,7 +3585,8 @@ static bool submit_upstream_work(struct work *work, CURL *curl, bool resubmit)
 		free(hexstr);
 	}
 	applog(LOG_DEBUG, "DBG: sending %s submit RPC call: %s", pool->rpc_url, s);
-	s = realloc_strcat(s, "\n");
+	if (!work->gbt)
+		s = realloc_strcat(s, "\n");
 
 	cgtime(&tv_submit);
 	/* issue JSON-RPC request */
@@ -3422,13 +3787,101 @@ static struct pool *select_balanced(struct pool *cp)
 static struct pool *priority_pool(int choice);
 static bool pool_unusable(struct pool *pool);
 
-/* Select any active pool in a rotating fashion when loadbalance is chosen if
- * it has any quota left. */
+/* The load-balance strategy is a deficit round robin on the diff1 the devices
+ * actually do for each pool. Each diff1 done on any pool's work is owed to the
+ * workable pools in the ratio of their quotas and paid by the pool whose work
+ * it was. With failover-only, the quota of pools that can't provide work is
+ * owed to priority pool 0 instead. Pools that can't provide work owe and are
+ * owed nothing so they don't catch up when they come back. Must be called
+ * with stats_lock held. */
+static void __drr_credit(struct pool *owner, double diff1)
+{
+	struct pool *pool, *pool0 = NULL;
+	unsigned long quotas = 0, lost = 0;
+	int i;
+
+	if (pool_strategy != POOL_LOADBALANCE)
+		return;
+
+	for (i = 0; i < total_pools; i++) {
+		pool = pools[i];
+		if (!pool->quota)
+			continue;
+		if (pool_unworkable(pool))
+			lost += pool->quota;
+		else
+			quotas += pool->quota;
+	}
+	if (opt_fail_only && lost) {
+		pool0 = priority_pool(0);
+		if (pool_unworkable(pool0))
+			pool0 = NULL;
+		else
+			quotas += lost;
+	}
+	if (!quotas)
+		return;
+
+	for (i = 0; i < total_pools; i++) {
+		pool = pools[i];
+		if (!pool->quota || pool_unworkable(pool)) {
+			pool->drr_deficit = 0;
+			continue;
+		}
+		pool->drr_deficit += diff1 * pool->quota / quotas;
+		if (pool == pool0)
+			pool->drr_deficit += diff1 * lost / quotas;
+	}
+	if (owner->quota && !pool_unworkable(owner))
+		owner->drr_deficit -= diff1;
+}
+
+/* The workable pool with quota that is owed the most diff1, the highest
+ * priority one of those equally owed */
+static struct pool *select_drr(void)
+{
+	struct pool *pool, *ret = NULL;
+	int i;
+
+	mutex_lock(&stats_lock);
+	for (i = 0; i < total_pools; i++) {
+		pool = priority_pool(i);
+		if (!pool->quota || pool_unworkable(pool))
+			continue;
+		if (!ret || pool->drr_deficit > ret->drr_deficit)
+			ret = pool;
+	}
+	mutex_unlock(&stats_lock);
+
+	return ret;
+}
+
+/* The fraction of the work this pool should be getting by its quota, and the
+ * fraction of the diff1 recently done it did get */
+void pool_split(struct pool *pool, double *target, double *actual)
+{
+	unsigned long quotas = 0;
+	double rolling = 0;
+	int i;
+
+	for (i = 0; i < total_pools; i++) {
+		if (!pool_unworkable(pools[i]))
+			quotas += pools[i]->quota;
+		rolling += pools[i]->drr_rolling;
+	}
+
+	*target = 0;
+	if (pool_strategy == POOL_LOADBALANCE && quotas && !pool_unworkable(pool))
+		*target = (double)pool->quota / (double)quotas;
+	*actual = rolling > 0 ? pool->drr_rolling / rolling : 0;
+}
+
+/* Select the pool owed the most work when loadbalance is chosen, or the next
+ * workable pool when leaking work from a lagging pool. */
 static inline struct pool *select_pool(bool lagging)
 {
 	static int rotating_pool = 0;
 	struct pool *pool, *cp;
-	bool avail = false;
 	int tested, i;
 
 	cp = current_pool();
@@ -3444,38 +3897,16 @@ static inline struct pool *select_pool(bool lagging)
 	} else
 		pool = NULL;
 
-	for (i = 0; i < total_pools; i++) {
-		struct pool *tp = pools[i];
-
-		if (tp->quota_used < tp->quota_gcd) {
-			avail = true;
-			break;
-		}
-	}
-
-	/* There are no pools with quota, so reset them. */
-	if (!avail) {
-		for (i = 0; i < total_pools; i++)
-			pools[i]->quota_used = 0;
-		if (++rotating_pool >= total_pools)
-			rotating_pool = 0;
-	}
-
-	/* Try to find the first pool in the rotation that is usable */
-	tested = 0;
-	while (!pool && tested++ < total_pools) {
-		pool = pools[rotating_pool];
-		if (pool->quota_used++ < pool->quota_gcd) {
-			if (!pool_unworkable(pool))
-				break;
-			/* Failover-only flag for load-balance means distribute
-			 * unused quota to priority pool 0. */
-			if (opt_fail_only)
-				priority_pool(0)->quota_used--;
+	if (pool_strategy == POOL_LOADBALANCE)
+		pool = select_drr();
+	else {
+		for (tested = 0; !pool && tested < total_pools; tested++) {
+			if (++rotating_pool >= total_pools)
+				rotating_pool = 0;
+			pool = pools[rotating_pool];
+			if (!pool->quota || pool_unworkable(pool))
+				pool = NULL;
 		}
-		pool = NULL;
-		if (++rotating_pool >= total_pools)
-			rotating_pool = 0;
 	}
 
 	/* If there are no alive pools with quota, choose according to
@@ -4026,6 +4457,16 @@ static inline bool can_roll(struct work *work)
 		work->rolls < 7000 && !stale_work(work, false));
 }
 
+/* Give a work view its own ntime string so it can be changed without
+ * changing its master's */
+static void view_own_ntime(struct work *work)
+{
+	if (work->master && work->ntime && work->ntime != work->view_ntime) {
+		snprintf(work->view_ntime, sizeof(work->view_ntime), "%s", work->ntime);
+		work->ntime = work->view_ntime;
+	}
+}
+
 /* Adjust an existing char ntime field with a relative noffset */
 static void modify_ntime(char *ntime, int noffset)
 {
@@ -4052,27 +4493,23 @@ void roll_work(struct work *work)
 	work->nonce = 0;
 	applog(LOG_DEBUG, "Successfully rolled work");
 	/* Change the ntime field if this is stratum work */
-	if (work->ntime)
+	if (work->ntime) {
+		view_own_ntime(work);
 		modify_ntime(work->ntime, 1);
+	}
 
 	/* This is now a different work item so it needs a different ID for the
 	 * hashtable */
 	work->id = total_work_inc();
 }
 
-static void *submit_work_thread(void *userdata)
+/* Submit one share, retrying until it is accepted, rejected or stale. The
+ * curl entries are reused so their keep-alive connections persist */
+static void submit_work_one(struct pool *pool, struct work *work)
 {
-	struct work *work = (struct work *)userdata;
-	struct pool *pool = work->pool;
 	bool resubmit = false;
 	struct curl_ent *ce;
 
-	pthread_detach(pthread_self());
-
-	RenameThread("SubmitWork");
-
-	applog(LOG_DEBUG, "Creating extra submit work thread");
-
 	ce = pop_curl_entry(pool);
 	/* submit solution to bitcoin via JSON-RPC */
 	while (!submit_upstream_work(work, ce->curl, resubmit)) {
@@ -4099,13 +4536,94 @@ static void *submit_work_thread(void *userdata)
 		applog(LOG_INFO, "json_rpc_call failed on submit_work, retrying");
 	}
 	push_curl_entry(ce, pool);
+}
+
+/* Each pool has up to opt_submit_threads of these serving its submit_q,
+ * started on demand by submit_work_push(). A thread left idle for a minute
+ * exits, so pools that stop being used don't keep their threads */
+static void *submit_work_thread(void *userdata)
+{
+	struct pool *pool = (struct pool *)userdata;
+	struct timespec abstime, now = {0, 0};
+	char threadname[16];
+	struct work *work;
+	struct timeval tv;
+
+	pthread_detach(pthread_self());
+
+	snprintf(threadname, sizeof(threadname), "%d/SubmitWork", pool->pool_no);
+	RenameThread(threadname);
+
+	applog(LOG_DEBUG, "Pool %d submit work thread started", pool->pool_no);
+
+	cgtime(&tv);
+	abstime.tv_sec = tv.tv_sec + 60;
+	abstime.tv_nsec = tv.tv_usec * 1000;
+	while (42) {
+		work = tq_pop(pool->submit_q, &abstime);
+		if (!work) {
+			/* Woken for work another thread took first */
+			cgtime(&tv);
+			if (tv.tv_sec < abstime.tv_sec)
+				continue;
+		}
+
+		mutex_lock(&pool->pool_lock);
+		pool->submit_idle--;
+		if (!work) {
+			/* Check again under pool_lock, which submit_work_push
+			 * holds while it decides whether to start a thread */
+			work = tq_pop(pool->submit_q, &now);
+			if (!work) {
+				pool->submit_threads--;
+				mutex_unlock(&pool->pool_lock);
+				break;
+			}
+		}
+		mutex_unlock(&pool->pool_lock);
+
+		submit_work_one(pool, work);
+
+		mutex_lock(&pool->pool_lock);
+		pool->submit_idle++;
+		mutex_unlock(&pool->pool_lock);
+
+		cgtime(&tv);
+		abstime.tv_sec = tv.tv_sec + 60;
+		abstime.tv_nsec = tv.tv_usec * 1000;
+	}
+
+	applog(LOG_DEBUG, "Pool %d submit work thread idle, exiting", pool->pool_no);
 
 	return NULL;
 }
 
+/* Queue a share for the pool's submit threads, starting another one if none
+ * are idle and there are less than opt_submit_threads */
+static void submit_work_push(struct pool *pool, struct work *work)
+{
+	pthread_t submit_thread;
+
+	mutex_lock(&pool->pool_lock);
+	if (unlikely(!pool->submit_q)) {
+		pool->submit_q = tq_new();
+		if (unlikely(!pool->submit_q))
+			quit(1, "Failed to create submit_q in submit_work_push");
+	}
+	if (unlikely(!tq_push(pool->submit_q, work)))
+		quit(1, "Failed to tq_push work in submit_work_push");
+	if (!pool->submit_idle && pool->submit_threads < opt_submit_threads) {
+		if (unlikely(pthread_create(&submit_thread, NULL, submit_work_thread, (void *)pool)))
+			quit(1, "Failed to create submit_work_thread");
+		pool->submit_threads++;
+		pool->submit_idle++;
+	}
+	mutex_unlock(&pool->pool_lock);
+}
+
 struct work *make_clone(struct work *work)
 {
-	struct work *work_clone = copy_work(work);
+	struct work *work_clone = copy_work_view(work, 0, 0);
 
 	work_clone->clone = true;
 	cgtime((struct timeval *)&(work_clone->tv_cloned));
@@ -4183,10 +4701,9 @@ static struct work *clone_work(struct work *work)
 }
 
 #else /* HAVE_LIBCURL */
-static void *submit_work_thread(void __maybe_unused *userdata)
+static void submit_work_push(struct pool __maybe_unused *pool, struct work *work)
 {
-	pthread_detach(pthread_self());
-	return NULL;
+	free_work(work);
 }
 #endif /* HAVE_LIBCURL */
 
@@ -4215,6 +4732,7 @@ static void _copy_work(struct work *work, const struct work *base_work, int noff
 	/* Keep the unique new id assigned during make_work to prevent copied
 	 * work from having the same id. */
 	work->id = id;
+	work->master = NULL;
 	if (base_work->job_id)
 		work->job_id = strdup(base_work->job_id);
 	if (base_work->nonce1)
@@ -4248,8 +4766,13 @@ void set_work_ntime(struct work *work, int ntime)
 
 	*work_ntime = htobe32(ntime);
 	if (work->ntime) {
-		free(work->ntime);
-		work->ntime = bin2hex((unsigned char *)work_ntime, 4);
+		if (work->master) {
+			__bin2hex(work->view_ntime, (unsigned char *)work_ntime, 4);
+			work->ntime = work->view_ntime;
+		} else {
+			free(work->ntime);
+			work->ntime = bin2hex((unsigned char *)work_ntime, 4);
+		}
 	}
 }
 
@@ -4266,6 +4789,135 @@ struct work *copy_work_noffset(struct work *base_work, int noffset)
 	return work;
 }
 
+/* The number of different header versions work can be rolled to */
+int work_vrolls(const struct work *work)
+{
+	uint32_t mask = work->version_mask;
+	int bits = 0;
+
+	while (mask) {
+		mask &= mask - 1;
+		bits++;
+	}
+	return bits > 30 ? 1 << 30 : 1 << bits;
+}
+
+/* Spread the bits of vroll over the set bits of mask, lowest first */
+static uint32_t vroll_bits(uint32_t mask, int vroll)
+{
+	uint32_t bits = 0, low;
+
+	while (mask && vroll) {
+		low = mask & -mask;
+		if (vroll & 1)
+			bits |= low;
+		vroll >>= 1;
+		mask &= mask - 1;
+	}
+	return bits;
+}
+
+static void roll_version(struct work *work, int vroll)
+{
+	uint32_t *work_version = (uint32_t *)(work->data);
+	uint32_t version = be32toh(*work_version);
+
+	version ^= vroll_bits(work->version_mask, vroll);
+	*work_version = htobe32(version);
+	calc_midstate(work);
+	local_work++;
+}
+
+/* Generates a copy of work with its version rolled, for drivers that can use
+ * several midstates of the one work item. vroll 0 is the unchanged version
+ * and up to work_vrolls(base_work) - 1 each give a unique header */
+struct work *copy_work_vroll(struct work *base_work, int vroll)
+{
+	struct work *work = copy_work(base_work);
+
+	roll_version(work, vroll);
+
+	return work;
+}
+
+/* Returns the hidden master holding the strings of work, moving them into a
+ * new one if work isn't already a view. The work itself becomes a view. A
+ * driver may submit nonces of the one work from more than one thread so the
+ * master is swapped in atomically */
+static struct work *work_master(struct work *work)
+{
+	struct work *master = work->master;
+
+	if (!master) {
+		master = calloc(1, sizeof(struct work));
+		if (unlikely(!master))
+			quit(1, "Failed to calloc work master");
+		master->job_id = work->job_id;
+		master->nonce1 = work->nonce1;
+		master->ntime = work->ntime;
+		master->coinbase = work->coinbase;
+		master->views = 1;
+		if (!__sync_bool_compare_and_swap(&work->master, NULL, master)) {
+			free(master);
+			master = work->master;
+		}
+	}
+	return master;
+}
+
+/* Generates a view of an existing work struct, for drivers that use many
+ * work items derived from the one work. Unlike copy_work_noffset() no strings
+ * are copied, the view shares them with base_work until they are all freed.
+ * noffset rolls the ntime, which is in the second sha256 block so the
+ * midstate is unchanged, and vroll rolls the version bits as in
+ * copy_work_vroll() which does need a new midstate */
+struct work *copy_work_view(struct work *base_work, int noffset, int vroll)
+{
+	struct work *master = work_master(base_work);
+	struct work *work = make_work();
+	uint32_t id = work->id;
+
+	memcpy(work, base_work, sizeof(struct work));
+	work->id = id;
+	__sync_add_and_fetch(&master->views, 1);
+	if (base_work->ntime == base_work->view_ntime)
+		work->ntime = work->view_ntime;
+
+	if (noffset) {
+		uint32_t *work_ntime = (uint32_t *)(work->data + 68);
+		uint32_t ntime = be32toh(*work_ntime);
+
+		ntime += noffset;
+		*work_ntime = htobe32(ntime);
+		if (work->ntime) {
+			__bin2hex(work->view_ntime, (unsigned char *)work_ntime, 4);
+			work->ntime = work->view_ntime;
+		}
+	}
+
+	if (vroll)
+		roll_version(work, vroll);
+
+	return work;
+}
+
+/* Stage version rolled copies of stratum work to fill the queue. Each only
+ * needs a new midstate instead of a new coinbase and merkle root
+ * Only as many are staged as the scheduler's max_staged has room for, the
+ * scheduler generates and rolls more work as it's used */
+static void stage_vroll_work(struct work *work, int max_staged)
+{
+	int mrs = max_staged - total_staged();
+	int vrolls = work_vrolls(work), vroll;
+	struct work *work_vroll;
+
+	for (vroll = 1; vroll < vrolls && mrs-- > 1; vroll++) {
+		work_vroll = copy_work_view(work, 0, vroll);
+		stage_work(work_vroll);
+	}
+	stage_work(work);
+}
+
 void pool_died(struct pool *pool)
 {
 	if (!pool_tset(pool, &pool->idle)) {
@@ -4316,10 +4968,13 @@ static bool stale_work(struct work *work, bool share)
 		cg_rlock(&pool->data_lock);
 		if (strcmp(work->job_id, pool->swork.job_id))
 			same_job = false;
+		/* mining.set_extranonce changes the nonce1 within a job */
+		if (work->nonce1 && pool->nonce1 && strcmp(work->nonce1, pool->nonce1))
+			same_job = false;
 		cg_runlock(&pool->data_lock);
 
 		if (!same_job) {
-			applog(LOG_DEBUG, "Work stale due to stratum job_id mismatch");
+			applog(LOG_DEBUG, "Work stale due to stratum job_id or extranonce mismatch");
 			return true;
 		}
 	}
@@ -4506,7 +5161,6 @@ void _discard_work(struct work *work)
 	if (!work->clone && !work->rolls && !work->mined) {
 		if (work->pool) {
 			work->pool->discarded_work++;
-			work->pool->quota_used--;
 			work->pool->works--;
 		}
 		total_discarded++;
@@ -4846,6 +5500,7 @@ static bool hash_push(struct work *work)
 
 static void _stage_work(struct work *work)
 {
+	TRACE_MARK(stage_work, work->id);
 	applog(LOG_DEBUG, "Pushing work from pool %d to hash queue", work->pool->pool_no);
 	work->work_block = work_block;
 	test_work_current(work);
@@ -6004,6 +6659,22 @@ static bool parse_stratum_response(struct pool *pool, char *s)
 
 	id = json_integer_value(id_val);
 
+	if (pool->xnsub_id && id == pool->xnsub_id) {
+		pool->xnsub_id = 0;
+		if (json_is_true(res_val))
+			applog(LOG_INFO, "Pool %d accepted mining.extranonce.subscribe", pool->pool_no);
+		else
+			applog(LOG_INFO, "Pool %d does not support mining.extranonce.subscribe", pool->pool_no);
+		ret = true;
+		goto out;
+	}
+
+	// Shares from stratum server clients are passed back to them
+	if (proxy_response(pool, id, res_val, err_val)) {
+		ret = true;
+		goto out;
+	}
+
 	mutex_lock(&sshare_lock);
 	HASH_FIND_INT(stratum_shares, &id, sshare);
 	if (sshare) {
@@ -6342,20 +7013,33 @@ static void *stratum_sthread(void *userdata)
 		*nonce2_64 = htole64(work->nonce2);
 		__bin2hex(nonce2hex, nonce2, work->nonce2_len);
 
-		snprintf(s, sizeof(s),
-			"{\"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\"], \"id\": %d, \"method\": \"mining.submit\"}",
-			pool->rpc_user, work->job_id, nonce2hex, work->ntime, noncehex, sshare->id);
+		if (work->version_mask) {
+			/* BIP310 sends the rolled version bits as a 6th param */
+			uint32_t version = be32toh(*((uint32_t *)work->data));
 
-		applog(LOG_INFO, "Submitting share %08lx to pool %d",
+			snprintf(s, sizeof(s),
+				"{\"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\", \"%08x\"], \"id\": %d, \"method\": \"mining.submit\"}",
+				pool->rpc_user, work->job_id, nonce2hex, work->ntime, noncehex,
+				version & work->version_mask, sshare->id);
+		} else {
+			snprintf(s, sizeof(s),
+				"{\"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\"], \"id\": %d, \"method\": \"mining.submit\"}",
+				pool->rpc_user, work->job_id, nonce2hex, work->ntime, noncehex, sshare->id);
+		}
+
+		ratelog(LOG_INFO, "Submitting share %08lx to pool %d",
 					(long unsigned int)htole32(hash32[6]), pool->pool_no);
 
 		/* Try resubmitting for up to 2 minutes if we fail to submit
 		 * once and the stratum pool nonce1 still matches suggesting
 		 * we may be able to resume. */
 		while (time(NULL) < sshare->sshare_time + 120) {
-			bool sessionid_match;
+			bool sessionid_match, sent;
+			TRACE_START(stratum_send);
 
-			if (likely(stratum_send(pool, s, strlen(s)))) {
+			sent = stratum_send(pool, s, strlen(s));
+			TRACE_END(stratum_send, sshare->id);
+			if (likely(sent)) {
 				if (pool_tclear(pool, &pool->submit_fail))
 						applog(LOG_WARNING, "Pool %d communication resumed, submitting work", pool->pool_no);
 
@@ -6727,6 +7411,7 @@ static struct work *hash_pop(bool blocking)
 {
 	struct work *work = NULL, *tmp;
 	int hc;
+	TRACE_START(hash_pop);
 
 	mutex_lock(stgd_lock);
 	if (!HASH_COUNT(staged_work)) {
@@ -6788,6 +7473,8 @@ static struct work *hash_pop(bool blocking)
 out_unlock:
 	mutex_unlock(stgd_lock);
 
+	TRACE_END(hash_pop, work ? work->id : -1);
+
 	return work;
 }
 
@@ -6895,9 +7582,22 @@ static void gen_stratum_work(struct pool *pool, struct work *work)
 
 	/* Update coinbase. Always use an LE encoded nonce2 to fill in values
 	 * from left to right and prevent overflow errors with small n2sizes */
-	nonce2le = htole64(pool->nonce2);
+	if (opt_stratum_server && pool->n2size >= PROXY_N2_MIN) {
+		/* The first nonce2 byte is the stratum server clients'
+		 * extranonce1 suffix, so our own work has PROXY_PREFIX_LOCAL
+		 * there and only the remaining bytes for the counter. Wrap
+		 * it ourselves rather than let it carry into the suffix */
+		if (pool->n2size <= 8 && (pool->nonce2 >> ((pool->n2size - 1) * 8))) {
+			ratelog(LOG_WARNING, "Pool %d nonce2 space used up with the stratum server "
+					     "reserving a byte, work will repeat until the next job",
+					     pool->pool_no);
+			pool->nonce2 = 0;
+		}
+		work->nonce2 = (pool->nonce2++ << 8) | PROXY_PREFIX_LOCAL;
+	} else
+		work->nonce2 = pool->nonce2++;
+	nonce2le = htole64(work->nonce2);
 	memcpy(pool->coinbase + pool->nonce2_offset, &nonce2le, pool->n2size);
-	work->nonce2 = pool->nonce2++;
 	work->nonce2_len = pool->n2size;
 
 	/* Downgrade to a read lock to read off the pool variables */
@@ -6922,6 +7622,7 @@ static void gen_stratum_work(struct pool *pool, struct work *work)
 	/* Store the stratum work diff to check it still matches the pool's
 	 * stratum diff when submitting shares */
 	work->sdiff = pool->sdiff;
+	work->version_mask = pool->version_mask;
 
 	/* Copy parameters required for share submission */
 	work->job_id = strdup(pool->swork.job_id);
@@ -6983,9 +7684,22 @@ static inline void release_gbt_curl(struct pool *pool)
 	pool->gbt_curl_inuse = false;
 }
 
-static void update_gbt_solo(struct pool *pool)
+/* Decode a fetched solo template and stage work from it. Must be called
+ * holding gbt_curl, which serialises decoding templates */
+static void __gbt_solo_template(struct pool *pool, json_t *val)
 {
 	struct work *work = make_work();
+
+	if (work_decode(pool, work, val)) {
+		__setup_gbt_solo(pool);
+		gen_solo_work(pool, work);
+		stage_work(work);
+	} else
+		free_work(work);
+}
+
+static void update_gbt_solo(struct pool *pool)
+{
 	int rolltime;
 	json_t *val;
 
@@ -6997,14 +7711,7 @@ retry:
 			    true, false, &rolltime, pool, false);
 
 	if (likely(val)) {
-		bool rc = work_decode(pool, work, val);
-
-		if (rc) {
-			__setup_gbt_solo(pool);
-			gen_solo_work(pool, work);
-			stage_work(work);
-		} else
-			free_work(work);
+		__gbt_solo_template(pool, val);
 		json_decref(val);
 	} else {
 		applog(LOG_DEBUG, "Pool %d json_rpc_call failed on get gbt, retrying in 5s",
@@ -7041,10 +7748,12 @@ static void gen_solo_work(struct pool *pool, struct work *work)
 	work->nonce2 = pool->nonce2++;
 	work->nonce2_len = pool->n2size;
 	work->gbt_txns = pool->transactions + 1;
+	/* The coinbase is only needed if this work solves a block so it is
+	 * rebuilt from the template and nonce2 in gbt_submitblock() */
+	work->gbt_id = pool->gbt_id;
 
 	/* Downgrade to a read lock to read off the pool variables */
 	cg_dwlock(&pool->gbt_lock);
-	work->coinbase = bin2hex(pool->coinbase, pool->coinbase_len);
 	/* Generate merkle root */
 	gen_hash(pool->coinbase, merkle_root, pool->coinbase_len);
 	memcpy(merkle_sha, merkle_root, 32);
@@ -7162,7 +7871,6 @@ struct work *get_work(struct thr_info *thr, const int thr_id)
 static void submit_work_async(struct work *work)
 {
 	struct pool *pool = work->pool;
-	pthread_t submit_thread;
 
 	cgtime(&work->tv_work_found);
 	if (opt_benchmark) {
@@ -7211,9 +7919,8 @@ static void submit_work_async(struct work *work)
 			free_work(work);
 		}
 	} else {
-		applog(LOG_DEBUG, "Pushing submit work to work thread");
-		if (unlikely(pthread_create(&submit_thread, NULL, submit_work_thread, (void *)work)))
-			quit(1, "Failed to create submit_work_thread");
+		applog(LOG_DEBUG, "Pushing pool %d work to submit queue", pool->pool_no);
+		submit_work_push(pool, work);
 	}
 }
 
@@ -7244,8 +7951,10 @@ static void rebuild_nonce(struct work *work, uint32_t nonce)
 bool test_nonce(struct work *work, uint32_t nonce)
 {
 	uint32_t *hash_32 = (uint32_t *)(work->hash + 28);
+	TRACE_START(test_nonce);
 
 	rebuild_nonce(work, nonce);
+	TRACE_END(test_nonce, nonce);
 	return (*hash_32 == 0);
 }
 
@@ -7279,6 +7988,7 @@ static void update_work_stats(struct thr_info *thr, struct work *work)
 	total_diff1 += work->device_diff;
 	thr->cgpu->diff1 += work->device_diff;
 	work->pool->diff1 += work->device_diff;
+	__drr_credit(work->pool, work->device_diff);
 	thr->cgpu->last_device_valid_work = time(NULL);
 	mutex_unlock(&stats_lock);
 }
@@ -7295,7 +8005,7 @@ bool submit_tested_work(struct thr_info *thr, struct work *work)
 		       thr->cgpu->device_id);
 		return false;
 	}
-	work_out = copy_work(work);
+	work_out = copy_work_view(work, 0, 0);
 	submit_work_async(work_out);
 	return true;
 }
@@ -7303,16 +8013,20 @@ bool submit_tested_work(struct thr_info *thr, struct work *work)
 /* Returns true if nonce for work was a valid share */
 bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce)
 {
+	TRACE_START(submit_nonce);
+
 	if (test_nonce(work, nonce))
 		submit_tested_work(thr, work);
 	else {
 		inc_hw_errors(thr);
+		TRACE_END(submit_nonce, nonce);
 		return false;
 	}
 
 	if (opt_benchfile && opt_benchfile_display)
 		benchfile_dspwork(work, nonce);
 
+	TRACE_END(submit_nonce, nonce);
 	return true;
 }
 
@@ -7323,10 +8037,9 @@ bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce)
 bool submit_noffset_nonce(struct thr_info *thr, struct work *work_in, uint32_t nonce,
 			  int noffset)
 {
-	struct work *work = make_work();
+	struct work *work = copy_work_view(work_in, noffset, 0);
 	bool ret = false;
 
-	_copy_work(work, work_in, noffset);
 	if (!test_nonce(work, nonce)) {
 		free_work(work);
 		inc_hw_errors(thr);
@@ -7350,6 +8063,48 @@ out:
 	return ret;
 }
 
+/* Allows drivers that roll the version bits in hardware to submit the nonce
+ * with the version the device found it with. As with submit_noffset_nonce, the
+ * original work struct is not touched, only a copy of it. */
+bool submit_version_nonce(struct thr_info *thr, struct work *work_in, uint32_t nonce,
+			  uint32_t version)
+{
+	uint32_t *work_version;
+	struct work *work;
+	bool ret = false;
+
+	work_version = (uint32_t *)(work_in->data);
+	if (unlikely((be32toh(*work_version) ^ version) & ~work_in->version_mask)) {
+		applog(LOG_INFO, "%s %d: Version %08x outside mask %08x",
+		       thr->cgpu->drv->name, thr->cgpu->device_id, version,
+		       work_in->version_mask);
+		inc_hw_errors(thr);
+		goto out;
+	}
+
+	work = copy_work_view(work_in, 0, 0);
+	work_version = (uint32_t *)(work->data);
+	*work_version = htobe32(version);
+	if (!test_nonce(work, nonce)) {
+		free_work(work);
+		inc_hw_errors(thr);
+		goto out;
+	}
+	update_work_stats(thr, work);
+
+	ret = true;
+	if (!fulltest(work->hash, work->target)) {
+		free_work(work);
+		applog(LOG_INFO, "%s %d: Share above target", thr->cgpu->drv->name,
+		       thr->cgpu->device_id);
+		goto out;
+	}
+	submit_work_async(work);
+
+out:
+	return ret;
+}
+
 static inline bool abandon_work(struct work *work, struct timeval *wdiff, uint64_t hashes)
 {
 	if (wdiff->tv_sec > opt_scantime || hashes >= 0xfffffffe ||
@@ -7567,6 +8322,7 @@ void __add_queued(struct cgpu_info *cgpu, struct work *work)
 struct work *get_queued(struct cgpu_info *cgpu)
 {
 	struct work *work = NULL;
+	TRACE_START(get_queued);
 
 	wr_lock(&cgpu->qlock);
 	if (cgpu->unqueued_work) {
@@ -7580,6 +8336,8 @@ struct work *get_queued(struct cgpu_info *cgpu)
 	}
 	wr_unlock(&cgpu->qlock);
 
+	TRACE_END(get_queued, work ? work->id : -1);
+
 	return work;
 }
 
@@ -8012,16 +8770,57 @@ retry_pool:
 	}
 
 	if (pool->gbt_solo) {
-		applog(LOG_WARNING, "Block change for %s detection via getblockcount polling",
+		int lp_fails = 0;
+
+		applog(LOG_WARNING, "Block change for %s detection via getblocktemplate longpoll",
 		       cp->rpc_url);
 		while (42) {
 			json_t *val, *res_val = NULL;
+			bool lp_sent = false;
 
 			if (unlikely(pool->removed))
 				return NULL;
 
 			cgtime(&start);
 			wait_lpcurrent(cp);
+
+			/* Block on a getblocktemplate longpoll while the template
+			 * has a longpollid, which bitcoind answers with a new
+			 * template as soon as the block or transactions change */
+			if (lp_fails < 3) {
+				cg_rlock(&pool->gbt_lock);
+				if (pool->longpollid) {
+					snprintf(lpreq, sizeof(lpreq),
+						"{\"id\": 0, \"method\": \"getblocktemplate\", \"params\": "
+						"[{\"longpollid\": \"%s\"}]}\n", pool->longpollid);
+					lp_sent = true;
+				}
+				cg_runlock(&pool->gbt_lock);
+			}
+			if (lp_sent) {
+				if (!curl) {
+					curl = curl_easy_init();
+					if (unlikely(!curl))
+						quit (1, "Longpoll CURL initialisation failed");
+				}
+				val = json_rpc_call(curl, pool->rpc_url, pool->rpc_userpass, lpreq,
+						    false, true, &rolltime, pool, false);
+				if (likely(val)) {
+					lp_fails = 0;
+					failures = 0;
+					get_gbt_curl(pool, 10);
+					__gbt_solo_template(pool, val);
+					release_gbt_curl(pool);
+					json_decref(val);
+					continue;
+				}
+				if (++lp_fails >= 3) {
+					applog(LOG_WARNING, "Pool %d getblocktemplate longpoll failing, "
+					       "block change detection via getblockcount polling",
+					       pool->pool_no);
+				}
+			}
+
 			sprintf(lpreq, "{\"id\": 0, \"method\": \"getblockcount\"}\n");
 
 			/* We will be making another call immediately after this
@@ -8285,6 +9084,10 @@ static void *watchpool_thread(void __maybe_unused *userdata)
 				pool->shares = pool->utility;
 			}
 
+			/* A faster rolling diff1 to report the actual split */
+			pool->drr_rolling = (pool->drr_rolling + (pool->diff1 - pool->drr_last) * 0.63) / 1.63;
+			pool->drr_last = pool->diff1;
+
 			if (pool->enabled == POOL_DISABLED)
 				continue;
 
@@ -8358,6 +9161,8 @@ static void *watchdog_thread(void __maybe_unused *userdata)
 
 		hashmeter(-1, 0);
 
+		log_ratelimit_flush();
+
 #ifdef HAVE_CURSES
 		if (curses_active_locked()) {
 			struct cgpu_info *cgpu;
@@ -8597,6 +9402,8 @@ static void clean_up(bool restarting)
 	if (!restarting && !opt_realquiet && successful_connect)
 		print_summary();
 
+	log_async_flush();
+
 	curl_global_cleanup();
 }
 
@@ -8631,8 +9438,10 @@ void __quit(int status, bool clean)
 		forkpid = 0;
 	}
 #endif
-	pthread_cancel(killall_t);
+	// Still under the killall timeout in case the console_lock is stuck
+	log_async_flush();
 
+	pthread_cancel(killall_t);
 	exit(status);
 }
 
@@ -9302,7 +10111,7 @@ int main(int argc, char *argv[])
 	if (unlikely(curl_global_init(CURL_GLOBAL_ALL)))
 		early_quit(1, "Failed to curl_global_init");
 
-#if LOCK_TRACKING
+#if LOCK_TRACKING || LOCK_PROFILING
 	// Must be first
 	if (unlikely(pthread_mutex_init(&lockstat_lock, NULL)))
 		quithere(1, "Failed to pthread_mutex_init lockstat_lock errno=%d", errno);
@@ -9553,6 +10362,8 @@ int main(int argc, char *argv[])
 		openlog(PACKAGE, LOG_PID, LOG_USER);
 #endif
 
+	log_async_start();
+
 	#if defined(unix) || defined(__APPLE__)
 		if (opt_stderr_cmd)
 			fork_monitor();
@@ -9567,6 +10378,8 @@ int main(int argc, char *argv[])
 			early_quit(1, "Failed to calloc mining_thr[%d]", i);
 	}
 
+	verify_start();
+
 	// Start threads
 	k = 0;
 	for (i = 0; i < total_devices; ++i) {
@@ -9676,6 +10489,9 @@ begin_bench:
 	if (thr_info_create(thr, NULL, api_thread, thr))
 		early_quit(1, "API thread create failed");
 
+	if (opt_stratum_server)
+		proxy_start();
+
 #ifdef USE_USBUTILS
 	hotplug_thr_id = 6;
 	thr = &control_thr[hotplug_thr_id];
@@ -9775,7 +10591,10 @@ retry:
 			}
 			gen_stratum_work(pool, work);
 			applog(LOG_DEBUG, "Generated stratum work");
-			stage_work(work);
+			if (work->version_mask)
+				stage_vroll_work(work, max_staged);
+			else
+				stage_work(work);
 			continue;
 		}
 
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2007, 2008, 2009 Sebastien Bourdeauducq (crc16)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "crc.h"
+
+/*
+ * The 16 bit CRCs use slice by 4 tables, [0] is the usual byte at a time
+ * table and each of the others advances an entry of the one before it by
+ * one more byte, so 4 bytes are done with 4 independent lookups
+ * All tables are built once, the first time any CRC is requested
+ */
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint8_t crc8_table[256];
+static uint16_t crc16_table[4][256];
+static uint16_t crc16_modbus_table[4][256];
+
+static void crc_init(void)
+{
+	uint16_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc << 1) ^ ((crc & 0x80) ? CRC8_POLY : 0);
+		crc8_table[i] = crc & 0xff;
+
+		crc = i << 8;
+		for (j = 0; j < 8; j++)
+			crc = (crc << 1) ^ ((crc & 0x8000) ? CRC16_POLY : 0);
+		crc16_table[0][i] = crc;
+
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC16_MODBUS_POLY : 0);
+		crc16_modbus_table[0][i] = crc;
+	}
+
+	for (j = 1; j < 4; j++) {
+		for (i = 0; i < 256; i++) {
+			crc = crc16_table[j-1][i];
+			crc16_table[j][i] = (crc << 8) ^ crc16_table[0][crc >> 8];
+			crc = crc16_modbus_table[j-1][i];
+			crc16_modbus_table[j][i] = (crc >> 8) ^ crc16_modbus_table[0][crc & 0xff];
+		}
+	}
+}
+
+uint8_t crc8(uint8_t crc, const uint8_t *buf, int len)
+{
+	pthread_once(&crc_once, crc_init);
+
+	while (len-- > 0)
+		crc = crc8_table[crc ^ *buf++];
+
+	return crc;
+}
+
+unsigned short crc16(const unsigned char *buffer, int len)
+{
+	uint16_t crc = 0;
+
+	pthread_once(&crc_once, crc_init);
+
+	while (len >= 4) {
+		crc ^= (buffer[0] << 8) | buffer[1];
+		crc = crc16_table[3][crc >> 8] ^ crc16_table[2][crc & 0xff] ^
+		      crc16_table[1][buffer[2]] ^ crc16_table[0][buffer[3]];
+		buffer += 4;
+		len -= 4;
+	}
+	while (len-- > 0)
+		crc = crc16_table[0][((crc >> 8) ^ *buffer++) & 0xff] ^ (crc << 8);
+
+	return crc;
+}
+
+uint16_t crc16_modbus(const uint8_t *buf, int len)
+{
+	uint16_t crc = 0xffff;
+
+	pthread_once(&crc_once, crc_init);
+
+	while (len >= 4) {
+		crc ^= buf[0] | (buf[1] << 8);
+		crc = crc16_modbus_table[3][crc & 0xff] ^ crc16_modbus_table[2][crc >> 8] ^
+		      crc16_modbus_table[1][buf[2]] ^ crc16_modbus_table[0][buf[3]];
+		buf += 4;
+		len -= 4;
+	}
+	while (len-- > 0)
+		crc = (crc >> 8) ^ crc16_modbus_table[0][(crc ^ *buf++) & 0xff];
+
+	return crc;
+}
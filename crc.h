@@ -18,6 +18,17 @@
 #ifndef _CRC_H_
 #define _CRC_H_
 
+#include <stdint.h>
+
+// x^8 + x^2 + x + 1, msb first (hashfast)
+#define CRC8_POLY 0x07
+// CCITT x^16 + x^12 + x^5 + 1, msb first, initial 0 (avalon2, hashratio)
+#define CRC16_POLY 0x1021
+// x^16 + x^15 + x^2 + 1, lsb first, initial 0xffff (bitmain)
+#define CRC16_MODBUS_POLY 0xA001
+
+uint8_t crc8(uint8_t crc, const uint8_t *buf, int len);
 unsigned short crc16(const unsigned char *buffer, int len);
+uint16_t crc16_modbus(const uint8_t *buf, int len);
 
 #endif	/* _CRC_H_ */
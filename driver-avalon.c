@@ -148,14 +148,13 @@ static int avalon_write(struct cgpu_info *avalon, char *buf, ssize_t len, int ep
 	return AVA_SEND_OK;
 }
 
-static int avalon_send_task(const struct avalon_task *at, struct cgpu_info *avalon,
-			    struct avalon_info *info)
-
+/* Put the task as it's sent to the device in buf, which must have room for
+ * AVALON_TASK_SIZE, and return its length */
+static size_t avalon_pack_task(const struct avalon_task *at, uint8_t *buf)
 {
-	uint8_t buf[AVALON_WRITE_SIZE + 4 * AVALON_DEFAULT_ASIC_NUM];
-	int delay, ret, i, ep = C_AVALON_TASK;
 	uint32_t nonce_range;
 	size_t nr_len;
+	int i;
 
 	if (at->nonce_elf)
 		nr_len = AVALON_WRITE_SIZE + 4 * at->asic_num;
@@ -194,6 +193,20 @@ static int avalon_send_task(const struct avalon_task *at, struct cgpu_info *aval
 	tt |= ((buf[4] & 0x80) ? (1 << 0) : 0);
 	buf[4] = tt;
 #endif
+
+	return nr_len;
+}
+
+static int avalon_send_task(const struct avalon_task *at, struct cgpu_info *avalon,
+			    struct avalon_info *info)
+
+{
+	uint8_t buf[AVALON_TASK_SIZE];
+	int delay, ret, ep = C_AVALON_TASK;
+	size_t nr_len;
+
+	nr_len = avalon_pack_task(at, buf);
+
 	delay = nr_len * 10 * 1000000;
 	delay = delay / info->baud;
 	delay += 4000;
@@ -1141,25 +1154,110 @@ static void avalon_adjust_freq(struct avalon_info *info, struct cgpu_info *avalo
 	}
 }
 
+/* Write each round of tasks from avalon_send_tasks() while
+ * avalon_send_tasks() assembles the next round in the other buffer.
+ * There's no flow control on the FTDI so, as when the tasks were sent
+ * directly, each task waits for CTS and the time to send the previous task
+ * at the baud rate, and the rest of the round is dropped if the buffer
+ * is full */
+static void *avalon_write_rounds(void *userdata)
+{
+	struct cgpu_info *avalon = (struct cgpu_info *)userdata;
+	struct avalon_info *info = avalon->device_data;
+	struct timeval now;
+	char threadname[16];
+	int cur = 0, ret, len, tasks, t;
+	double idle, wrote;
+	uint8_t *buf;
+
+	snprintf(threadname, sizeof(threadname), "%d/AvaWrite", avalon->device_id);
+	RenameThread(threadname);
+
+	while (likely(!avalon->shutdown)) {
+		if (cgsem_mswait(&info->round_ready, 100))
+			continue;
+
+		/* Idle is how long the device had nothing more to be sent */
+		cgtime(&now);
+		idle = info->rounds ? tdiff(&now, &info->round_end) : 0;
+
+		while (avalon_buffer_full(avalon))
+			cgsleep_ms(40);
+
+		tasks = info->round_tasks[cur];
+		len = info->round_tlen[cur];
+		cgtime(&now);
+		for (t = 0; t < tasks; t++) {
+			if (avalon_buffer_full(avalon)) {
+				applog(LOG_INFO,
+				       "%s%i: Buffer full after only %d of %d work queued",
+					avalon->drv->name, avalon->device_id, t, tasks);
+				break;
+			}
+
+			buf = info->round_buf[cur] + t * AVALON_TASK_SIZE;
+			if (opt_debug) {
+				applog(LOG_DEBUG, "Avalon: Sent(%d):", len);
+				hexdump(buf, len);
+			}
+			/* Sleep from the last time we sent data */
+			cgsleep_us_r(&info->cgsent, info->send_delay);
+
+			cgsleep_prepare_r(&info->cgsent);
+			ret = avalon_write(avalon, (char *)buf, len, C_AVALON_TASK);
+			if (unlikely(ret == AVA_SEND_ERROR)) {
+				/* Send errors are fatal */
+				applog(LOG_ERR, "%s%i: Comms error(buffer)",
+				       avalon->drv->name, avalon->device_id);
+				dev_error(avalon, REASON_DEV_COMMS_ERROR);
+				info->round_error = true;
+				cgsem_post(&info->round_free);
+				return NULL;
+			}
+			info->send_delay = len * 10 * 1000000 / info->baud + 4000;
+		}
+
+		mutex_lock(&info->lock);
+		cgtime(&info->round_end);
+		wrote = tdiff(&info->round_end, &now);
+		info->rounds++;
+		info->round_idle += idle;
+		if (info->round_idle_max < idle)
+			info->round_idle_max = idle;
+		info->round_write += wrote;
+		mutex_unlock(&info->lock);
+
+		cgsem_post(&info->round_free);
+		cur ^= 1;
+	}
+
+	return NULL;
+}
+
 static void *avalon_send_tasks(void *userdata)
 {
 	struct cgpu_info *avalon = (struct cgpu_info *)userdata;
 	struct avalon_info *info = avalon->device_data;
 	const int avalon_get_work_count = info->miner_count;
 	char threadname[16];
+	int cur = 0;
 
 	snprintf(threadname, sizeof(threadname), "%d/AvaSend", avalon->device_id);
 	RenameThread(threadname);
 
 	while (likely(!avalon->shutdown)) {
-		int start_count, end_count, i, j, ret;
+		int start_count, end_count, i, j, len = 0;
 		cgtimer_t ts_start;
 		struct avalon_task at;
 		bool idled = false;
 		int64_t us_timeout;
+		uint8_t *round;
 
-		while (avalon_buffer_full(avalon))
-			cgsleep_ms(40);
+		/* Wait until the writer is done with this buffer */
+		if (cgsem_mswait(&info->round_free, 100))
+			continue;
+		if (unlikely(info->round_error))
+			break;
 
 		avalon_adjust_freq(info, avalon);
 
@@ -1167,16 +1265,10 @@ static void *avalon_send_tasks(void *userdata)
 		us_timeout = 0x100000000ll / info->asic_count / info->frequency;
 		cgsleep_prepare_r(&ts_start);
 
+		round = info->round_buf[cur];
 		start_count = avalon->work_array * avalon_get_work_count;
 		end_count = start_count + avalon_get_work_count;
 		for (i = start_count, j = 0; i < end_count; i++, j++) {
-			if (avalon_buffer_full(avalon)) {
-				applog(LOG_INFO,
-				       "%s%i: Buffer full after only %d of %d work queued",
-					avalon->drv->name, avalon->device_id, j, avalon_get_work_count);
-				break;
-			}
-
 			mutex_lock(&info->qlock);
 			if (likely(j < avalon->queued && !info->overheat && avalon->works[i])) {
 				avalon_init_task(&at, 0, 0, info->fan_pwm,
@@ -1200,17 +1292,14 @@ static void *avalon_send_tasks(void *userdata)
 			}
 			mutex_unlock(&info->qlock);
 
-			ret = avalon_send_task(&at, avalon, info);
-
-			if (unlikely(ret == AVA_SEND_ERROR)) {
-				/* Send errors are fatal */
-				applog(LOG_ERR, "%s%i: Comms error(buffer)",
-				       avalon->drv->name, avalon->device_id);
-				dev_error(avalon, REASON_DEV_COMMS_ERROR);
-				goto out;
-			}
+			len = avalon_pack_task(&at, round + j * AVALON_TASK_SIZE);
 		}
 
+		info->round_tasks[cur] = j;
+		info->round_tlen[cur] = len;
+		cgsem_post(&info->round_ready);
+		cur ^= 1;
+
 		avalon_rotate_array(avalon, info);
 
 		cgsem_post(&info->qsem);
@@ -1226,7 +1315,6 @@ static void *avalon_send_tasks(void *userdata)
 		 * fall short of the full duration. */
 		cgsleep_us_r(&ts_start, us_timeout);
 	}
-out:
 	return NULL;
 }
 
@@ -1315,6 +1403,7 @@ static bool avalon_prepare(struct thr_info *thr)
 	struct avalon_info *info = avalon->device_data;
 	int array_size = AVALON_ARRAY_SIZE;
 	void *(*write_thread_fn)(void *) = avalon_send_tasks;
+	int i;
 
 	if (is_bitburner(avalon)) {
 		array_size = BITBURNER_ARRAY_SIZE;
@@ -1332,6 +1421,23 @@ static bool avalon_prepare(struct thr_info *thr)
 	mutex_init(&info->qlock);
 	cgsem_init(&info->qsem);
 
+	if (!is_bitburner(avalon)) {
+		for (i = 0; i < 2; i++) {
+			free(info->round_buf[i]);
+			info->round_buf[i] = calloc(info->miner_count, AVALON_TASK_SIZE);
+			if (!info->round_buf[i])
+				quit(1, "Failed to calloc avalon round_buf in avalon_prepare");
+		}
+		info->round_error = false;
+		cgsem_init(&info->round_ready);
+		cgsem_init(&info->round_free);
+		/* Both buffers start free */
+		cgsem_post(&info->round_free);
+		cgsem_post(&info->round_free);
+		if (pthread_create(&info->round_thr, NULL, avalon_write_rounds, (void *)avalon))
+			quit(1, "Failed to create avalon round_thr");
+	}
+
 	if (pthread_create(&info->read_thr, NULL, avalon_get_results, (void *)avalon))
 		quit(1, "Failed to create avalon read_thr");
 
@@ -1619,6 +1725,21 @@ static struct api_data *avalon_api_stats(struct cgpu_info *cgpu)
 				info->version1, info->version2, info->version3);
 		root = api_add_string(root, "version", buf, true);
 	}
+	if (!is_bitburner(cgpu)) {
+		double idle_avg, write_avg;
+
+		mutex_lock(&info->lock);
+		if (info->rounds) {
+			idle_avg = info->round_idle / info->rounds;
+			write_avg = info->round_write / info->rounds;
+		} else
+			idle_avg = write_avg = 0;
+		root = api_add_uint64(root, "rounds", &(info->rounds), true);
+		root = api_add_double(root, "round_idle_avg", &idle_avg, true);
+		root = api_add_double(root, "round_idle_max", &(info->round_idle_max), true);
+		root = api_add_double(root, "round_write_avg", &write_avg, true);
+		mutex_unlock(&info->lock);
+	}
 	root = api_add_uint32(root, "Controller Version", &(info->ctlr_ver), false);
 	root = api_add_uint32(root, "Avalon Chip", &(info->asic), false);
 
@@ -1632,6 +1753,14 @@ static void avalon_shutdown(struct thr_info *thr)
 
 	pthread_join(info->read_thr, NULL);
 	pthread_join(info->write_thr, NULL);
+	if (!is_bitburner(avalon)) {
+		pthread_join(info->round_thr, NULL);
+		cgsem_destroy(&info->round_free);
+		cgsem_destroy(&info->round_ready);
+		free(info->round_buf[0]);
+		free(info->round_buf[1]);
+		info->round_buf[0] = info->round_buf[1] = NULL;
+	}
 	avalon_running_reset(avalon, info);
 	cgsem_destroy(&info->qsem);
 	mutex_destroy(&info->qlock);
@@ -152,6 +152,22 @@ struct avalon_info {
 	cgtimer_t cgsent;
 	int send_delay;
 
+	/* Double buffered rounds of tasks, one being written by the round
+	 * writer while avalon_send_tasks() assembles the next
+	 * Each task is at a multiple of AVALON_TASK_SIZE in round_buf */
+	pthread_t round_thr;
+	uint8_t *round_buf[2];
+	int round_tasks[2];
+	int round_tlen[2];
+	cgsem_t round_ready;
+	cgsem_t round_free;
+	bool round_error;
+	struct timeval round_end;
+	uint64_t rounds;
+	double round_idle;
+	double round_idle_max;
+	double round_write;
+
 	int nonces;
 	int auto_queued;
 	int auto_nonces;
@@ -174,6 +190,7 @@ struct avalon_info {
 #define BITBURNER_VERSION3 0
 
 #define AVALON_WRITE_SIZE (sizeof(struct avalon_task))
+#define AVALON_TASK_SIZE (AVALON_WRITE_SIZE + 4 * AVALON_DEFAULT_ASIC_NUM)
 #define AVALON_READ_SIZE (sizeof(struct avalon_result))
 #define AVALON_ARRAY_SIZE 3
 #define BITBURNER_ARRAY_SIZE 4
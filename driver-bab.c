@@ -16,6 +16,7 @@
 #include "miner.h"
 #include "sha2.h"
 #include "klist.h"
+#include "spi-context.h"
 #include <ctype.h>
 
 /*
@@ -469,6 +470,9 @@ struct bab_info {
 	uint64_t work_unrolled;
 	uint64_t work_rolled;
 
+	// All transfers for one bank go in a single ioctl
+	struct spi_batch spi_batch;
+
 	// bab-options (in order)
 	uint8_t max_speed;
 	uint8_t def_speed;
@@ -709,21 +713,72 @@ static void _bab_reset(__maybe_unused struct cgpu_info *babcgpu, struct bab_info
 	BAB_OUT_GPIO_V(9, 0);
 }
 
+static void bab_txrx_err(struct cgpu_info *babcgpu, struct bab_info *babinfo, K_ITEM *item, int count, uint32_t pos, uint32_t len, const char *file, const char *func, const int line)
+{
+	int bank, chip1, chip2;
+
+	for (bank = BAB_MAXBANKS; bank >= 0; bank--) {
+		if (DATAS(item)->bank_off[bank] &&
+		    pos >= DATAS(item)->bank_off[bank]) {
+			break;
+		}
+	}
+	for (chip1 = babinfo->chips-1; chip1 >= 0; chip1--) {
+		if (DATAS(item)->chip_off[chip1] &&
+		    pos >= DATAS(item)->chip_off[chip1]) {
+			break;
+		}
+	}
+	for (chip2 = babinfo->chips-1; chip2 >= 0; chip2--) {
+		if (DATAS(item)->chip_off[chip2] &&
+		    (pos + len) >= DATAS(item)->chip_off[chip2]) {
+			break;
+		}
+	}
+	applog(LOG_ERR, "%s%d: ioctl (%d) siz=%d bank=%d chip=%d-%d"
+			" failed err=%d" BAB_FFL,
+			babcgpu->drv->name,
+			babcgpu->device_id,
+			count, (int)len,
+			bank, chip1, chip2,
+			errno, BAB_FFL_PASS);
+}
+
+/*
+ * The transfers between bank resets are queued up and sent with one
+ * SPI_IOC_MESSAGE(n) rather than an ioctl each
+ * A non-zero trf_delay needs to sleep between transfers so then each
+ * transfer is sent on its own as before
+ */
+static bool bab_txrx_flush(struct cgpu_info *babcgpu, struct bab_info *babinfo, K_ITEM *item, bool detect_ignore, int *count, uint32_t pos, const char *file, const char *func, const int line)
+{
+	uint32_t len = babinfo->spi_batch.bytes;
+
+	if (babinfo->spi_batch.count == 0)
+		return true;
+
+	(*count)++;
+	if (spi_batch_submit(babinfo->spifd, &(babinfo->spi_batch)) < 0) {
+		if (!detect_ignore || errno != 110)
+			bab_txrx_err(babcgpu, babinfo, item, *count, pos - len, len, BAB_FFL_PASS);
+		return false;
+	}
+
+	return true;
+}
+
 // TODO: handle a false return where this is called?
 static bool _bab_txrx(struct cgpu_info *babcgpu, struct bab_info *babinfo, K_ITEM *item, bool detect_ignore, const char *file, const char *func, const int line)
 {
-	int bank, i, count, chip1, chip2;
-	uint32_t siz, pos;
-	struct spi_ioc_transfer tran;
-	uintptr_t rbuf, wbuf;
+	int bank, i, count;
+	uint32_t siz, pos, len, speed_hz;
+	uint8_t *rbuf, *wbuf;
 
-	wbuf = (uintptr_t)(DATAS(item)->wbuf);
-	rbuf = (uintptr_t)(DATAS(item)->rbuf);
+	wbuf = DATAS(item)->wbuf;
+	rbuf = DATAS(item)->rbuf;
 	siz = (uint32_t)(DATAS(item)->siz);
 
-	memset(&tran, 0, sizeof(tran));
-	tran.speed_hz = babinfo->speed_hz;
-	tran.delay_usecs = babinfo->delay_usecs;
+	spi_batch_reset(&(babinfo->spi_batch));
 
 	i = 0;
 	pos = 0;
@@ -743,31 +798,33 @@ static bool _bab_txrx(struct cgpu_info *babcgpu, struct bab_info *babinfo, K_ITE
 
 	count = 0;
 	while (siz > 0) {
-		tran.tx_buf = wbuf;
-		tran.rx_buf = rbuf;
-		tran.speed_hz = BAB_SPI_SPEED;
+		speed_hz = BAB_SPI_SPEED;
 		if (pos == DATAS(item)->bank_off[bank]) {
 			for (; ++bank <= BAB_MAXBANKS; ) {
 				if (DATAS(item)->bank_off[bank] > pos) {
+					// Everything queued so far must go before the reset
+					if (!bab_txrx_flush(babcgpu, babinfo, item, detect_ignore,
+							    &count, pos, BAB_FFL_PASS))
+						return false;
 					bab_reset(bank, 64);
 					break;
 				}
 			}
 		}
 		if (siz < BAB_SPI_BUFSIZ)
-			tran.len = siz;
+			len = siz;
 		else
-			tran.len = BAB_SPI_BUFSIZ;
+			len = BAB_SPI_BUFSIZ;
 
 		if (pos < DATAS(item)->bank_off[bank] &&
-		    DATAS(item)->bank_off[bank] < (pos + tran.len))
-			tran.len = DATAS(item)->bank_off[bank] - pos;
+		    DATAS(item)->bank_off[bank] < (pos + len))
+			len = DATAS(item)->bank_off[bank] - pos;
 
 		for (; i < babinfo->chips; i++) {
 			if (!DATAS(item)->chip_off[i])
 				continue;
-			if (DATAS(item)->chip_off[i] >= pos + tran.len) {
-				tran.speed_hz = babinfo->chip_spis[i];
+			if (DATAS(item)->chip_off[i] >= pos + len) {
+				speed_hz = babinfo->chip_spis[i];
 				break;
 			}
 		}
@@ -786,53 +843,39 @@ static bool _bab_txrx(struct cgpu_info *babcgpu, struct bab_info *babinfo, K_ITE
 						BAB_SPI_SPEED, BAB_FFL_PASS);
 		}
 
-		if (unlikely(tran.speed_hz == BAB_SPI_SPEED)) {
+		if (unlikely(speed_hz == BAB_SPI_SPEED)) {
 			applog(LOG_DEBUG, "%s%d: %s() transfer speed %d shouldn't be %d" BAB_FFL,
 						babcgpu->drv->name, babcgpu->device_id,
-						__func__, (int)tran.speed_hz,
+						__func__, (int)speed_hz,
 						BAB_SPI_SPEED, BAB_FFL_PASS);
 		}
 
-		count++;
-		if (ioctl(babinfo->spifd, SPI_IOC_MESSAGE(1), (void *)&tran) < 0) {
-			if (!detect_ignore || errno != 110) {
-				for (bank = BAB_MAXBANKS; bank >= 0; bank--) {
-					if (DATAS(item)->bank_off[bank] &&
-					    pos >= DATAS(item)->bank_off[bank]) {
-						break;
-					}
-				}
-				for (chip1 = babinfo->chips-1; chip1 >= 0; chip1--) {
-					if (DATAS(item)->chip_off[chip1] &&
-					    pos >= DATAS(item)->chip_off[chip1]) {
-						break;
-					}
-				}
-				for (chip2 = babinfo->chips-1; chip2 >= 0; chip2--) {
-					if (DATAS(item)->chip_off[chip2] &&
-					    (pos + tran.len) >= DATAS(item)->chip_off[chip2]) {
-						break;
-					}
-				}
-				applog(LOG_ERR, "%s%d: ioctl (%d) siz=%d bank=%d chip=%d-%d"
-						" failed err=%d" BAB_FFL,
-						babcgpu->drv->name,
-						babcgpu->device_id,
-						count, (int)(tran.len),
-						bank, chip1, chip2,
-						errno, BAB_FFL_PASS);
-			}
-			return false;
+		// Full, so send what's queued and start again
+		if (!spi_batch_add(&(babinfo->spi_batch), wbuf, rbuf, len, speed_hz,
+				   babinfo->delay_usecs, true)) {
+			if (!bab_txrx_flush(babcgpu, babinfo, item, detect_ignore,
+					    &count, pos, BAB_FFL_PASS))
+				return false;
+			spi_batch_add(&(babinfo->spi_batch), wbuf, rbuf, len, speed_hz,
+				      babinfo->delay_usecs, true);
 		}
 
-		siz -= tran.len;
-		wbuf += tran.len;
-		rbuf += tran.len;
-		pos += tran.len;
+		siz -= len;
+		wbuf += len;
+		rbuf += len;
+		pos += len;
 
-		if (siz > 0 && babinfo->trf_delay > 0)
-			cgsleep_us(babinfo->trf_delay);
+		if (babinfo->trf_delay > 0) {
+			if (!bab_txrx_flush(babcgpu, babinfo, item, detect_ignore,
+					    &count, pos, BAB_FFL_PASS))
+				return false;
+			if (siz > 0)
+				cgsleep_us(babinfo->trf_delay);
+		}
 	}
+	if (!bab_txrx_flush(babcgpu, babinfo, item, detect_ignore, &count, pos, BAB_FFL_PASS))
+		return false;
+
 	cgtime(&(DATAS(item)->work_start));
 	mutex_lock(&(babinfo->did_lock));
 	cgtime(&(babinfo->last_did));
@@ -2988,6 +3031,10 @@ static struct api_data *bab_api_stats(struct cgpu_info *babcgpu)
 	root = api_add_uint64(root, "Work Unrolled", &(babinfo->work_unrolled), true);
 	root = api_add_uint64(root, "Work Rolled", &(babinfo->work_rolled), true);
 
+	root = api_add_uint64(root, "SPI Ioctls", &(babinfo->spi_batch.ioctls), true);
+	root = api_add_uint64(root, "SPI Transfers", &(babinfo->spi_batch.xfrs), true);
+	root = api_add_uint64(root, "SPI Bytes", &(babinfo->spi_batch.total_bytes), true);
+
 	i = (int)(babinfo->max_speed);
 	root = api_add_int(root, bab_options[0], &i, true);
 	i = (int)(babinfo->def_speed);
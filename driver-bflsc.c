@@ -201,6 +201,44 @@ static void freebreakdown(int *count, char **firstname, char ***fields)
 	*fields = NULL;
 }
 
+/* In place, allocation free, versions of tolines() and breakdown(NOCOLON)
+ * for the results hot path, storing no more than max pointers */
+
+// Break buf up into lines with LFs removed, -1 means a missing LF at the end
+static int splitlines(char *buf, char **lines, int max)
+{
+	int count = 0;
+	char *lf;
+
+	while (*buf && count < max) {
+		lf = strchr(buf, '\n');
+		if (!lf)
+			return -1;
+		*lf = '\0';
+		lines[count++] = buf;
+		buf = lf + 1;
+	}
+	return count;
+}
+
+// Break line down at each ',' returning the count of all fields found
+static int splitfields(char *line, char **fields, int max)
+{
+	int count = 0;
+	char *comma;
+
+	while (line && *line) {
+		comma = strchr(line, ',');
+		if (comma)
+			*(comma++) = '\0';
+		if (count < max)
+			fields[count] = line;
+		count++;
+		line = comma;
+	}
+	return count;
+}
+
 static bool isokerr(int err, char *buf, int amount)
 {
 	if (err < 0 || amount < (int)BFLSC_OK_LEN)
@@ -969,6 +1007,12 @@ static void bflsc_flush_work(struct cgpu_info *bflsc)
 	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
 	int dev;
 
+	// Work waiting in a pack is stale
+	mutex_lock(&(bflsc->device_mutex));
+	while (sc_info->pack_count > 0)
+		work_completed(bflsc, sc_info->pack_work[--(sc_info->pack_count)]);
+	mutex_unlock(&(bflsc->device_mutex));
+
 	for (dev = 0; dev < sc_info->sc_count; dev++)
 		flush_one_dev(bflsc, dev);
 }
@@ -1367,20 +1411,25 @@ static void process_nonces(struct cgpu_info *bflsc, int dev, char *xlink, char *
 static int process_results(struct cgpu_info *bflsc, int dev, char *pbuf, int *nonces)
 {
 	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
-	char **items, *firstname, **fields, *lf;
-	int que = 0, i, lines, count;
-	char *tmp, *tmp2, *buf;
+	char *items[QUE_RES_LINES_MAX], *fields[QUE_FLD_MAX_V2];
+	char buf[BFLSC_BUFSIZ+1], line[BFLSC_BUFSIZ+1];
+	int que = 0, i, len, lines, count;
+	char *tmp, *tmp2, *colon;
 	char xlink[17];
-	bool res;
 
 	*nonces = 0;
 
 	xlinkstr(xlink, sizeof(xlink), dev, sc_info);
 
-	buf = strdup(pbuf);
-	res = tolines(bflsc, dev, buf, &lines, &items, C_GETRESULTS);
-	free(buf);
-	if (!res || lines < 1) {
+	// One copy to split into lines, each line is copied again to split up
+	len = strlen(pbuf);
+	if (len > BFLSC_BUFSIZ)
+		len = BFLSC_BUFSIZ;
+	memcpy(buf, pbuf, len);
+	buf[len] = '\0';
+
+	lines = splitlines(buf, items, QUE_RES_LINES_MAX);
+	if (lines < 1) {
 		tmp = str_text(pbuf);
 		applogsiz(LOG_ERR, BFLSC_APPLOGSIZ,
 				"%s%i:%s empty result (%s) ignored",
@@ -1398,7 +1447,12 @@ static int process_results(struct cgpu_info *bflsc, int dev, char *pbuf, int *no
 		goto arigatou;
 	}
 
-	breakdown(ONECOLON, items[1], &count, &firstname, &fields, &lf);
+	strcpy(line, items[1]);
+	colon = strchr(line, ':');
+	if (colon)
+		count = splitfields(colon + 1, fields, QUE_FLD_MAX_V2);
+	else
+		count = 0;
 	if (count < 1) {
 		tmp = str_text(pbuf);
 		tmp2 = str_text(items[1]);
@@ -1434,23 +1488,21 @@ static int process_results(struct cgpu_info *bflsc, int dev, char *pbuf, int *no
 
 	}
 
-	freebreakdown(&count, &firstname, &fields);
-
 	for (i = 0; i < que; i++) {
-		res = breakdown(NOCOLON, items[i + QUE_RES_LINES_MIN - 1], &count, &firstname, &fields, &lf);
-		if (likely(res))
-			process_nonces(bflsc, dev, &(xlink[0]), items[i], count, fields, nonces);
+		char *item = items[i + QUE_RES_LINES_MIN - 1];
+
+		strcpy(line, item);
+		count = splitfields(line, fields, QUE_FLD_MAX_V2);
+		if (likely(count > 0))
+			process_nonces(bflsc, dev, &(xlink[0]), item, count, fields, nonces);
 		else
 			applogsiz(LOG_ERR, BFLSC_APPLOGSIZ,
 					"%s%i:%s failed to process nonce %s",
-					bflsc->drv->name, bflsc->device_id, xlink, items[i]);
-		freebreakdown(&count, &firstname, &fields);
+					bflsc->drv->name, bflsc->device_id, xlink, item);
 		sc_info->not_first_work = true;
 	}
 
 arigatou:
-	freetolines(&lines, &items);
-
 	return que;
 }
 
@@ -1559,46 +1611,22 @@ static void bflsc_thread_enable(struct thr_info *thr)
 	bflsc_initialise(bflsc);
 }
 
-static bool bflsc_send_work(struct cgpu_info *bflsc, int dev, bool mandatory)
+// Send one job to dev with ZNX, device_mutex must be held
+static bool bflsc_send_job(struct cgpu_info *bflsc, int dev, struct work *work)
 {
 	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
 	struct FullNonceRangeJob data;
 	char buf[BFLSC_BUFSIZ+1];
-	bool sent, ret = false;
-	struct work *work;
 	int err, amount;
 	int len, try;
 	int stage;
+	bool sent;
 
-	// Device is gone
-	if (bflsc->usbinfo.nodev)
-		return false;
-
-	// TODO: handle this everywhere
-	if (sc_info->sc_devs[dev].overheat == true)
-		return false;
-
-	// Initially code only deals with sending one work item
 	data.payloadSize = BFLSC_JOBSIZ;
 	data.endOfBlock = BFLSC_EOB;
 
 	len = sizeof(struct FullNonceRangeJob);
 
-	/* On faster devices we have a lot of lock contention so only
-	 * mandatorily grab the lock and send work if the queue is empty since
-	 * we have a submit queue. */
-	if (mandatory)
-		mutex_lock(&(bflsc->device_mutex));
-	else {
-		if (mutex_trylock(&bflsc->device_mutex))
-			return ret;
-	}
-
-	work = get_queued(bflsc);
-	if (unlikely(!work)) {
-		mutex_unlock(&bflsc->device_mutex);
-		return ret;
-	}
 	memcpy(data.midState, work->midstate, MIDSTATE_BYTES);
 	memcpy(data.blockData, work->data + MERKLE_OFFSET, MERKLE_BYTES);
 	try = 0;
@@ -1607,13 +1635,12 @@ re_send:
 				BFLSC_QJOB, BFLSC_QJOB_LEN, C_REQUESTQUEJOB, C_REQUESTQUEJOBSTATUS,
 				(char *)&data, len, C_QUEJOB, C_QUEJOBSTATUS,
 				buf, sizeof(buf)-1);
-	mutex_unlock(&(bflsc->device_mutex));
 
 	switch (stage) {
 		case 1:
 			if (!sent) {
 				bflsc_applog(bflsc, dev, C_REQUESTQUEJOB, amount, err);
-				goto out;
+				return false;
 			} else {
 				// TODO: handle other errors ...
 
@@ -1623,13 +1650,13 @@ re_send:
 						goto re_send;
 
 				bflsc_applog(bflsc, dev, C_REQUESTQUEJOBSTATUS, amount, err);
-				goto out;
+				return false;
 			}
 			break;
 		case 2:
 			if (!sent) {
 				bflsc_applog(bflsc, dev, C_QUEJOB, amount, err);
-				goto out;
+				return false;
 			} else {
 				if (!isokerr(err, buf, amount)) {
 					// TODO: check for QUEUE FULL and set work_queued to sc_info->que_size
@@ -1642,7 +1669,7 @@ re_send:
 							goto re_send;
 
 					bflsc_applog(bflsc, dev, C_QUEJOBSTATUS, amount, err);
-					goto out;
+					return false;
 				}
 			}
 			break;
@@ -1653,8 +1680,208 @@ re_send:
 	wr_unlock(&(sc_info->stat_lock));
 
 	work->subid = dev;
-	ret = true;
-out:
+	return true;
+}
+
+/* Send count jobs to dev with one ZWX, device_mutex must be held
+ * Returns how many of the jobs, from the start of works, the device queued
+ * or -1 if the firmware doesn't accept ZWX, and then none were queued */
+static int bflsc_send_jobs(struct cgpu_info *bflsc, int dev, struct work **works, int count)
+{
+	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
+	uint8_t data[BFLSC_QJOBS_HDR + sizeof(struct QueueJobStructure) * BFLSC_QJOBS_MAX + 1];
+	struct QueueJobStructure *job;
+	char buf[BFLSC_BUFSIZ+1];
+	int err, amount;
+	int i, len, try, queued;
+	int stage;
+	bool sent;
+
+	len = BFLSC_QJOBS_HDR + sizeof(struct QueueJobStructure) * count + 1;
+	// payloadSize is everything after itself
+	data[0] = len - 1;
+	data[1] = BFLSC_SIGNATURE;
+	data[2] = count;
+	job = (struct QueueJobStructure *)(data + BFLSC_QJOBS_HDR);
+	for (i = 0; i < count; i++) {
+		job[i].payloadSize = BFLSC_JOBSIZ;
+		memcpy(job[i].midState, works[i]->midstate, MIDSTATE_BYTES);
+		memcpy(job[i].blockData, works[i]->data + MERKLE_OFFSET, MERKLE_BYTES);
+		job[i].endOfBlock = BFLSC_EOB;
+	}
+	data[len - 1] = BFLSC_EOW;
+
+	try = 0;
+re_send:
+	err = send_recv_ds(bflsc, dev, &stage, &sent, &amount,
+				BFLSC_QJOBS, BFLSC_QJOBS_LEN, C_REQUESTQUEJOBS, C_REQUESTQUEJOBSSTATUS,
+				(char *)data, len, C_QUEJOBS, C_QUEJOBSSTATUS,
+				buf, sizeof(buf)-1);
+
+	if (!sent) {
+		bflsc_applog(bflsc, dev, stage == 1 ? C_REQUESTQUEJOBS : C_QUEJOBS, amount, err);
+		return 0;
+	}
+
+	if (stage == 2 && err >= 0 && strncmp(buf, BFLSC_OKQN, BFLSC_OKQN_LEN) == 0) {
+		queued = atoi(buf + BFLSC_OKQN_LEN);
+		if (queued < 0 || queued > count)
+			queued = 0;
+	} else if (stage == 2 && isokerr(err, buf, amount))
+		queued = count;
+	else {
+		// Try twice
+		if (try++ < 1 && amount > 1 && strstr(buf, BFLSC_TIMEOUT))
+			goto re_send;
+
+		// An error reply, other than a timeout, means no ZWX support
+		if (err >= 0 && amount > 1 && strstr(buf, BFLSC_ANERR) &&
+		    !strstr(buf, BFLSC_TIMEOUT))
+			return -1;
+
+		bflsc_applog(bflsc, dev, stage == 1 ? C_REQUESTQUEJOBSSTATUS : C_QUEJOBSSTATUS, amount, err);
+		return 0;
+	}
+
+	wr_lock(&(sc_info->stat_lock));
+	sc_info->sc_devs[dev].work_queued += queued;
+	sc_info->pack_sends++;
+	sc_info->pack_jobs += queued;
+	wr_unlock(&(sc_info->stat_lock));
+
+	for (i = 0; i < queued; i++)
+		works[i]->subid = dev;
+
+	return queued;
+}
+
+/* Send the waiting pack, device_mutex must be held
+ * Any work not queued is added to works/count for the caller to complete
+ * outside of the device_mutex */
+static void bflsc_send_pack(struct cgpu_info *bflsc, struct work **works, int *count)
+{
+	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
+	int dev = sc_info->pack_dev;
+	int i, queued;
+
+	if (sc_info->pack_count < 1)
+		return;
+
+	if (sc_info->pack_count > 1)
+		queued = bflsc_send_jobs(bflsc, dev, sc_info->pack_work, sc_info->pack_count);
+	else
+		queued = -1;
+
+	if (queued < 0) {
+		if (sc_info->pack_count > 1) {
+			applog(LOG_WARNING, "%s%i: firmware rejected %s, using %s only",
+			       bflsc->drv->name, bflsc->device_id, BFLSC_QJOBS, BFLSC_QJOB);
+			sc_info->pack_bad = true;
+		}
+		for (i = 0; i < sc_info->pack_count; i++) {
+			if (!bflsc_send_job(bflsc, dev, sc_info->pack_work[i]))
+				works[(*count)++] = sc_info->pack_work[i];
+		}
+	} else {
+		for (i = queued; i < sc_info->pack_count; i++)
+			works[(*count)++] = sc_info->pack_work[i];
+	}
+
+	sc_info->pack_count = 0;
+}
+
+static void bflsc_complete_works(struct cgpu_info *bflsc, struct work **works, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		work_completed(bflsc, works[i]);
+}
+
+/* V2 devices are sent work BFLSC_QJOBS_MAX at a time with ZWX, one round
+ * trip per pack rather than per job, when dev has room for a whole pack */
+static bool bflsc_use_pack(struct bflsc_info *sc_info, int dev)
+{
+	bool ret;
+
+	if (sc_info->driver_version != BFLSC_DRV2 || sc_info->pack_bad)
+		return false;
+
+	rd_lock(&(sc_info->stat_lock));
+	ret = (sc_info->sc_devs[dev].work_queued + BFLSC_QJOBS_MAX <= sc_info->que_size);
+	rd_unlock(&(sc_info->stat_lock));
+
+	return ret;
+}
+
+// Send any waiting pack now
+static void bflsc_flush_pack(struct cgpu_info *bflsc)
+{
+	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
+	struct work *unsent[BFLSC_QJOBS_MAX];
+	int count = 0;
+
+	if (sc_info->pack_count < 1)
+		return;
+
+	mutex_lock(&(bflsc->device_mutex));
+	bflsc_send_pack(bflsc, unsent, &count);
+	mutex_unlock(&(bflsc->device_mutex));
+
+	bflsc_complete_works(bflsc, unsent, count);
+}
+
+static bool bflsc_send_work(struct cgpu_info *bflsc, int dev, bool mandatory)
+{
+	struct bflsc_info *sc_info = (struct bflsc_info *)(bflsc->device_data);
+	struct work *work, *unsent[BFLSC_QJOBS_MAX];
+	int count = 0;
+	bool ret = false;
+
+	// Device is gone
+	if (bflsc->usbinfo.nodev)
+		return false;
+
+	// TODO: handle this everywhere
+	if (sc_info->sc_devs[dev].overheat == true)
+		return false;
+
+	/* On faster devices we have a lot of lock contention so only
+	 * mandatorily grab the lock and send work if the queue is empty since
+	 * we have a submit queue. */
+	if (mandatory)
+		mutex_lock(&(bflsc->device_mutex));
+	else {
+		if (mutex_trylock(&bflsc->device_mutex))
+			return ret;
+	}
+
+	work = get_queued(bflsc);
+	if (unlikely(!work)) {
+		mutex_unlock(&bflsc->device_mutex);
+		return ret;
+	}
+
+	// A pack for a different dev goes first
+	if (sc_info->pack_count > 0 && sc_info->pack_dev != dev)
+		bflsc_send_pack(bflsc, unsent, &count);
+
+	if (bflsc_use_pack(sc_info, dev)) {
+		// The work is in the queue now so this dev is done until the pack is sent
+		sc_info->pack_dev = dev;
+		sc_info->pack_work[sc_info->pack_count++] = work;
+		work = NULL;
+		ret = true;
+		if (sc_info->pack_count >= BFLSC_QJOBS_MAX)
+			bflsc_send_pack(bflsc, unsent, &count);
+	} else {
+		// Only one pack is ever sent per call since the pack is now for dev
+		bflsc_send_pack(bflsc, unsent, &count);
+		ret = bflsc_send_job(bflsc, dev, work);
+	}
+	mutex_unlock(&(bflsc->device_mutex));
+
+	bflsc_complete_works(bflsc, unsent, count);
 	if (unlikely(!ret))
 		work_completed(bflsc, work);
 	return ret;
@@ -1710,6 +1937,8 @@ static bool bflsc_queue_full(struct cgpu_info *bflsc)
 
 		// nothing needs work yet
 		if (dev == -1) {
+			// so don't leave work waiting in a pack
+			bflsc_flush_pack(bflsc);
 			ret = true;
 			break;
 		}
@@ -1949,6 +2178,9 @@ static struct api_data *bflsc_api_stats(struct cgpu_info *bflsc)
 	for (i = 0; i <= QUE_MAX_RESULTS + 1; i++)
 		tailsprintf(buf, sizeof(buf), "%s%"PRIu64, (i > 0) ? "/" : "", sc_info->result_size[i]);
 	root = api_add_string(root, "Result Size", buf, true);
+	root = api_add_uint64(root, "Pack Sends", &(sc_info->pack_sends), true);
+	root = api_add_uint64(root, "Pack Jobs", &(sc_info->pack_jobs), true);
+	root = api_add_bool(root, "Pack Bad", &(sc_info->pack_bad), true);
 
 	rd_unlock(&(sc_info->stat_lock));
 
@@ -116,6 +116,10 @@ struct bflsc_dev {
 
 #define QUE_MAX_RESULTS 8
 
+// Most jobs sent in one ZWX, ZWX also needs the 3 byte pack header
+#define BFLSC_QJOBS_MAX 5
+#define BFLSC_QJOBS_HDR 3
+
 struct bflsc_info {
 	enum driver_version driver_version;
 	pthread_rwlock_t stat_lock;
@@ -144,6 +148,13 @@ struct bflsc_info {
 	int flush_size;
 	// count of given size, [+2] is for any > QUE_MAX_RESULTS
 	uint64_t result_size[QUE_MAX_RESULTS+2];
+	// Work waiting to be sent to pack_dev in one ZWX
+	struct work *pack_work[BFLSC_QJOBS_MAX];
+	int pack_count;
+	int pack_dev;
+	bool pack_bad; // firmware rejected ZWX so use ZNX only
+	uint64_t pack_sends;
+	uint64_t pack_jobs;
 };
 
 #define BFLSC_XLINKHDR '@'
@@ -198,6 +209,9 @@ struct QueueJobPackStructure {
 	uint8_t endOfWrapper;
 };
 
+// Most result lines processed from one results reply
+#define QUE_RES_LINES_MAX 64
+
 // TODO: Implement in API and also in usb device selection
 struct SaveString {
 	uint8_t payloadSize;
@@ -30,6 +30,8 @@ static void ants2_detect(__maybe_unused bool hotplug)
 #include "elist.h"
 #include "usbutils.h"
 #include "driver-bitmain.h"
+#include "verify.h"
+#include "crc.h"
 #include "hexdump.c"
 #include "util.h"
 #include <fcntl.h>
@@ -104,75 +106,6 @@ static unsigned char bit_swap_table[256] =
 #define bitswap(x) (x)
 #endif
 
-// --------------------------------------------------------------
-//      CRC16 check table
-// --------------------------------------------------------------
-const uint8_t chCRCHTalbe[] = // CRC high byte table
-{
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
- 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
- 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
- 0x00, 0xC1, 0x81, 0x40
-};
-
-const uint8_t chCRCLTalbe[] = // CRC low byte table
-{
- 0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7,
- 0x05, 0xC5, 0xC4, 0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E,
- 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09, 0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9,
- 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD, 0x1D, 0x1C, 0xDC,
- 0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
- 0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32,
- 0x36, 0xF6, 0xF7, 0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D,
- 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A, 0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38,
- 0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE, 0x2E, 0x2F, 0xEF,
- 0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
- 0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1,
- 0x63, 0xA3, 0xA2, 0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4,
- 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F, 0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB,
- 0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB, 0x7B, 0x7A, 0xBA,
- 0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
- 0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0,
- 0x50, 0x90, 0x91, 0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97,
- 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C, 0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E,
- 0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88, 0x48, 0x49, 0x89,
- 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
- 0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83,
- 0x41, 0x81, 0x80, 0x40
-};
-
-static uint16_t CRC16(const uint8_t* p_data, uint16_t w_len)
-{
-	uint8_t chCRCHi = 0xFF; // CRC high byte initialize
-	uint8_t chCRCLo = 0xFF; // CRC low byte initialize
-	uint16_t wIndex = 0;    // CRC cycling index
-
-	while (w_len--) {
-		wIndex = chCRCLo ^ *p_data++;
-		chCRCLo = chCRCHi ^ chCRCHTalbe[wIndex];
-		chCRCHi = chCRCLTalbe[wIndex];
-	}
-	return ((chCRCHi << 8) | chCRCLo);
-}
-
 static uint32_t num2bit(int num)
 {
 	if (num < 0 || num > 31)
@@ -399,7 +332,7 @@ static int bitmain_set_txconfig(struct bitmain_txconfig_token *bm,
 	bm->chip_address = chip_address;
 	bm->reg_address = reg_address;
 
-	crc = CRC16((uint8_t *)bm, datalen-2);
+	crc = crc16_modbus((uint8_t *)bm, datalen-2);
 	bm->crc = htole16(crc);
 
 #ifdef USE_ANT_S1
@@ -458,7 +391,8 @@ static int bitmain_set_txtask(struct bitmain_info *info, uint8_t *sendbuf,
 		applog(LOG_WARNING, "%s: %s() bm is null", ANTDRV.dname, __func__);
 		return -1;
 	}
-	memset(bm, 0, sizeof(struct bitmain_txtask_token));
+	// Every work field is written below, so only the header needs clearing
+	memset(bm, 0, offsetof(struct bitmain_txtask_token, works));
 
 	bm->token_type = BITMAIN_TOKEN_TYPE_TXTASK;
 #ifdef USE_ANT_S2
@@ -543,7 +477,7 @@ static int bitmain_set_txtask(struct bitmain_info *info, uint8_t *sendbuf,
 
 	*sentcount = cursentcount;
 
-	crc = CRC16(sendbuf, datalen-2);
+	crc = crc16_modbus(sendbuf, datalen-2);
 	crc = htole16(crc);
 	memcpy(sendbuf+datalen-2, &crc, 2);
 
@@ -607,7 +541,7 @@ static int bitmain_set_rxstatus(struct bitmain_rxstatus_token *bm,
 	bm->chip_address = chip_address;
 	bm->reg_address = reg_address;
 
-	crc = CRC16((uint8_t *)bm, datalen-2);
+	crc = crc16_modbus((uint8_t *)bm, datalen-2);
 	bm->crc = htole16(crc);
 
 #ifdef USE_ANT_S1
@@ -662,7 +596,7 @@ static int bitmain_parse_rxstatus(const uint8_t * data, int datalen, struct bitm
 				bm->length, datalen);
 		return -1;
 	}
-	crc = CRC16(data, datalen-2);
+	crc = crc16_modbus(data, datalen-2);
 	memcpy(&(bm->crc), data+datalen-2, 2);
 	bm->crc = htole16(bm->crc);
 	if (crc != bm->crc) {
@@ -730,7 +664,7 @@ static int bitmain_parse_rxstatus(const uint8_t * data, int datalen, struct bitm
 				bm->length, datalen);
 		return -1;
 	}
-	crc = CRC16(data, datalen-2);
+	crc = crc16_modbus(data, datalen-2);
 	memcpy(&(bm->crc), data+datalen-2, 2);
 	bm->crc = htole16(bm->crc);
 	if (crc != bm->crc) {
@@ -855,7 +789,11 @@ static int bitmain_parse_rxnonce(const uint8_t * data, int datalen, struct bitma
 				ANTDRV.dname, __func__, datalen);
 		return -1;
 	}
-	memcpy(bm, data, sizeof(struct bitmain_rxnonce_data));
+	// Only the frame itself, not whatever follows it in the read buffer
+	if (datalen < (int)sizeof(struct bitmain_rxnonce_data))
+		memcpy(bm, data, datalen);
+	else
+		memcpy(bm, data, sizeof(struct bitmain_rxnonce_data));
 
 	if (bm->data_type != BITMAIN_DATA_TYPE_RXNONCE) {
 		applog(LOG_ERR, "%s: %s() datatype(%02x) error",
@@ -885,7 +823,7 @@ static int bitmain_parse_rxnonce(const uint8_t * data, int datalen, struct bitma
 		return -1;
 	}
 #endif
-	crc = CRC16(data, datalen-2);
+	crc = crc16_modbus(data, datalen-2);
 	memcpy(&(bm->crc), data+datalen-2, 2);
 	bm->crc = htole16(bm->crc);
 	if (crc != bm->crc) {
@@ -1122,513 +1060,434 @@ static void bitmain_update_temps(struct cgpu_info *bitmain, struct bitmain_info
 #endif
 }
 
-static void bitmain_parse_results(struct cgpu_info *bitmain, struct bitmain_info *info,
-				  struct thr_info *thr, uint8_t *buf, int *offset)
+// Called by verify_nonce() once the nonce has been tested and submitted
+static void bitmain_verified(struct thr_info *thr, struct work *work, uint32_t nonce, bool valid)
+{
+	struct cgpu_info *bitmain = thr->cgpu;
+	struct bitmain_info *info = (struct bitmain_info *)(bitmain->device_data);
+
+	if (valid) {
+		ratelog(LOG_DEBUG, "%s%d: %s() RxNonce Data ok",
+				  bitmain->drv->name, bitmain->device_id,
+				  __func__);
+		mutex_lock(&info->qlock);
+#ifdef USE_ANT_S1
+		info->nonces++;
+#else
+		info->nonces += work->device_diff;
+#endif
+		mutex_unlock(&info->qlock);
+	} else {
+		applog(LOG_ERR, "%s%d: %s() RxNonce Data "
+				"error work(%"PRIu32") nonce %08x",
+				bitmain->drv->name, bitmain->device_id,
+				__func__, work->id, nonce);
+	}
+}
+
+#ifdef USE_ANT_S1
+#define BITMAIN_CHAIN_STATUS_SIZ 40
+#else
+#define BITMAIN_CHAIN_STATUS_SIZ 320
+#endif
+
+// Big enough for a log message that includes a chain status
+#define BITMAIN_STATUS_APPLOGSIZ (LOGBUFSIZ + BITMAIN_CHAIN_STATUS_SIZ)
+
+/* Format the chain's asic status bits, 'o' ok, 'x' failed and on the S2 '-'
+ * missing, in groups of 8. Only done when it's logged or the API asks
+ * Caller must hold qlock if the rx thread is running */
+static char *bitmain_chain_status(struct bitmain_info *info, int chain, char *buf, size_t siz)
+{
+	uint32_t checkbit;
+	size_t j = 0;
+	int r;
+#ifdef USE_ANT_S2
+	int m, asicnum;
+#endif
+
+	if (siz < BITMAIN_CHAIN_STATUS_SIZ) {
+		if (siz > 0)
+			buf[0] = '\0';
+		return buf;
+	}
+
+#ifdef USE_ANT_S1
+	for (r = 0; r < 32; r++) {
+		if (r%8 == 0 && r != 0)
+			buf[j++] = ' ';
+		checkbit = num2bit(r);
+		if (info->chain_asic_status[chain] & checkbit)
+			buf[j++] = 'o';
+		else
+			buf[j++] = 'x';
+	}
+#else // S2
+	if (info->chain_asic_num[chain] <= 0)
+		asicnum = 0;
+	else {
+		if (info->chain_asic_num[chain] % 32 == 0)
+			asicnum = info->chain_asic_num[chain] / 32;
+		else
+			asicnum = info->chain_asic_num[chain] / 32 + 1;
+	}
+	if (asicnum > 8)
+		asicnum = 8;
+	for (m = asicnum-1; m >= 0; m--) {
+		for (r = 0; r < 32; r++) {
+			if ((r % 8) == 0 && r != 0)
+				buf[j++] = ' ';
+			checkbit = num2bit(r);
+			if (info->chain_asic_exist[chain*8+m] & checkbit) {
+				if (info->chain_asic_status[chain*8+m] & checkbit)
+					buf[j++] = 'o';
+				else
+					buf[j++] = 'x';
+			} else
+				buf[j++] = '-';
+		}
+		buf[j++] = ' ';
+	}
+#endif
+	buf[j] = '\0';
+
+	return buf;
+}
+
+static void bitmain_rx_status(struct cgpu_info *bitmain, struct bitmain_info *info,
+			      struct thr_info *thr, const uint8_t *frame, int len)
 {
+	struct bitmain_rxstatus_data rxstatusdata;
+	char status[BITMAIN_CHAIN_STATUS_SIZ];
+	int j, n, errordiff;
+#ifdef USE_ANT_S2
+	bool changed[BITMAIN_MAX_CHAIN_NUM];
+#endif
+
+	ratelog(LOG_DEBUG, "%s%d: %s() RxStatus Data",
+			  bitmain->drv->name, bitmain->device_id,
+			  __func__);
+
+	if (bitmain_parse_rxstatus(frame, len, &rxstatusdata) != 0) {
+		applog(LOG_ERR, "%s%d: %s() RxStatus Data error len=%d",
+				bitmain->drv->name, bitmain->device_id,
+				__func__, len);
+		return;
+	}
+
+	mutex_lock(&info->qlock);
+	info->chain_num = rxstatusdata.chain_num;
+	info->fifo_space = rxstatusdata.fifo_space;
+#ifdef USE_ANT_S2
+	info->hw_version[0] = rxstatusdata.hw_version[0];
+	info->hw_version[1] = rxstatusdata.hw_version[1];
+	info->hw_version[2] = rxstatusdata.hw_version[2];
+	info->hw_version[3] = rxstatusdata.hw_version[3];
+#endif
+	info->nonce_error = rxstatusdata.nonce_error;
+	errordiff = info->nonce_error-info->last_nonce_error;
 #ifdef USE_ANT_S1
-	int i, j, n, m, errordiff, spare = BITMAIN_READ_SIZE;
-	uint32_t checkbit = 0x00000000;
-	bool found = false;
+	ratelog(LOG_DEBUG, "%s%d: %s() RxStatus Data"
+			" version=%d chainnum=%d fifospace=%d"
+			" nonceerror=%d-%d freq=%d chain info:",
+			bitmain->drv->name, bitmain->device_id, __func__,
+			rxstatusdata.version, info->chain_num,
+			info->fifo_space, info->last_nonce_error,
+			info->nonce_error, info->frequency);
+	for (n = 0; n < rxstatusdata.chain_num; n++) {
+		info->chain_asic_num[n] = rxstatusdata.chain_asic_num[n];
+		info->chain_asic_status[n] = rxstatusdata.chain_asic_status[n];
+		ratelog(LOG_DEBUG, "%s%d: %s() RxStatus Data chain(%d)"
+				" asic_num=%d asic_status=%08x-%s",
+				bitmain->drv->name, bitmain->device_id,
+				__func__,
+				n, info->chain_asic_num[n],
+				info->chain_asic_status[n],
+				bitmain_chain_status(info, n, status, sizeof(status)));
+	}
+#else // S2
+	ratelog(LOG_DEBUG, "%s%d: %s() RxStatus Data"
+			" version=%d chainnum=%d fifospace=%d"
+			" hwv1=%d hwv2=%d hwv3=%d hwv4=%d"
+			" nonceerror=%d-%d freq=%d chain info:",
+			bitmain->drv->name, bitmain->device_id, __func__,
+			rxstatusdata.version, info->chain_num, info->fifo_space,
+			info->hw_version[0], info->hw_version[1],
+			info->hw_version[2], info->hw_version[3],
+			info->last_nonce_error,
+			info->nonce_error, info->frequency);
+	for (n = 0; n < rxstatusdata.chain_num; n++) {
+		changed[n] = (info->chain_asic_num[n] != rxstatusdata.chain_asic_num[n] ||
+			      memcmp(&(info->chain_asic_exist[n*8]),
+				     &(rxstatusdata.chain_asic_exist[n*8]), 32) ||
+			      memcmp(&(info->chain_asic_status[n*8]),
+				     &(rxstatusdata.chain_asic_status[n*8]), 32));
+	}
+	memcpy(info->chain_asic_exist, rxstatusdata.chain_asic_exist, BITMAIN_MAX_CHAIN_NUM*32);
+	memcpy(info->chain_asic_status, rxstatusdata.chain_asic_status, BITMAIN_MAX_CHAIN_NUM*32);
+	for (n = 0; n < rxstatusdata.chain_num; n++) {
+		info->chain_asic_num[n] = rxstatusdata.chain_asic_num[n];
+		ratelog(LOG_DEBUG, "%s%d: %s() RxStatis Data chain(%d) asic_num=%d "
+				  "asic_exist=%08x%08x%08x%08x%08x%08x%08x%08x "
+				  "asic_status=%08x%08x%08x%08x%08x%08x%08x%08x",
+				  bitmain->drv->name, bitmain->device_id,
+				  __func__, n, info->chain_asic_num[n],
+				  info->chain_asic_exist[n*8+0],
+				  info->chain_asic_exist[n*8+1],
+				  info->chain_asic_exist[n*8+2],
+				  info->chain_asic_exist[n*8+3],
+				  info->chain_asic_exist[n*8+4],
+				  info->chain_asic_exist[n*8+5],
+				  info->chain_asic_exist[n*8+6],
+				  info->chain_asic_exist[n*8+7],
+				  info->chain_asic_status[n*8+0],
+				  info->chain_asic_status[n*8+1],
+				  info->chain_asic_status[n*8+2],
+				  info->chain_asic_status[n*8+3],
+				  info->chain_asic_status[n*8+4],
+				  info->chain_asic_status[n*8+5],
+				  info->chain_asic_status[n*8+6],
+				  info->chain_asic_status[n*8+7]);
+		// Only report a chain's asic status when it changes
+		if (changed[n]) {
+			applogsiz(LOG_ERR, BITMAIN_STATUS_APPLOGSIZ,
+					"%s%d: %s() RxStatis Data chain(%d) asic_num=%d"
+					" asic_status=%s",
+					bitmain->drv->name, bitmain->device_id,
+					__func__, n, info->chain_asic_num[n],
+					bitmain_chain_status(info, n, status, sizeof(status)));
+		}
+	}
+#endif
+	mutex_unlock(&info->qlock);
+
+	if (errordiff > 0) {
+		for (j = 0; j < errordiff; j++)
+			bitmain_inc_nvw(info, thr);
+		mutex_lock(&info->qlock);
+		info->last_nonce_error += errordiff;
+		mutex_unlock(&info->qlock);
+	}
+	bitmain_update_temps(bitmain, info, &rxstatusdata);
+}
+
+static void bitmain_rx_nonce(struct cgpu_info *bitmain, struct bitmain_info *info,
+			     struct thr_info *thr, const uint8_t *frame, int len)
+{
+	struct bitmain_rxnonce_data rxnoncedata;
 	struct work *work = NULL;
-	//char *ob_hex = NULL;
+	int j, nonce_num = 0;
 	uint64_t searches;
 	K_ITEM *witem;
 
-	for (i = 0; i <= spare; i++) {
-		if (buf[i] == 0xa1) {
-			struct bitmain_rxstatus_data rxstatusdata;
-			applog(LOG_DEBUG, "%s%d: %s() RxStatus Data",
-					  bitmain->drv->name, bitmain->device_id,
-					  __func__);
-			if (*offset < 2) {
-				return;
-			}
-			if (buf[i+1] > 124) {
-				applog(LOG_ERR, "%s%d: %s() RxStatus Data datalen=%d error",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, buf[i+1]+2);
-				continue;
-			}
-			if (*offset < buf[i+1] + 2) {
-				return;
-			}
-			if (bitmain_parse_rxstatus(buf+i, buf[i+1]+2, &rxstatusdata) != 0) {
-				applog(LOG_ERR, "%s%d: %s() RxStatus Data error len=%d",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, buf[i+1]+2);
-			} else {
-				mutex_lock(&info->qlock);
-				info->chain_num = rxstatusdata.chain_num;
-				info->fifo_space = rxstatusdata.fifo_space;
-				info->nonce_error = rxstatusdata.nonce_error;
-				errordiff = info->nonce_error-info->last_nonce_error;
-				applog(LOG_DEBUG, "%s%d: %s() RxStatus Data"
-						" version=%d chainnum=%d fifospace=%d"
-						" nonceerror=%d-%d freq=%d chain info:",
-						bitmain->drv->name, bitmain->device_id, __func__,
-						rxstatusdata.version, info->chain_num,
-						info->fifo_space, info->last_nonce_error,
-						info->nonce_error, info->frequency);
-				for (n = 0; n < rxstatusdata.chain_num; n++) {
-					info->chain_asic_num[n] = rxstatusdata.chain_asic_num[n];
-					info->chain_asic_status[n] = rxstatusdata.chain_asic_status[n];
-					memset(info->chain_asic_status_t[n], 0, 40);
-					j = 0;
-					for (m = 0; m < 32; m++) {
-						if (m%8 == 0 && m != 0) {
-							info->chain_asic_status_t[n][j] = ' ';
-							j++;
-						}
-						checkbit = num2bit(m);
-						if (rxstatusdata.chain_asic_status[n] & checkbit)
-							info->chain_asic_status_t[n][j] = 'o';
-						else
-							info->chain_asic_status_t[n][j] = 'x';
+	ratelog(LOG_DEBUG, "%s%d: %s() RxNonce Data",
+			  bitmain->drv->name, bitmain->device_id,
+			  __func__);
 
-						j++;
-					}
-					applog(LOG_DEBUG, "%s%d: %s() RxStatus Data chain(%d)"
-							" asic_num=%d asic_status=%08x-%s",
-							bitmain->drv->name, bitmain->device_id,
-							__func__,
-							n, info->chain_asic_num[n],
-							info->chain_asic_status[n],
-							info->chain_asic_status_t[n]);
-				}
-				mutex_unlock(&info->qlock);
+	if (bitmain_parse_rxnonce(frame, len, &rxnoncedata, &nonce_num) != 0) {
+		applog(LOG_ERR, "%s%d: %s() RxNonce Data error len=%d",
+				bitmain->drv->name, bitmain->device_id,
+				__func__, len);
+		return;
+	}
 
-				if (errordiff > 0) {
-					for (j = 0; j < errordiff; j++) {
-						bitmain_inc_nvw(info, thr);
-					}
-					mutex_lock(&info->qlock);
-					info->last_nonce_error += errordiff;
-					mutex_unlock(&info->qlock);
-				}
-				bitmain_update_temps(bitmain, info, &rxstatusdata);
+	for (j = 0; j < nonce_num; j++) {
+		searches = 0;
+		mutex_lock(&info->qlock);
+		witem = info->work_list->head;
+#ifdef USE_ANT_S1
+		while (witem) {
+			searches++;
+			if (DATAW(witem)->work->id == rxnoncedata.nonces[j].work_id)
+				break;
+			witem = witem->next;
+		}
+		if (witem)
+			work = DATAW(witem)->work;
+#else // S2
+		while (witem && DATAW(witem)->work) {
+			searches++;
+			if (DATAW(witem)->wid == rxnoncedata.nonces[j].work_id)
+				break;
+			witem = witem->next;
+		}
+		if (witem && !DATAW(witem)->work)
+			witem = NULL;
+		if (witem)
+			work = DATAW(witem)->work;
+#endif
+		mutex_unlock(&info->qlock);
+		if (witem) {
+			if (info->work_search == 0) {
+				info->min_search = searches;
+				info->max_search = searches;
+			} else {
+				if (info->min_search > searches)
+					info->min_search = searches;
+				if (info->max_search < searches)
+					info->max_search = searches;
 			}
+			info->work_search++;
+			info->tot_search += searches;
 
-			found = true;
-			spare = buf[i+1] + 2 + i;
-			if (spare > *offset) {
-				applog(LOG_ERR, "%s%d: %s() spare(%d) > offset(%d)",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, spare, *offset);
-				spare = *offset;
-			}
-			break;
-		} else if (buf[i] == 0xa2) {
-			struct bitmain_rxnonce_data rxnoncedata;
-			int nonce_num = 0;
-			applog(LOG_DEBUG, "%s%d: %s() RxNonce Data",
+			ratelog(LOG_DEBUG, "%s%d: %s() RxNonce Data find "
+					  "work(%"PRIu32"-%"PRIu32")(%08x)",
 					  bitmain->drv->name, bitmain->device_id,
-					  __func__);
-			if (*offset < 2) {
-				return;
-			}
-			if (buf[i+1] > 70) {
-				applog(LOG_ERR, "%s%d: %s() RxNonce Data datalen=%d error",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, buf[i+1]+2);
-				continue;
-			}
-			if (*offset < buf[i+1] + 2) {
-				return;
+					  __func__, work->id,
+					  rxnoncedata.nonces[j].work_id,
+					  rxnoncedata.nonces[j].nonce);
+
+			ratelog(LOG_DEBUG, "%s%d: %s() nonce = %08x",
+					  bitmain->drv->name, bitmain->device_id,
+					  __func__, rxnoncedata.nonces[j].nonce);
+			if (isdupnonce(bitmain, work, rxnoncedata.nonces[j].nonce)) {
+				// ignore it
+			} else {
+				verify_nonce(thr, work, rxnoncedata.nonces[j].nonce,
+					     bitmain_verified);
 			}
-			if (bitmain_parse_rxnonce(buf+i, buf[i+1]+2, &rxnoncedata, &nonce_num) != 0) {
-				applog(LOG_ERR, "%s%d: %s() RxNonce Data error len=%d",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, buf[i+1]+2);
+		} else {
+			if (info->failed_search == 0) {
+				info->min_failed = searches;
+				info->max_failed = searches;
 			} else {
-				for (j = 0; j < nonce_num; j++) {
-					searches = 0;
-					mutex_lock(&info->qlock);
-					witem = info->work_list->head;
-					while (witem) {
-						searches++;
-						if (DATAW(witem)->work->id == rxnoncedata.nonces[j].work_id)
-							break;
-						witem = witem->next;
-					}
-					mutex_unlock(&info->qlock);
-					if (witem) {
-						if (info->work_search == 0) {
-							info->min_search = searches;
-							info->max_search = searches;
-						} else {
-							if (info->min_search > searches)
-								info->min_search = searches;
-							if (info->max_search < searches)
-								info->max_search = searches;
-						}
-						info->work_search++;
-						info->tot_search += searches;
-
-						work = DATAW(witem)->work;
-						applog(LOG_DEBUG, "%s%d: %s() RxNonce Data find "
-								  "work(%"PRIu32"-%"PRIu32")(%08x)",
-								  bitmain->drv->name, bitmain->device_id,
-								  __func__, work->id,
-								  rxnoncedata.nonces[j].work_id,
-								  rxnoncedata.nonces[j].nonce);
-
-						applog(LOG_DEBUG, "%s%d: %s() nonce = %08x",
-								  bitmain->drv->name, bitmain->device_id,
-								  __func__, rxnoncedata.nonces[j].nonce);
-						if (isdupnonce(bitmain, work, rxnoncedata.nonces[j].nonce)) {
-							// ignore it
-						} else {
-							if (submit_nonce(thr, work, rxnoncedata.nonces[j].nonce)) {
-								applog(LOG_DEBUG, "%s%d: %s() RxNonce Data ok",
-										  bitmain->drv->name,
-										  bitmain->device_id,
-										  __func__);
-								mutex_lock(&info->qlock);
-								info->nonces++;
-								mutex_unlock(&info->qlock);
-							} else {
-								applog(LOG_ERR, "%s%d: %s() RxNonce Data "
-										"error work(%"PRIu32")",
-										bitmain->drv->name,
-										bitmain->device_id,
-										__func__,
-										rxnoncedata.nonces[j].work_id);
-							}
-						}
-					} else {
-						if (info->failed_search == 0) {
-							info->min_failed = searches;
-							info->max_failed = searches;
-						} else {
-							if (info->min_failed > searches)
-								info->min_failed = searches;
-							if (info->max_failed < searches)
-								info->max_failed = searches;
-						}
-						info->failed_search++;
-						info->tot_failed += searches;
-
-						mutex_lock(&info->qlock);
-						uint32_t min = 0, max = 0;
-						int count = 0;
-						if (info->work_list->tail) {
-							min = DATAW(info->work_list->tail)->wid;
-							max = DATAW(info->work_list->head)->wid;
-							count = info->work_list->count;
-						}
-						mutex_unlock(&info->qlock);
-						applog(LOG_ERR, "%s%d: %s() Work not found for id (%"PRIu32")"
-								" (min=%"PRIu32" max=%"PRIu32" count=%d)",
-								bitmain->drv->name, bitmain->device_id,
-								__func__, rxnoncedata.nonces[j].work_id,
-								min, max, count);
-					}
-				}
-				mutex_lock(&info->qlock);
-				info->fifo_space = rxnoncedata.fifo_space;
-				mutex_unlock(&info->qlock);
-				applog(LOG_DEBUG, "%s%d: %s() RxNonce Data fifo space=%d",
-						  bitmain->drv->name, bitmain->device_id,
-						  __func__, rxnoncedata.fifo_space);
+				if (info->min_failed > searches)
+					info->min_failed = searches;
+				if (info->max_failed < searches)
+					info->max_failed = searches;
 			}
+			info->failed_search++;
+			info->tot_failed += searches;
 
-			found = true;
-			spare = buf[i+1] + 2 + i;
-			if (spare > *offset) {
-				applog(LOG_ERR, "%s%d: %s() RxNonce Data space(%d) > offset(%d)",
-						bitmain->drv->name, bitmain->device_id, __func__, 
-						spare, *offset);
-				spare = *offset;
+#ifdef USE_ANT_S1
+			mutex_lock(&info->qlock);
+			uint32_t min = 0, max = 0;
+			int count = 0;
+			if (info->work_list->tail) {
+				min = DATAW(info->work_list->tail)->wid;
+				max = DATAW(info->work_list->head)->wid;
+				count = info->work_list->count;
 			}
-			break;
-		} else {
-			applog(LOG_ERR, "%s%d: %s() data type error=%02x",
+			mutex_unlock(&info->qlock);
+			ratelog(LOG_ERR, "%s%d: %s() Work not found for id (%"PRIu32")"
+					" (min=%"PRIu32" max=%"PRIu32" count=%d)",
+					bitmain->drv->name, bitmain->device_id,
+					__func__, rxnoncedata.nonces[j].work_id,
+					min, max, count);
+#else
+			ratelog(LOG_ERR, "%s%d: %s() Work not found for id (%"PRIu32")",
 					bitmain->drv->name, bitmain->device_id,
-					__func__, buf[i]);
+					__func__, rxnoncedata.nonces[j].work_id);
+#endif
 		}
 	}
-	if (!found) {
-		spare = *offset - BITMAIN_READ_SIZE;
-		/* We are buffering and haven't accumulated one more corrupt
-		 * work result. */
-		if (spare < (int)BITMAIN_READ_SIZE)
-			return;
-		bitmain_inc_nvw(info, thr);
+	mutex_lock(&info->qlock);
+	info->fifo_space = rxnoncedata.fifo_space;
+	mutex_unlock(&info->qlock);
+	ratelog(LOG_DEBUG, "%s%d: %s() RxNonce Data fifo space=%d",
+			  bitmain->drv->name, bitmain->device_id,
+			  __func__, rxnoncedata.fifo_space);
+
+#ifdef USE_ANT_S2
+	if (nonce_num < BITMAIN_MAX_NONCE_NUM)
+		cgsleep_ms(5);
+#endif
+}
+
+/* Return the length of the frame at buf, 0 if buf isn't the start of a
+ * valid frame header, or -1 if more data is needed to get the whole frame */
+static int bitmain_frame_len(const uint8_t *buf, int avail)
+{
+	int len, max;
+
+	switch (buf[0]) {
+		case BITMAIN_DATA_TYPE_RXSTATUS:
+#ifdef USE_ANT_S1
+			max = 124;
+#else
+			max = 1130;
+#endif
+			break;
+		case BITMAIN_DATA_TYPE_RXNONCE:
+#ifdef USE_ANT_S1
+			max = 70;
+#else
+			max = 1030;
+#endif
+			break;
+		default:
+			return 0;
 	}
 
-	*offset -= spare;
-	memmove(buf, buf + spare, *offset);
+#ifdef USE_ANT_S1
+	if (avail < 2)
+		return -1;
+	len = buf[1];
+	if (len > max)
+		return 0;
+	len += 2;
 #else // S2
-	int i, j, n, m, r, errordiff, spare = BITMAIN_READ_SIZE;
-	uint32_t checkbit = 0x00000000;
-	bool found = false;
-	struct work *work = NULL;
-	struct bitmain_packet_head packethead;
-	int asicnum = 0;
-	uint64_t searches;
-	K_ITEM *witem;
+	if (avail < (int)sizeof(struct bitmain_packet_head))
+		return -1;
+	len = buf[2] | (buf[3] << 8);
+	if (len > max)
+		return 0;
+	len += sizeof(struct bitmain_packet_head);
+#endif
+	if (avail < len)
+		return -1;
 
-	for (i = 0; i <= spare; i++) {
-		if (buf[i] == 0xa1) {
-			struct bitmain_rxstatus_data rxstatusdata;
-			applog(LOG_DEBUG, "%s%d: %s() RxStatus Data",
-					  bitmain->drv->name, bitmain->device_id,
-					  __func__);
-			if (*offset < 4) {
-				return;
-			}
-			memcpy(&packethead, buf+i, sizeof(struct bitmain_packet_head));
-			packethead.length = htole16(packethead.length);
-			if (packethead.length > 1130) {
-				applog(LOG_ERR, "%s%d: %s() RxStatus Data datalen=%d error",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, packethead.length+4);
-				continue;
-			}
-			if (*offset < packethead.length + 4)
-				return;
-			if (bitmain_parse_rxstatus(buf+i, packethead.length+4, &rxstatusdata) != 0) {
-				applog(LOG_ERR, "%s%d: %s() RxStatus Data error len=%d",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, packethead.length+4);
-			} else {
-				mutex_lock(&info->qlock);
-				info->chain_num = rxstatusdata.chain_num;
-				info->fifo_space = rxstatusdata.fifo_space;
-				info->hw_version[0] = rxstatusdata.hw_version[0];
-				info->hw_version[1] = rxstatusdata.hw_version[1];
-				info->hw_version[2] = rxstatusdata.hw_version[2];
-				info->hw_version[3] = rxstatusdata.hw_version[3];
-				info->nonce_error = rxstatusdata.nonce_error;
-				errordiff = info->nonce_error-info->last_nonce_error;
-				applog(LOG_DEBUG, "%s%d: %s() RxStatus Data"
-						" version=%d chainnum=%d fifospace=%d"
-						" hwv1=%d hwv2=%d hwv3=%d hwv4=%d"
-						" nonceerror=%d-%d freq=%d chain info:",
-						bitmain->drv->name, bitmain->device_id, __func__,
-						rxstatusdata.version, info->chain_num, info->fifo_space,
-						info->hw_version[0], info->hw_version[1],
-						info->hw_version[2], info->hw_version[3],
-						info->last_nonce_error,
-						info->nonce_error, info->frequency);
-				memcpy(info->chain_asic_exist, rxstatusdata.chain_asic_exist, BITMAIN_MAX_CHAIN_NUM*32);
-				memcpy(info->chain_asic_status, rxstatusdata.chain_asic_status, BITMAIN_MAX_CHAIN_NUM*32);
-				for (n = 0; n < rxstatusdata.chain_num; n++) {
-					info->chain_asic_num[n] = rxstatusdata.chain_asic_num[n];
-					memset(info->chain_asic_status_t[n], 0, 320);
-					j = 0;
-					if (info->chain_asic_num[n] <= 0)
-						asicnum = 0;
-					else {
-						if (info->chain_asic_num[n] % 32 == 0)
-							asicnum = info->chain_asic_num[n] / 32;
-						else
-							asicnum = info->chain_asic_num[n] / 32 + 1;
-					}
-					if (asicnum > 0) {
-						for (m = asicnum-1; m >= 0; m--) {
-							for (r = 0; r < 32; r++) {
-								if ((r % 8) == 0 && r != 0) {
-									info->chain_asic_status_t[n][j] = ' ';
-									j++;
-								}
-								checkbit = num2bit(r);
-								if (rxstatusdata.chain_asic_exist[n*8+m] & checkbit) {
-									if (rxstatusdata.chain_asic_status[n*8+m] & checkbit)
-										info->chain_asic_status_t[n][j] = 'o';
-									else
-										info->chain_asic_status_t[n][j] = 'x';
-								} else
-									info->chain_asic_status_t[n][j] = '-';
-								j++;
-							}
-							info->chain_asic_status_t[n][j] = ' ';
-							j++;
-						}
-					}
-					applog(LOG_DEBUG, "%s%d: %s() RxStatis Data chain(%d) asic_num=%d "
-							  "asic_exist=%08x%08x%08x%08x%08x%08x%08x%08x "
-							  "asic_status=%08x%08x%08x%08x%08x%08x%08x%08x",
-							  bitmain->drv->name, bitmain->device_id,
-							  __func__, n, info->chain_asic_num[n],
-							  info->chain_asic_exist[n*8+0],
-							  info->chain_asic_exist[n*8+1],
-							  info->chain_asic_exist[n*8+2],
-							  info->chain_asic_exist[n*8+3],
-							  info->chain_asic_exist[n*8+4],
-							  info->chain_asic_exist[n*8+5],
-							  info->chain_asic_exist[n*8+6],
-							  info->chain_asic_exist[n*8+7],
-							  info->chain_asic_status[n*8+0],
-							  info->chain_asic_status[n*8+1],
-							  info->chain_asic_status[n*8+2],
-							  info->chain_asic_status[n*8+3],
-							  info->chain_asic_status[n*8+4],
-							  info->chain_asic_status[n*8+5],
-							  info->chain_asic_status[n*8+6],
-							  info->chain_asic_status[n*8+7]);
-					applog(LOG_ERR, "%s%d: %s() RxStatis Data chain(%d) asic_num=%d"
-							" asic_status=%s",
-							bitmain->drv->name, bitmain->device_id,
-							__func__, n, info->chain_asic_num[n],
-							info->chain_asic_status_t[n]);
-				}
-				mutex_unlock(&info->qlock);
-
-				if (errordiff > 0) {
-					for (j = 0; j < errordiff; j++)
-						bitmain_inc_nvw(info, thr);
-					mutex_lock(&info->qlock);
-					info->last_nonce_error += errordiff;
-					mutex_unlock(&info->qlock);
-				}
-				bitmain_update_temps(bitmain, info, &rxstatusdata);
-			}
+	return len;
+}
 
-			found = true;
-			spare = packethead.length + 4 + i;
-			if (spare > *offset) {
-				applog(LOG_ERR, "%s%d: %s() spare(%d) > offset(%d)",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, spare, *offset);
-				spare = *offset;
-			}
+/* Decode every complete frame in buf in place, skipping any bytes that
+ * aren't the start of a frame, then move any partial frame left over to the
+ * start of buf. The CRC is checked on the frame in buf before decoding */
+static void bitmain_parse_results(struct cgpu_info *bitmain, struct bitmain_info *info,
+				  struct thr_info *thr, uint8_t *buf, int *offset)
+{
+	int pos = 0, skip = 0, len;
+
+	while (pos < *offset) {
+		len = bitmain_frame_len(buf + pos, *offset - pos);
+		if (len < 0)
 			break;
-		} else if (buf[i] == 0xa2) {
-			struct bitmain_rxnonce_data rxnoncedata;
-			int nonce_num = 0;
-			applog(LOG_DEBUG, "%s%d: %s() RxNonce Data",
-					  bitmain->drv->name, bitmain->device_id,
-					  __func__);
-			if (*offset < 4)
-				return;
-			memcpy(&packethead, buf+i, sizeof(struct bitmain_packet_head));
-			packethead.length = htole16(packethead.length);
-			if (packethead.length > 1030) {
-				applog(LOG_ERR, "%s%d: %s() RxNonce Data datalen=%d error",
+		if (len == 0) {
+			if (skip == 0) {
+				applog(LOG_ERR, "%s%d: %s() data type error=%02x",
 						bitmain->drv->name, bitmain->device_id,
-						__func__, packethead.length+4);
-				continue;
+						__func__, buf[pos]);
 			}
-			if (*offset < packethead.length + 4)
-				return;
-			if (bitmain_parse_rxnonce(buf+i, packethead.length+4, &rxnoncedata, &nonce_num) != 0) {
-				applog(LOG_ERR, "%s%d: %s() RxNonce Data error len=%d",
-						bitmain->drv->name, bitmain->device_id,
-						__func__, packethead.length+4);
-			} else {
-				for (j = 0; j < nonce_num; j++) {
-					searches = 0;
-					mutex_lock(&info->qlock);
-					witem = info->work_list->head;
-					while (witem && DATAW(witem)->work) {
-						searches++;
-						if (DATAW(witem)->wid == rxnoncedata.nonces[j].work_id)
-							break;
-						witem = witem->next;
-					}
-					if (witem && DATAW(witem)->work) {
-						work = DATAW(witem)->work;
-						mutex_unlock(&info->qlock);
-						if (info->work_search == 0) {
-							info->min_search = searches;
-							info->max_search = searches;
-						} else {
-							if (info->min_search > searches)
-								info->min_search = searches;
-							if (info->max_search < searches)
-								info->max_search = searches;
-						}
-						info->work_search++;
-						info->tot_search += searches;
-
-						applog(LOG_DEBUG, "%s%d: %s() RxNonce Data find "
-								  "work(%"PRIu32"-%"PRIu32")(%08x)",
-								  bitmain->drv->name, bitmain->device_id,
-								  __func__, work->id,
-								  rxnoncedata.nonces[j].work_id,
-								  rxnoncedata.nonces[j].nonce);
-
-						applog(LOG_DEBUG, "%s%d: %s() nonce = %08x",
-								  bitmain->drv->name, bitmain->device_id,
-								  __func__, rxnoncedata.nonces[j].nonce);
-						if (isdupnonce(bitmain, work, rxnoncedata.nonces[j].nonce)) {
-							// ignore it
-						} else {
-							if (submit_nonce(thr, work, rxnoncedata.nonces[j].nonce)) {
-								applog(LOG_DEBUG, "%s%d: %s() RxNonce Data ok",
-										  bitmain->drv->name,
-										  bitmain->device_id,
-										  __func__);
-								mutex_lock(&info->qlock);
-								info->nonces += work->device_diff;
-								mutex_unlock(&info->qlock);
-							} else {
-								applog(LOG_ERR, "%s%d: %s() RxNonce Data "
-										"error work(%"PRIu32")",
-										bitmain->drv->name,
-										bitmain->device_id,
-										__func__,
-										rxnoncedata.nonces[j].work_id);
-							}
-						}
-					} else {
-						mutex_unlock(&info->qlock);
-						if (info->failed_search == 0) {
-							info->min_failed = searches;
-							info->max_failed = searches;
-						} else {
-							if (info->min_failed > searches)
-								info->min_failed = searches;
-							if (info->max_failed < searches)
-								info->max_failed = searches;
-						}
-						info->failed_search++;
-						info->tot_failed += searches;
+			skip++;
+			pos++;
+			continue;
+		}
 
-						applog(LOG_ERR, "%s%d: %s() Work not found for id (%"PRIu32")",
-								bitmain->drv->name, bitmain->device_id,
-								__func__, rxnoncedata.nonces[j].work_id);
-					}
-				}
-				mutex_lock(&info->qlock);
-				info->fifo_space = rxnoncedata.fifo_space;
-				mutex_unlock(&info->qlock);
-				applog(LOG_DEBUG, "%s%d: %s() RxNonce Data fifo space=%d",
-						  bitmain->drv->name, bitmain->device_id,
-						  __func__, rxnoncedata.fifo_space);
+		if (buf[pos] == BITMAIN_DATA_TYPE_RXSTATUS)
+			bitmain_rx_status(bitmain, info, thr, buf + pos, len);
+		else
+			bitmain_rx_nonce(bitmain, info, thr, buf + pos, len);
 
-				if (nonce_num < BITMAIN_MAX_NONCE_NUM)
-					cgsleep_ms(5);
-			}
+		info->rx_frames++;
+		pos += len;
+	}
 
-			found = true;
-			spare = packethead.length + 4 + i;
-			if (spare > *offset) {
-				applog(LOG_ERR, "%s%d: %s() RxNonce Data space(%d) > offset(%d)",
-						bitmain->drv->name, bitmain->device_id, __func__,
-						spare, *offset);
-				spare = *offset;
-			}
-			break;
-		} else {
-			applog(LOG_ERR, "%s%d: %s() data type error=%02x",
-					bitmain->drv->name, bitmain->device_id,
-					__func__, buf[i]);
+	if (skip) {
+		info->rx_skipped += skip;
+		/* Count one corrupt work result for every BITMAIN_READ_SIZE
+		 * bytes that weren't part of a frame */
+		info->rx_skip_part += skip;
+		while (info->rx_skip_part >= (int)BITMAIN_READ_SIZE) {
+			bitmain_inc_nvw(info, thr);
+			info->rx_skip_part -= BITMAIN_READ_SIZE;
 		}
 	}
-	if (!found) {
-		spare = *offset - BITMAIN_READ_SIZE;
-		/* We are buffering and haven't accumulated one more corrupt
-		 * work result. */
-		if (spare < (int)BITMAIN_READ_SIZE)
-			return;
-		bitmain_inc_nvw(info, thr);
-	}
 
-	*offset -= spare;
-	memmove(buf, buf + spare, *offset);
-#endif
+	if (pos > 0) {
+		*offset -= pos;
+		if (*offset > 0)
+			memmove(buf, buf + pos, *offset);
+	}
 }
 
 static void bitmain_running_reset(struct bitmain_info *info)
@@ -1761,17 +1620,15 @@ static int bitmain_initialize(struct cgpu_info *bitmain)
 	int trycount = 3;
 	struct timespec p;
 	struct bitmain_rxstatus_data rxstatusdata;
-	int i = 0, j = 0, m = 0, statusok = 0;
-	uint32_t checkbit = 0x00000000;
+	char status[BITMAIN_CHAIN_STATUS_SIZ];
+	int i = 0, statusok = 0;
 #ifdef USE_ANT_S1
 	int eft = 0;
 #else
-	int r = 0;
 	int hwerror_eft = 0;
 	int beeper_ctrl = 1;
 	int tempover_ctrl = 1;
 	struct bitmain_packet_head packethead;
-	int asicnum = 0;
 
 	int mathtest = (int)floor(log2(42));
 	if (mathtest != 5) {
@@ -1863,27 +1720,12 @@ static int bitmain_initialize(struct cgpu_info *bitmain)
 						for (i = 0; i < rxstatusdata.chain_num; i++) {
 							info->chain_asic_num[i] = rxstatusdata.chain_asic_num[i];
 							info->chain_asic_status[i] = rxstatusdata.chain_asic_status[i];
-							memset(info->chain_asic_status_t[i], 0, 40);
-							j = 0;
-							for (m = 0; m < 32; m++) {
-								if (m%8 == 0 && m != 0) {
-									info->chain_asic_status_t[i][j] = ' ';
-									j++;
-								}
-								checkbit = num2bit(m);
-								if (rxstatusdata.chain_asic_status[i] & checkbit)
-									info->chain_asic_status_t[i][j] = 'o';
-								else
-									info->chain_asic_status_t[i][j] = 'x';
-
-								j++;
-							}
 							applog(LOG_ERR, "%s%d: %s() parse_rxstatus chain(%d) "
 									"asic_num=%d asic_status=%08x-%s",
 									bitmain->drv->name, bitmain->device_id,
 									__func__, i, info->chain_asic_num[i],
 									info->chain_asic_status[i],
-									info->chain_asic_status_t[i]);
+									bitmain_chain_status(info, i, status, sizeof(status)));
 						}
 #else // S2
 						memcpy(&packethead, data+i, sizeof(struct bitmain_packet_head));
@@ -1935,37 +1777,6 @@ static int bitmain_initialize(struct cgpu_info *bitmain)
 							BITMAIN_MAX_CHAIN_NUM*32);
 						for (i = 0; i < rxstatusdata.chain_num; i++) {
 							info->chain_asic_num[i] = rxstatusdata.chain_asic_num[i];
-							memset(info->chain_asic_status_t[i], 0, 320);
-							j = 0;
-							if (info->chain_asic_num[i] <= 0)
-								asicnum = 0;
-							else {
-								if (info->chain_asic_num[i] % 32 == 0)
-									asicnum = info->chain_asic_num[i] / 32;
-								else
-									asicnum = info->chain_asic_num[i] / 32 + 1;
-							}
-							if (asicnum > 0) {
-								for (m = asicnum-1; m >= 0; m--) {
-									for (r = 0; r < 32; r++) {
-										if (r%8 == 0 && r != 0) {
-											info->chain_asic_status_t[i][j] = ' ';
-											j++;
-										}
-										checkbit = num2bit(r);
-										if (rxstatusdata.chain_asic_exist[i*8+m] & checkbit) {
-											if (rxstatusdata.chain_asic_status[i*8+m] & checkbit)
-												info->chain_asic_status_t[i][j] = 'o';
-											else
-												info->chain_asic_status_t[i][j] = 'x';
-										} else
-											info->chain_asic_status_t[i][j] = '-';
-										j++;
-									}
-									info->chain_asic_status_t[i][j] = ' ';
-									j++;
-								}
-							}
 							applog(LOG_DEBUG, "%s%d: %s() chain(%d) asic_num=%d "
 									  "asic_exist=%08x%08x%08x%08x%08x%08x%08x%08x "
 									  "asic_status=%08x%08x%08x%08x%08x%08x%08x%08x",
@@ -1987,11 +1798,12 @@ static int bitmain_initialize(struct cgpu_info *bitmain)
 									  info->chain_asic_status[i*8+5],
 									  info->chain_asic_status[i*8+6],
 									  info->chain_asic_status[i*8+7]);
-							applog(LOG_ERR, "%s%d: %s() chain(%d) "
+							applogsiz(LOG_ERR, BITMAIN_STATUS_APPLOGSIZ,
+									"%s%d: %s() chain(%d) "
 									"asic_num=%d asic_status=%s",
 									bitmain->drv->name, bitmain->device_id,
 									__func__, i, info->chain_asic_num[i],
-									info->chain_asic_status_t[i]);
+									bitmain_chain_status(info, i, status, sizeof(status)));
 						}
 #endif
 						bitmain_update_temps(bitmain, info, &rxstatusdata);
@@ -2615,7 +2427,9 @@ static struct api_data *bitmain_api_stats(struct cgpu_info *cgpu)
 {
 	struct api_data *root = NULL;
 	struct bitmain_info *info = cgpu->device_data;
-	//int i = 0;
+	char chain_acs[BITMAIN_MAX_CHAIN_NUM][BITMAIN_CHAIN_STATUS_SIZ];
+	char buf[32];
+	int i;
 	double hwp = (cgpu->hw_errors + cgpu->diff1) ?
 			(double)(cgpu->hw_errors) / (double)(cgpu->hw_errors + cgpu->diff1) : 0;
 
@@ -2702,28 +2516,20 @@ static struct api_data *bitmain_api_stats(struct cgpu_info *cgpu)
 	root = api_add_int(root, "chain_acn16", &(info->chain_asic_num[15]), false);
 #endif
 
-	root = api_add_string(root, "chain_acs1", info->chain_asic_status_t[0], false);
-	root = api_add_string(root, "chain_acs2", info->chain_asic_status_t[1], false);
-	root = api_add_string(root, "chain_acs3", info->chain_asic_status_t[2], false);
-	root = api_add_string(root, "chain_acs4", info->chain_asic_status_t[3], false);
-#ifdef USE_ANT_S2
-	root = api_add_string(root, "chain_acs5", info->chain_asic_status_t[4], false);
-	root = api_add_string(root, "chain_acs6", info->chain_asic_status_t[5], false);
-	root = api_add_string(root, "chain_acs7", info->chain_asic_status_t[6], false);
-	root = api_add_string(root, "chain_acs8", info->chain_asic_status_t[7], false);
-	root = api_add_string(root, "chain_acs9", info->chain_asic_status_t[8], false);
-	root = api_add_string(root, "chain_acs10", info->chain_asic_status_t[9], false);
-	root = api_add_string(root, "chain_acs11", info->chain_asic_status_t[10], false);
-	root = api_add_string(root, "chain_acs12", info->chain_asic_status_t[11], false);
-	root = api_add_string(root, "chain_acs13", info->chain_asic_status_t[12], false);
-	root = api_add_string(root, "chain_acs14", info->chain_asic_status_t[13], false);
-	root = api_add_string(root, "chain_acs15", info->chain_asic_status_t[14], false);
-	root = api_add_string(root, "chain_acs16", info->chain_asic_status_t[15], false);
-#endif
+	mutex_lock(&info->qlock);
+	for (i = 0; i < BITMAIN_MAX_CHAIN_NUM; i++)
+		bitmain_chain_status(info, i, chain_acs[i], sizeof(chain_acs[i]));
+	mutex_unlock(&info->qlock);
+	for (i = 0; i < BITMAIN_MAX_CHAIN_NUM; i++) {
+		snprintf(buf, sizeof(buf), "chain_acs%d", i+1);
+		root = api_add_string(root, buf, chain_acs[i], true);
+	}
 
 	root = api_add_int(root, "work_list_total", &(info->work_list->total), true);
 	root = api_add_int(root, "work_list_count", &(info->work_list->count), true);
 	root = api_add_int(root, "work_ready_count", &(info->work_ready->count), true);
+	root = api_add_uint64(root, "rx_frames", &(info->rx_frames), true);
+	root = api_add_uint64(root, "rx_skipped", &(info->rx_skipped), true);
 	root = api_add_uint64(root, "work_search", &(info->work_search), true);
 	root = api_add_uint64(root, "min_search", &(info->min_search), true);
 	root = api_add_uint64(root, "max_search", &(info->max_search), true);
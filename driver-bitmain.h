@@ -277,7 +277,6 @@ struct bitmain_info {
 	int asic_num;
 	int chain_asic_num[BITMAIN_MAX_CHAIN_NUM];
 	uint32_t chain_asic_status[BITMAIN_MAX_CHAIN_NUM];
-	char chain_asic_status_t[BITMAIN_MAX_CHAIN_NUM][40];
 #else // S2
 	int device_fd;
 	int baud;
@@ -286,7 +285,6 @@ struct bitmain_info {
 	int chain_asic_num[BITMAIN_MAX_CHAIN_NUM];
 	uint32_t chain_asic_exist[BITMAIN_MAX_CHAIN_NUM*8];
 	uint32_t chain_asic_status[BITMAIN_MAX_CHAIN_NUM*8];
-	char chain_asic_status_t[BITMAIN_MAX_CHAIN_NUM][320];
 #endif
 	int timeout;
 	int errorcount;
@@ -357,6 +355,10 @@ struct bitmain_info {
 	K_STORE *wbuild;
 #endif
 	uint32_t last_wid;
+	// Frames decoded, and bytes skipped that weren't part of a frame
+	uint64_t rx_frames;
+	uint64_t rx_skipped;
+	int rx_skip_part;
 	uint64_t work_search;
 	uint64_t tot_search;
 	uint64_t min_search;
@@ -15,6 +15,7 @@
 
 #include "miner.h"
 #include "usbutils.h"
+#include "crc.h"
 
 #include "driver-hashfast.h"
 
@@ -33,15 +34,6 @@ bool opt_hfa_noshed;
 char *opt_hfa_name;
 char *opt_hfa_options;
 
-////////////////////////////////////////////////////////////////////////////////
-// Support for the CRC's used in header (CRC-8) and packet body (CRC-32)
-////////////////////////////////////////////////////////////////////////////////
-
-#define GP8  0x107   /* x^8 + x^2 + x + 1 */
-#define DI8  0x07
-
-static bool hfa_crc8_set;
-
 char *set_hfa_fan(char *arg)
 {
 	int val1, val2, ret;
@@ -65,32 +57,10 @@ char *set_hfa_fan(char *arg)
 	return NULL;
 }
 
-static unsigned char crc8_table[256];	/* CRC-8 table */
-
-static void hfa_init_crc8(void)
-{
-	int i,j;
-	unsigned char crc;
-
-	hfa_crc8_set = true;
-	for (i = 0; i < 256; i++) {
-		crc = i;
-		for (j = 0; j < 8; j++)
-			crc = (crc << 1) ^ ((crc & 0x80) ? DI8 : 0);
-		crc8_table[i] = crc & 0xFF;
-	}
-}
-
 static unsigned char hfa_crc8(unsigned char *h)
 {
-	int i;
-	unsigned char crc;
-
-	h++;	// Preamble not included
-	for (i = 1, crc = 0xff; i < 7; i++)
-		crc = crc8_table[crc ^ *h++];
-
-	return crc;
+	// Preamble not included
+	return crc8(0xff, h + 1, 6);
 }
 
 struct hfa_cmd {
@@ -181,12 +151,12 @@ retry:
 	return true;
 }
 
-static bool hfa_send_frame(struct cgpu_info *hashfast, uint8_t opcode, uint16_t hdata,
+/* Assemble a frame for the global work queue in packet and return its
+ * length. */
+static int hfa_build_frame(uint8_t *packet, uint8_t opcode, uint16_t hdata,
 			   uint8_t *data, int len)
 {
-	uint8_t packet[256];
 	struct hf_header *p = (struct hf_header *)packet;
-	int tx_length;
 
 	p->preamble = HF_PREAMBLE;
 	p->operation_code = hfa_cmds[opcode].cmd;
@@ -198,7 +168,17 @@ static bool hfa_send_frame(struct cgpu_info *hashfast, uint8_t opcode, uint16_t
 
 	if (len)
 		memcpy(&packet[sizeof(struct hf_header)], data, len);
-	tx_length = sizeof(struct hf_header) + len;
+
+	return sizeof(struct hf_header) + len;
+}
+
+static bool hfa_send_frame(struct cgpu_info *hashfast, uint8_t opcode, uint16_t hdata,
+			   uint8_t *data, int len)
+{
+	uint8_t packet[256];
+	int tx_length;
+
+	tx_length = hfa_build_frame(packet, opcode, hdata, data, len);
 
 	return (__hfa_send_frame(hashfast, opcode, tx_length, packet));
 }
@@ -876,9 +856,6 @@ static struct cgpu_info *hfa_detect_one(libusb_device *dev, struct usb_find_devi
 
 static void hfa_detect(bool __maybe_unused hotplug)
 {
-	/* Set up the CRC tables only once. */
-	if (!hfa_crc8_set)
-		hfa_init_crc8();
 	usb_detect(&hashfast_drv, hfa_detect_one);
 }
 
@@ -1635,12 +1612,33 @@ static void hfa_running_shutdown(struct cgpu_info *hashfast, struct hashfast_inf
 	usb_nodev(hashfast);
 }
 
+#define HFA_HASH_FRAME (sizeof(struct hf_header) + sizeof(struct hf_hash_usb))
+
+/* Send the batched OP_HASH frames in one USB write. Their works are already
+ * in info->works so any failure is cleaned up by the shutdown. */
+static bool hfa_send_hashes(struct cgpu_info *hashfast, struct hashfast_info *info,
+			    uint8_t *batch, int batched)
+{
+	if (!__hfa_send_frame(hashfast, OP_HASH, batched * HFA_HASH_FRAME, batch))
+		return false;
+
+	mutex_lock(&info->lock);
+	info->hash_writes++;
+	info->hash_frames += batched;
+	if (info->max_batch < batched)
+		info->max_batch = batched;
+	mutex_unlock(&info->lock);
+
+	return true;
+}
+
 static int64_t hfa_scanwork(struct thr_info *thr)
 {
 	struct cgpu_info *hashfast = thr->cgpu;
 	struct hashfast_info *info = hashfast->device_data;
+	uint8_t batch[HFA_HASH_BATCH * HFA_HASH_FRAME];
 	struct work *base_work = NULL;
-	int jobs, ret, cycles = 0;
+	int jobs, ret, cycles = 0, batched = 0;
 	double fail_time;
 	int64_t hashes;
 
@@ -1735,15 +1733,12 @@ restart:
 		op_hash_data.group = 0;
 		if ((sequence = info->hash_sequence_head + 1) >= info->num_sequence)
 			sequence = 0;
-		ret = hfa_send_frame(hashfast, OP_HASH, sequence, (uint8_t *)&op_hash_data, sizeof(op_hash_data));
-		if (unlikely(!ret)) {
-			free_work(work);
-			if (base_work)
-				free_work(base_work);
-			hfa_running_shutdown(hashfast, info);
-			return -1;
-		}
+		hfa_build_frame(batch + batched * HFA_HASH_FRAME, OP_HASH, sequence,
+				(uint8_t *)&op_hash_data, sizeof(op_hash_data));
+		batched++;
 
+		/* Store the work before it's sent so any nonce or status
+		 * reply for it always finds it */
 		mutex_lock(&info->lock);
 		info->hash_sequence_head = sequence;
 		info->works[info->hash_sequence_head] = work;
@@ -1752,6 +1747,17 @@ restart:
 		applog(LOG_DEBUG, "%s %s: OP_HASH sequence %d search_difficulty %d work_difficulty %g",
 		       hashfast->drv->name, hashfast->unique_id, info->hash_sequence_head,
 		       op_hash_data.search_difficulty, work->work_difficulty);
+
+		if (batched == HFA_HASH_BATCH || jobs == 0) {
+			ret = hfa_send_hashes(hashfast, info, batch, batched);
+			batched = 0;
+			if (unlikely(!ret)) {
+				if (base_work)
+					free_work(base_work);
+				hfa_running_shutdown(hashfast, info);
+				return -1;
+			}
+		}
 	}
 
 	if (base_work)
@@ -1795,6 +1801,9 @@ static struct api_data *hfa_api_stats(struct cgpu_info *cgpu)
 	varint = db->sequence_modulus;
 	root = api_add_int(root, "sequence modulus", &varint, true);
 	root = api_add_int(root, "fan percent", &info->fanspeed, false);
+	root = api_add_uint64(root, "hash writes", &info->hash_writes, false);
+	root = api_add_uint64(root, "hash frames", &info->hash_frames, false);
+	root = api_add_int(root, "max hash batch", &info->max_batch, false);
 	if (info->op_name[0] != '\0')
 		root = api_add_string(root, "op name", info->op_name, false);
 
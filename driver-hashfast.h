@@ -43,6 +43,8 @@ char *opt_hfa_options;
 #define HFA_FAN_DEFAULT 33
 #define HFA_FAN_MAX 85
 #define HFA_FAN_MIN 5
+/* Max OP_HASH frames to send in one USB write */
+#define HFA_HASH_BATCH 16
 
 // Matching fields for hf_statistics, but large #s for local accumulation, per-die
 struct hf_long_statistics {
@@ -134,6 +136,9 @@ struct hashfast_info {
 	uint16_t device_sequence_head;              // DEVICE: The most recent sequence number the device dispatched
 	uint16_t device_sequence_tail;              // DEVICE: The most recently completed job in the device
 	int64_t hash_count;
+	uint64_t hash_writes;                       // USB writes of batched OP_HASH frames
+	uint64_t hash_frames;                       // OP_HASH frames sent
+	int max_batch;                              // Most OP_HASH frames sent in one write
 	uint64_t raw_hashes;
 	uint64_t calc_hashes;
 	uint16_t shed_count;                        // Dynamic copy of #cores device has shed for thermal control
@@ -54,9 +54,8 @@ static const char *msg_reply = "Reply";
 #define MERKLE_BYTES 12
 
 #define REPLY_SIZE		15	// adequate for all types of replies
-#define MAX_KLINES		1024	// unhandled reply limit
-#define REPLY_WAIT_TIME		100 	// poll interval for a cmd waiting it's reply
-#define CMD_REPLY_RETRIES	8	// how many retries for cmds
+#define REPLY_WAIT_TIME		100 	// detect waits 10x this for the ident reply
+#define CMD_REPLY_MS		800	// how long a cmd waits for it's reply
 #define MAX_WORK_COUNT		4	// for now, must be binary multiple and match firmware
 #define TACH_FACTOR		87890	// fan rpm divisor
 
@@ -185,6 +184,8 @@ typedef struct kline {
 
 #define zero_kline(_kline) memset((void *)(_kline), 0, sizeof(KLINE));
 
+#define KLN_WORKIDS 256
+
 typedef struct device_info {
 	uint32_t noncecount;
 	uint32_t nextworkid;
@@ -192,17 +193,24 @@ typedef struct device_info {
 	uint64_t totalhashcount;
 	uint32_t rangesize;
 	uint32_t *chipstats;
+	// work->id of the work last sent with each workid
+	int workids[KLN_WORKIDS];
 } DEVINFO;
 
-typedef struct klist {
-	struct klist *prev;
-	struct klist *next;
+typedef struct kreply {
 	KLINE kline;
 	struct timeval tv_when;
-	int block_seq;
-	bool ready;
-	bool working;
-} KLIST;
+} KREPLY;
+
+// A cmd waiting for the reply with the same cmd and dev
+typedef struct kwaiter {
+	struct kwaiter *next;
+	uint8_t cmd;
+	uint8_t dev;
+	bool done;
+	KREPLY reply;
+	pthread_cond_t cond;
+} KWAITER;
 
 typedef struct jobque {
 	int workqc;
@@ -216,15 +224,13 @@ typedef struct jobque {
 struct klondike_info {
 	pthread_rwlock_t stat_lock;
 	struct thr_info replies_thr;
-	cglock_t klist_lock;
-	KLIST *used;
-	KLIST *free;
-	int kline_count;
-	int used_count;
-	int block_seq;
-	KLIST *status;
+	pthread_mutex_t reply_lock;
+	KWAITER *waiters;
+	uint64_t reply_timeouts;
+	uint64_t replies_unwaited;
+	KREPLY *status;
 	DEVINFO *devinfo;
-	KLIST *cfg;
+	KREPLY *cfg;
 	JOBQUE *jobque;
 	int noncecount;
 	uint64_t hashcount;
@@ -252,104 +258,6 @@ struct klondike_info {
 	bool initialised;
 };
 
-static KLIST *new_klist_set(struct cgpu_info *klncgpu)
-{
-	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *klist = NULL;
-	int i;
-
-	klist = calloc(MAX_KLINES, sizeof(*klist));
-	if (!klist)
-		quit(1, "Failed to calloc klist - when old count=%d", klninfo->kline_count);
-
-	klninfo->kline_count += MAX_KLINES;
-
-	klist[0].prev = NULL;
-	klist[0].next = &(klist[1]);
-	for (i = 1; i < MAX_KLINES-1; i++) {
-		klist[i].prev = &klist[i-1];
-		klist[i].next = &klist[i+1];
-	}
-	klist[MAX_KLINES-1].prev = &(klist[MAX_KLINES-2]);
-	klist[MAX_KLINES-1].next = NULL;
-
-	return klist;
-}
-
-static KLIST *allocate_kitem(struct cgpu_info *klncgpu)
-{
-	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *kitem = NULL;
-	int ran_out = 0;
-	char errbuf[1024];
-
-	cg_wlock(&klninfo->klist_lock);
-
-	if (klninfo->free == NULL) {
-		ran_out = klninfo->kline_count;
-		klninfo->free = new_klist_set(klncgpu);
-		snprintf(errbuf, sizeof(errbuf),
-				 "%s%i: KLINE count exceeded %d, now %d",
-				 klncgpu->drv->name, klncgpu->device_id,
-				 ran_out, klninfo->kline_count);
-	}
-
-	kitem = klninfo->free;
-
-	klninfo->free = klninfo->free->next;
-	if (klninfo->free)
-		klninfo->free->prev = NULL;
-
-	kitem->next = klninfo->used;
-	kitem->prev = NULL;
-	if (kitem->next)
-		kitem->next->prev = kitem;
-	klninfo->used = kitem;
-
-	kitem->ready = false;
-	kitem->working = false;
-
-	memset((void *)&(kitem->kline), 0, sizeof(kitem->kline));
-
-	klninfo->used_count++;
-
-	cg_wunlock(&klninfo->klist_lock);
-
-	if (ran_out > 0)
-		applog(LOG_WARNING, "%s", errbuf);
-
-	return kitem;
-}
-
-static KLIST *release_kitem(struct cgpu_info *klncgpu, KLIST *kitem)
-{
-	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-
-	cg_wlock(&klninfo->klist_lock);
-
-	if (kitem == klninfo->used)
-		klninfo->used = kitem->next;
-
-	if (kitem->next)
-		kitem->next->prev = kitem->prev;
-	if (kitem->prev)
-		kitem->prev->next = kitem->next;
-
-	kitem->next = klninfo->free;
-	if (klninfo->free)
-		klninfo->free->prev = kitem;
-
-	kitem->prev = NULL;
-
-	klninfo->free = kitem;
-
-	klninfo->used_count--;
-
-	cg_wunlock(&klninfo->klist_lock);
-
-	return NULL;
-}
-
 static double cvtKlnToC(uint8_t temp)
 {
 	double Rt, stein, celsius;
@@ -549,43 +457,84 @@ static bool SendCmd(struct cgpu_info *klncgpu, KLINE *kline, int datalen)
 	return true;
 }
 
-static KLIST *GetReply(struct cgpu_info *klncgpu, uint8_t cmd, uint8_t dev)
+/* The reply thread hands each reply directly to the first cmd waiting
+ * for that cmd and dev, replies with no waiter are discarded */
+static void klondike_reply(struct cgpu_info *klncgpu, KREPLY *kreply)
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *kitem;
-	int retries = CMD_REPLY_RETRIES;
-
-	while (retries-- > 0 && klncgpu->shutdown == false) {
-		cgsleep_ms(REPLY_WAIT_TIME);
-		cg_rlock(&klninfo->klist_lock);
-		kitem = klninfo->used;
-		while (kitem) {
-			if (kitem->kline.hd.cmd == cmd &&
-			    kitem->kline.hd.dev == dev &&
-			    kitem->ready == true && kitem->working == false) {
-				kitem->working = true;
-				cg_runlock(&klninfo->klist_lock);
-				return kitem;
-			}
-			kitem = kitem->next;
+	KWAITER *waiter;
+
+	mutex_lock(&klninfo->reply_lock);
+	for (waiter = klninfo->waiters; waiter; waiter = waiter->next) {
+		if (!waiter->done && waiter->cmd == kreply->kline.hd.cmd &&
+		    waiter->dev == kreply->kline.hd.dev) {
+			memcpy(&(waiter->reply), kreply, sizeof(waiter->reply));
+			waiter->done = true;
+			pthread_cond_signal(&(waiter->cond));
+			break;
 		}
-		cg_runlock(&klninfo->klist_lock);
 	}
-	return NULL;
+	if (!waiter)
+		klninfo->replies_unwaited++;
+	mutex_unlock(&klninfo->reply_lock);
 }
 
-static KLIST *SendCmdGetReply(struct cgpu_info *klncgpu, KLINE *kline, int datalen)
+static bool SendCmdGetReply(struct cgpu_info *klncgpu, KLINE *kline, int datalen, KREPLY *kreply)
 {
-	if (!SendCmd(klncgpu, kline, datalen))
-		return NULL;
+	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
+	struct timeval now, then, tdiff;
+	struct timespec abstime;
+	KWAITER waiter, **prev;
+	bool sent, ok;
+
+	waiter.cmd = kline->hd.cmd;
+	waiter.dev = kline->hd.dev;
+	waiter.done = false;
+	pthread_cond_init(&(waiter.cond), NULL);
+
+	// Wait before sending so the reply can't arrive before the waiter
+	mutex_lock(&klninfo->reply_lock);
+	waiter.next = klninfo->waiters;
+	klninfo->waiters = &waiter;
+	mutex_unlock(&klninfo->reply_lock);
+
+	sent = SendCmd(klncgpu, kline, datalen);
+
+	tdiff.tv_sec = CMD_REPLY_MS / 1000;
+	tdiff.tv_usec = CMD_REPLY_MS * 1000 - (tdiff.tv_sec * 1000000);
+	cgtime(&now);
+	timeradd(&now, &tdiff, &then);
+	abstime.tv_sec = then.tv_sec;
+	abstime.tv_nsec = then.tv_usec * 1000;
+
+	mutex_lock(&klninfo->reply_lock);
+	while (sent && !waiter.done && klncgpu->shutdown == false) {
+		if (pthread_cond_timedwait(&(waiter.cond), &klninfo->reply_lock, &abstime))
+			break;
+	}
+	ok = waiter.done;
+	if (sent && !ok)
+		klninfo->reply_timeouts++;
+	for (prev = &(klninfo->waiters); *prev; prev = &((*prev)->next)) {
+		if (*prev == &waiter) {
+			*prev = waiter.next;
+			break;
+		}
+	}
+	mutex_unlock(&klninfo->reply_lock);
+
+	pthread_cond_destroy(&(waiter.cond));
+
+	if (ok && kreply)
+		memcpy(kreply, &(waiter.reply), sizeof(*kreply));
 
-	return GetReply(klncgpu, kline->hd.cmd, kline->hd.dev);
+	return ok;
 }
 
 static bool klondike_get_stats(struct cgpu_info *klncgpu)
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *kitem;
+	KREPLY kreply;
 	KLINE kline;
 	int slaves, dev;
 
@@ -604,14 +553,12 @@ static bool klondike_get_stats(struct cgpu_info *klncgpu)
 		zero_kline(&kline);
 		kline.hd.cmd = KLN_CMD_STATUS;
 		kline.hd.dev = dev;
-		kitem = SendCmdGetReply(klncgpu, &kline, 0);
-		if (kitem != NULL) {
+		if (SendCmdGetReply(klncgpu, &kline, 0, &kreply)) {
 			wr_lock(&(klninfo->stat_lock));
 			memcpy((void *)(&(klninfo->status[dev])),
-				(void *)kitem,
+				(void *)&kreply,
 				sizeof(klninfo->status[dev]));
 			wr_unlock(&(klninfo->stat_lock));
-			kitem = release_kitem(klncgpu, kitem);
 		} else {
 			applog(LOG_ERR, "%s%i:%d failed to update stats",
 					klncgpu->drv->name, klncgpu->device_id, dev);
@@ -623,7 +570,6 @@ static bool klondike_get_stats(struct cgpu_info *klncgpu)
 // TODO: this only enables the master (no slaves)
 static bool kln_enable(struct cgpu_info *klncgpu)
 {
-	KLIST *kitem;
 	KLINE kline;
 	int tries = 2;
 	bool ok = false;
@@ -634,9 +580,7 @@ static bool kln_enable(struct cgpu_info *klncgpu)
 	kline.hd.buf[0] = KLN_CMD_ENABLE_ON;
 	
 	while (tries-- > 0) {
-		kitem = SendCmdGetReply(klncgpu, &kline, 1);
-		if (kitem) {
-			kitem = release_kitem(klncgpu, kitem);
+		if (SendCmdGetReply(klncgpu, &kline, 1, NULL)) {
 			ok = true;
 			break;
 		}
@@ -666,7 +610,7 @@ static void kln_disable(struct cgpu_info *klncgpu, int dev, bool all)
 static bool klondike_init(struct cgpu_info *klncgpu)
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *kitem;
+	KREPLY kreply;
 	KLINE kline;
 	int slaves, dev;
 
@@ -675,11 +619,10 @@ static bool klondike_init(struct cgpu_info *klncgpu)
 	zero_kline(&kline);
 	kline.hd.cmd = KLN_CMD_STATUS;
 	kline.hd.dev = 0;
-	kitem = SendCmdGetReply(klncgpu, &kline, 0);
-	if (kitem == NULL)
+	if (!SendCmdGetReply(klncgpu, &kline, 0, &kreply))
 		return false;
 
-	slaves = kitem->kline.ws.slavecount;
+	slaves = kreply.kline.ws.slavecount;
 	if (klninfo->status == NULL) {
 		applog(LOG_DEBUG, "%s%i: initializing data",
 				klncgpu->drv->name, klncgpu->device_id);
@@ -699,8 +642,7 @@ static bool klondike_init(struct cgpu_info *klncgpu)
 			quit(1, "Failed to calloc jobque array in klondke_get_stats");
 	}
 
-	memcpy((void *)(&(klninfo->status[0])), (void *)kitem, sizeof(klninfo->status[0]));
-	kitem = release_kitem(klncgpu, kitem);
+	memcpy((void *)(&(klninfo->status[0])), (void *)&kreply, sizeof(klninfo->status[0]));
 
 	// zero init triggers read back only
 	zero_kline(&kline);
@@ -723,16 +665,14 @@ static bool klondike_init(struct cgpu_info *klncgpu)
 
 	for (dev = 0; dev <= slaves; dev++) {
 		kline.cfg.dev = dev;
-		kitem = SendCmdGetReply(klncgpu, &kline, size);
-		if (kitem != NULL) {
-			memcpy((void *)&(klninfo->cfg[dev]), kitem, sizeof(klninfo->cfg[dev]));
+		if (SendCmdGetReply(klncgpu, &kline, size, &kreply)) {
+			memcpy((void *)&(klninfo->cfg[dev]), &kreply, sizeof(klninfo->cfg[dev]));
 			applog(LOG_WARNING, "%s%i:%d config (%d: Clk: %d, T:%.0lf, C:%.0lf, F:%d)",
 				klncgpu->drv->name, klncgpu->device_id, dev,
 				dev, K_HASHCLOCK(klninfo->cfg[dev].kline.cfg.hashclock),
 				cvtKlnToC(klninfo->cfg[dev].kline.cfg.temptarget),
 				cvtKlnToC(klninfo->cfg[dev].kline.cfg.tempcritical),
 				(int)100*klninfo->cfg[dev].kline.cfg.fantarget/256);
-			kitem = release_kitem(klncgpu, kitem);
 		}
 	}
 	klondike_get_stats(klncgpu);
@@ -779,11 +719,9 @@ static struct cgpu_info *klondike_detect_one(struct libusb_device *dev, struct u
 		quit(1, "Failed to calloc klninfo in klondke_detect_one");
 	klncgpu->device_data = (void *)klninfo;
 
-	klninfo->free = new_klist_set(klncgpu);
-
 	if (usb_init(klncgpu, dev, found)) {
 		int sent, recd, err;
-		KLIST kitem;
+		KREPLY kitem;
 		int attempts = 0;
 
 		control_init(klncgpu);
@@ -822,13 +760,12 @@ static struct cgpu_info *klondike_detect_one(struct libusb_device *dev, struct u
 				update_usb_stats(klncgpu);
 				applog(LOG_DEBUG, "Klondike cgpu added");
 				rwlock_init(&klninfo->stat_lock);
-				cglock_init(&klninfo->klist_lock);
+				mutex_init(&klninfo->reply_lock);
 				return klncgpu;
 			}
 		}
 		usb_uninit(klncgpu);
 	}
-	free(klninfo->free);
 	free(klninfo);
 	free(klncgpu);
 	return NULL;
@@ -847,34 +784,37 @@ static void klondike_identify(__maybe_unused struct cgpu_info *klncgpu)
 	zero_kline(&kline);
 	kline.hd.cmd = KLN_CMD_IDENT;
 	kline.hd.dev = 0;
-	SendCmdGetReply(klncgpu, &kline, KSENDHD(0));
+	SendCmdGetReply(klncgpu, &kline, KSENDHD(0), NULL);
 */
 }
 
-static void klondike_check_nonce(struct cgpu_info *klncgpu, KLIST *kitem)
+static void klondike_check_nonce(struct cgpu_info *klncgpu, KREPLY *kitem)
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	struct work *work, *look, *tmp;
 	KLINE *kline = &(kitem->kline);
 	struct timeval tv_now;
+	struct work *work;
 	double us_diff;
 	uint32_t nonce = K_NONCE(kline->wr.nonce) - 0xC0;
+	int id;
 
 	applog(LOG_DEBUG, "%s%i:%d FOUND NONCE (%02x:%08x)",
 			  klncgpu->drv->name, klncgpu->device_id, (int)(kline->wr.dev),
 			  kline->wr.workid, (unsigned int)nonce);
 
 	work = NULL;
-	cgtime(&tv_now);
-	rd_lock(&(klncgpu->qlock));
-	HASH_ITER(hh, klncgpu->queued_work, look, tmp) {
-		if (ms_tdiff(&tv_now, &(look->tv_stamp)) < OLD_WORK_MS &&
-		    (look->subid == (kline->wr.dev*256 + kline->wr.workid))) {
-			work = look;
-			break;
-		}
+	// No work is sent until it's initialised
+	if (klninfo->initialised) {
+		// The workid was last used for this work, if it's still queued
+		id = klninfo->devinfo[kline->wr.dev].workids[kline->wr.workid];
+		cgtime(&tv_now);
+		rd_lock(&(klncgpu->qlock));
+		HASH_FIND_INT(klncgpu->queued_work, &id, work);
+		if (work && (ms_tdiff(&tv_now, &(work->tv_stamp)) >= OLD_WORK_MS ||
+			     work->subid != (kline->wr.dev*256 + kline->wr.workid)))
+			work = NULL;
+		rd_unlock(&(klncgpu->qlock));
 	}
-	rd_unlock(&(klncgpu->qlock));
 
 	if (work) {
 		wr_lock(&(klninfo->stat_lock));
@@ -943,7 +883,7 @@ static void *klondike_get_replies(void *userdata)
 {
 	struct cgpu_info *klncgpu = (struct cgpu_info *)userdata;
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *kitem = NULL;
+	KREPLY kreply, *kitem = &kreply;
 	char *hexdata;
 	int err, recd, slaves, dev, isc;
 	bool overheat, sent;
@@ -955,10 +895,7 @@ static void *klondike_get_replies(void *userdata)
 		if (klncgpu->usbinfo.nodev)
 			return NULL;
 
-		if (kitem == NULL)
-			kitem = allocate_kitem(klncgpu);
-		else
-			memset((void *)&(kitem->kline), 0, sizeof(kitem->kline));
+		memset((void *)&(kitem->kline), 0, sizeof(kitem->kline));
 
 		err = usb_read(klncgpu, (char *)&(kitem->kline), REPLY_SIZE, &recd, C_GETRESULTS);
 		if (err || recd != REPLY_SIZE) {
@@ -969,9 +906,6 @@ static void *klondike_get_replies(void *userdata)
 		}
 		if (!err && recd == REPLY_SIZE) {
 			cgtime(&(kitem->tv_when));
-			rd_lock(&(klninfo->stat_lock));
-			kitem->block_seq = klninfo->block_seq;
-			rd_unlock(&(klninfo->stat_lock));
 			if (opt_log_level <= READ_DEBUG) {
 				hexdata = bin2hex((unsigned char *)&(kitem->kline.hd.dev), recd-1);
 				applog(READ_DEBUG, "%s%i:%d reply [%c:%s]",
@@ -1100,18 +1034,15 @@ static void *klondike_get_replies(void *userdata)
 					klninfo->noisecount += kitem->kline.ws.noise;
 					wr_unlock(&(klninfo->stat_lock));
 					display_kline(klncgpu, &kitem->kline, msg_reply);
-					kitem->ready = true;
-					kitem = NULL;
+					klondike_reply(klncgpu, kitem);
 					break;
 				case KLN_CMD_CONFIG:
 					display_kline(klncgpu, &kitem->kline, msg_reply);
-					kitem->ready = true;
-					kitem = NULL;
+					klondike_reply(klncgpu, kitem);
 					break;
 				case KLN_CMD_IDENT:
 					display_kline(klncgpu, &kitem->kline, msg_reply);
-					kitem->ready = true;
-					kitem = NULL;
+					klondike_reply(klncgpu, kitem);
 					break;
 				default:
 					display_kline(klncgpu, &kitem->kline, msg_reply);
@@ -1125,15 +1056,14 @@ static void *klondike_get_replies(void *userdata)
 static void klondike_flush_work(struct cgpu_info *klncgpu)
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	KLIST *kitem;
+	KREPLY kreply;
 	KLINE kline;
 	int slaves, dev;
 
 	if (klninfo->initialised) {
-		wr_lock(&(klninfo->stat_lock));
-		klninfo->block_seq++;
+		rd_lock(&(klninfo->stat_lock));
 		slaves = klninfo->status[0].kline.ws.slavecount;
-		wr_unlock(&(klninfo->stat_lock));
+		rd_unlock(&(klninfo->stat_lock));
 
 		applog(LOG_DEBUG, "%s%i: flushing work",
 				  klncgpu->drv->name, klncgpu->device_id);
@@ -1141,15 +1071,13 @@ static void klondike_flush_work(struct cgpu_info *klncgpu)
 		kline.hd.cmd = KLN_CMD_ABORT;
 		for (dev = 0; dev <= slaves; dev++) {
 			kline.hd.dev = dev;
-			kitem = SendCmdGetReply(klncgpu, &kline, KSENDHD(0));
-			if (kitem != NULL) {
+			if (SendCmdGetReply(klncgpu, &kline, KSENDHD(0), &kreply)) {
 				wr_lock(&(klninfo->stat_lock));
 				memcpy((void *)&(klninfo->status[dev]),
-					kitem,
+					&kreply,
 					sizeof(klninfo->status[dev]));
 				klninfo->jobque[dev].flushed = true;
 				wr_unlock(&(klninfo->stat_lock));
-				kitem = release_kitem(klncgpu, kitem);
 			}
 		}
 	}
@@ -1211,7 +1139,7 @@ static void klondike_thread_enable(struct thr_info *thr)
 	kline.hd.cmd = KLN_CMD_ENABLE;
 	kline.hd.dev = dev;
 	kline.hd.buf[0] = KLN_CMD_ENABLE_OFF;
-	kitem = SendCmdGetReply(klncgpu, &kline, KSENDHD(1));
+	SendCmdGetReply(klncgpu, &kline, KSENDHD(1), NULL);
 */
 
 }
@@ -1220,6 +1148,7 @@ static bool klondike_send_work(struct cgpu_info *klncgpu, int dev, struct work *
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
 	struct work *look, *tmp;
+	KREPLY kreply;
 	KLINE kline;
 	struct timeval tv_old;
 	int wque_size, wque_cleared;
@@ -1234,6 +1163,7 @@ static bool klondike_send_work(struct cgpu_info *klncgpu, int dev, struct work *
 	memcpy(kline.wt.merkle, work->data + MERKLE_OFFSET, MERKLE_BYTES);
 	kline.wt.workid = (uint8_t)(klninfo->devinfo[dev].nextworkid++ & 0xFF);
 	work->subid = dev*256 + kline.wt.workid;
+	klninfo->devinfo[dev].workids[kline.wt.workid] = work->id;
 	cgtime(&work->tv_stamp);
 
 	if (opt_log_level <= LOG_DEBUG) {
@@ -1245,12 +1175,10 @@ static bool klondike_send_work(struct cgpu_info *klncgpu, int dev, struct work *
 	applog(LOG_DEBUG, "%s%i:%d sending work (%d:%02x)",
 			  klncgpu->drv->name, klncgpu->device_id, dev,
 			  dev, kline.wt.workid);
-	KLIST *kitem = SendCmdGetReply(klncgpu, &kline, sizeof(kline.wt));
-	if (kitem != NULL) {
+	if (SendCmdGetReply(klncgpu, &kline, sizeof(kline.wt), &kreply)) {
 		wr_lock(&(klninfo->stat_lock));
-		memcpy((void *)&(klninfo->status[dev]), kitem, sizeof(klninfo->status[dev]));
+		memcpy((void *)&(klninfo->status[dev]), &kreply, sizeof(klninfo->status[dev]));
 		wr_unlock(&(klninfo->stat_lock));
-		kitem = release_kitem(klncgpu, kitem);
 
 		// remove old work
 		wque_size = 0;
@@ -1503,8 +1431,10 @@ static struct api_data *klondike_api_stats(struct cgpu_info *klncgpu)
 	root = api_add_uint64(root, "Error Count", &(klninfo->errorcount), true);
 	root = api_add_uint64(root, "Noise Count", &(klninfo->noisecount), true);
 
-	root = api_add_int(root, "KLine Limit", &(klninfo->kline_count), true);
-	root = api_add_int(root, "KLine Used", &(klninfo->used_count), true);
+	mutex_lock(&klninfo->reply_lock);
+	root = api_add_uint64(root, "Reply Timeouts", &(klninfo->reply_timeouts), true);
+	root = api_add_uint64(root, "Replies Unwaited", &(klninfo->replies_unwaited), true);
+	mutex_unlock(&klninfo->reply_lock);
 
 	root = api_add_elapsed(root, "KQue Delay Count", &(klninfo->delay_count), true);
 	root = api_add_elapsed(root, "KQue Delay Total", &(klninfo->delay_total), true);
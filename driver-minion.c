@@ -11,6 +11,7 @@
 #include "compat.h"
 #include "miner.h"
 #include "klist.h"
+#include "spi-context.h"
 #include <ctype.h>
 #include <math.h>
 
@@ -28,7 +29,10 @@ static void minion_detect(__maybe_unused bool hotplug)
 #include <fcntl.h>
 #include <poll.h>
 
-// Define this to 1 to enable interrupt code and enable no_nonce
+/*
+ * Define this to 1 to enable no_nonce and the command queue interrupt
+ * The result interrupt is enabled at runtime with --minion-interrupt
+ */
 #define ENABLE_INT_NONO 0
 
 // Define this to 1 if compiling on RockChip and not on RPi
@@ -757,6 +761,18 @@ typedef struct xff_item {
 			} \
 			minioninfo->summary.total_dlwait += _lwdiff; \
 			minioninfo->iostats[_off].total_dlwait += _lwdiff; \
+			minioninfo->summary.total_ioc += _ioc; \
+			if (minioninfo->summary.max_ioc < _ioc) \
+				minioninfo->summary.max_ioc = _ioc; \
+			if (minioninfo->summary.min_ioc == 0 || \
+			    minioninfo->summary.min_ioc > _ioc) \
+				minioninfo->summary.min_ioc = _ioc; \
+			minioninfo->iostats[_off].total_ioc += _ioc; \
+			if (minioninfo->iostats[_off].max_ioc < _ioc) \
+				minioninfo->iostats[_off].max_ioc = _ioc; \
+			if (minioninfo->iostats[_off].min_ioc == 0 || \
+			    minioninfo->iostats[_off].min_ioc > _ioc) \
+				minioninfo->iostats[_off].min_ioc = _ioc; \
 			if (_siz == 0) { \
 				minioninfo->summary.zero_bytes++; \
 				minioninfo->iostats[_off].zero_bytes++; \
@@ -793,8 +809,8 @@ typedef struct iostat {
 	// Total time waiting to get lock
 	double total_dlwait;
 
-	// these 3 fields are ignored for now since all are '1'
-	uint64_t total_ioc; // SPI_IOC_MESSAGE(x)
+	// transfers per ioctl i.e. the 'x' in SPI_IOC_MESSAGE(x)
+	uint64_t total_ioc;
 	uint64_t min_ioc;
 	uint64_t max_ioc;
 
@@ -851,6 +867,12 @@ struct minion_info {
 	uint64_t ioseq;
 	uint32_t next_task_id;
 
+	// FIFO status of all chips read with one ioctl each reply cycle
+	struct spi_batch spi_batch;
+	uint8_t fifo_obuf[MINION_CHIPS][HSIZE() + MINION_SYS_SIZ];
+	uint8_t fifo_rbuf[MINION_CHIPS][HSIZE() + MINION_SYS_SIZ];
+	bool fifo_ok[MINION_CHIPS];
+
 	// Stats
 	uint64_t chip_nonces[MINION_CHIPS];
 	uint64_t chip_nononces[MINION_CHIPS];
@@ -867,8 +889,7 @@ struct minion_info {
 	struct minion_status chip_status[MINION_CHIPS];
 
 	uint64_t interrupts;
-	uint64_t result_interrupts;
-	uint64_t command_interrupts;
+	uint64_t result_interrupts; // interrupts that found results
 	char last_interrupt[64];
 
 	pthread_mutex_t nonce_lock;
@@ -1377,14 +1398,120 @@ static void init_pins(struct minion_info *minioninfo)
 
 static bool minion_init_spi(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, int bus, int chip, bool reset);
 
+/* Check a FIFO status or nonce reply for all 0xff, which means the SPI bus
+ * has stopped responding, and if so reset it, or power cycle if it happens
+ * too often. Call with spi_lock held */
+static bool minion_xff(struct cgpu_info *minioncgpu, struct minion_info *minioninfo,
+		       uint8_t *obuf, uint8_t *rbuf, int ret, time_t now,
+		       bool *powercycle, bool *show)
+{
+	double lastshow, total;
+	K_ITEM *xitem;
+	bool fail = false;
+	int i;
+
+	*powercycle = *show = false;
+	if (ret >= 0 && rbuf[0] == 0xff && rbuf[ret-1] == 0xff &&
+	    (obuf[1] == READ_ADDR(MINION_RES_DATA) || obuf[1] == READ_ADDR(MINION_SYS_FIFO_STA))) {
+		fail = true;
+		for (i = 1; i < ret-2; i++) {
+			if (rbuf[i] != 0xff) {
+				fail = false;
+				break;
+			}
+		}
+		if (fail) {
+			minioninfo->xffs++;
+			minioninfo->last_xff = now;
+
+			if (minioninfo->xfree_list->count > 0)
+				xitem = k_unlink_head(minioninfo->xfree_list);
+			else
+				xitem = k_unlink_tail(minioninfo->xff_list);
+			DATA_XFF(xitem)->when = now;
+			if (!minioninfo->xff_list->head)
+				*show = true;
+			else {
+				// xff_list is full
+				if (minioninfo->xfree_list->count == 0) {
+					total = DATA_XFF(xitem)->when -
+						DATA_XFF(minioninfo->xff_list->tail)->when;
+					if (total <= MINION_POWER_TIME) {
+						*powercycle = true;
+						// Discard the history
+						k_list_transfer_to_head(minioninfo->xff_list,
+									minioninfo->xfree_list);
+						k_add_head(minioninfo->xfree_list, xitem);
+						xitem = NULL;
+					}
+				}
+
+				if (!*powercycle) {
+					lastshow = DATA_XFF(xitem)->when -
+						   DATA_XFF(minioninfo->xff_list->head)->when;
+					*show = (lastshow >= 5);
+				}
+			}
+			if (xitem)
+				k_add_head(minioninfo->xff_list, xitem);
+
+#if MINION_ROCKCHIP == 1
+			if (*powercycle)
+				minion_toggle_gpio(minioncgpu, MINION_POWERCYCLE_GPIO);
+#endif
+			minion_init_spi(minioncgpu, minioninfo, 0, 0, true);
+		}
+	}
+
+	return fail;
+}
+
+// Report what minion_xff() did, after releasing spi_lock
+static void minion_xff_show(struct cgpu_info *minioncgpu, struct minion_info *minioninfo,
+			    uint8_t reg, uint64_t ioseq, bool powercycle, bool show)
+{
+	char *what = "unk";
+
+	if (powercycle) {
+		applog(LOG_ERR, "%s%d: power cycle ioctl %"PRIu64" (%"PRIu64")",
+				minioncgpu->drv->name, minioncgpu->device_id, ioseq,
+				minioninfo->xffs - minioninfo->last_displayed_xff);
+		minioninfo->last_displayed_xff = minioninfo->xffs;
+	} else if (show) {
+		switch (reg) {
+			case READ_ADDR(MINION_RES_DATA):
+				what = "nonce";
+				break;
+			case READ_ADDR(MINION_SYS_FIFO_STA):
+				what = "fifo";
+				break;
+		}
+		applog(LOG_ERR, "%s%d: reset ioctl %"PRIu64" %s all 0xff (%"PRIu64")",
+				minioncgpu->drv->name, minioncgpu->device_id,
+				ioseq, what, minioninfo->xffs - minioninfo->last_displayed_xff);
+		minioninfo->last_displayed_xff = minioninfo->xffs;
+	}
+}
+
+// Reset the SPI every spi_reset_count seconds. Call with spi_lock held
+static void minion_spi_reset_time(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, time_t now)
+{
+	if (minioninfo->last_spi_reset == 0)
+		minioninfo->last_spi_reset = now;
+	else {
+		if ((now - minioninfo->last_spi_reset) >= minioninfo->spi_reset_count) {
+			minion_init_spi(minioncgpu, minioninfo, 0, 0, true);
+			minioninfo->last_spi_reset = now;
+		}
+	}
+}
+
 static int __do_ioctl(struct cgpu_info *minioncgpu, struct minion_info *minioninfo,
 		      int pin, uint8_t *obuf, uint32_t osiz, uint8_t *rbuf,
 		      uint32_t rsiz, uint64_t *ioseq, MINION_FFL_ARGS)
 {
 	struct spi_ioc_transfer tran;
-	bool fail = false, powercycle = false, show = false;
-	double lastshow, total;
-	K_ITEM *xitem;
+	bool fail, powercycle, show;
 	time_t now;
 	int ret;
 #if MINION_SHOW_IO
@@ -1459,71 +1586,13 @@ static int __do_ioctl(struct cgpu_info *minioncgpu, struct minion_info *minionin
 		set_pin(minioninfo, pin, true);
 	}
 	now = time(NULL);
-	if (ret >= 0 && rbuf[0] == 0xff && rbuf[ret-1] == 0xff &&
-	    (obuf[1] == READ_ADDR(MINION_RES_DATA) || obuf[1] == READ_ADDR(MINION_SYS_FIFO_STA))) {
-		int i;
-		fail = true;
-		for (i = 1; i < ret-2; i++) {
-			if (rbuf[i] != 0xff) {
-				fail = false;
-				break;
-			}
-		}
-		if (fail) {
-			powercycle = show = false;
-			minioninfo->xffs++;
-			minioninfo->last_xff = now;
-
-			if (minioninfo->xfree_list->count > 0)
-				xitem = k_unlink_head(minioninfo->xfree_list);
-			else
-				xitem = k_unlink_tail(minioninfo->xff_list);
-			DATA_XFF(xitem)->when = now;
-			if (!minioninfo->xff_list->head)
-				show = true;
-			else {
-				// xff_list is full
-				if (minioninfo->xfree_list->count == 0) {
-					total = DATA_XFF(xitem)->when -
-						DATA_XFF(minioninfo->xff_list->tail)->when;
-					if (total <= MINION_POWER_TIME) {
-						powercycle = true;
-						// Discard the history
-						k_list_transfer_to_head(minioninfo->xff_list,
-									minioninfo->xfree_list);
-						k_add_head(minioninfo->xfree_list, xitem);
-						xitem = NULL;
-					}
-				}
-
-				if (!powercycle) {
-					lastshow = DATA_XFF(xitem)->when -
-						   DATA_XFF(minioninfo->xff_list->head)->when;
-					show = (lastshow >= 5);
-				}
-			}
-			if (xitem)
-				k_add_head(minioninfo->xff_list, xitem);
-
-#if MINION_ROCKCHIP == 1
-			if (powercycle)
-				minion_toggle_gpio(minioncgpu, MINION_POWERCYCLE_GPIO);
-#endif
-			minion_init_spi(minioncgpu, minioninfo, 0, 0, true);
-		}
-	} else if (minioninfo->spi_reset_count) {
+	fail = minion_xff(minioncgpu, minioninfo, obuf, rbuf, ret, now, &powercycle, &show);
+	if (!fail && minioninfo->spi_reset_count) {
 		if (minioninfo->spi_reset_io) {
 			if (*ioseq > 0 && (*ioseq % minioninfo->spi_reset_count) == 0)
 				minion_init_spi(minioncgpu, minioninfo, 0, 0, true);
-		} else {
-			if (minioninfo->last_spi_reset == 0)
-				minioninfo->last_spi_reset = now;
-			else {
-				if ((now - minioninfo->last_spi_reset) >= minioninfo->spi_reset_count)
-					minion_init_spi(minioncgpu, minioninfo, 0, 0, true);
-					minioninfo->last_spi_reset = now;
-			}
-		}
+		} else
+			minion_spi_reset_time(minioncgpu, minioninfo, now);
 	}
 	if (opt_minion_spidelay)
 		cgsleep_ms(opt_minion_spidelay);
@@ -1533,28 +1602,8 @@ static int __do_ioctl(struct cgpu_info *minioncgpu, struct minion_info *minionin
 
 	IO_STAT_STORE(&sta, &fin, &lsta, &lfin, &tsd, obuf, osiz, ret, 1);
 
-	if (fail) {
-		if (powercycle) {
-			applog(LOG_ERR, "%s%d: power cycle ioctl %"PRIu64" (%"PRIu64")",
-					minioncgpu->drv->name, minioncgpu->device_id, *ioseq,
-					minioninfo->xffs - minioninfo->last_displayed_xff);
-			minioninfo->last_displayed_xff = minioninfo->xffs;
-		} else if (show) {
-			char *what = "unk";
-			switch (obuf[1]) {
-				case READ_ADDR(MINION_RES_DATA):
-					what = "nonce";
-					break;
-				case READ_ADDR(MINION_SYS_FIFO_STA):
-					what = "fifo";
-					break;
-			}
-			applog(LOG_ERR, "%s%d: reset ioctl %"PRIu64" %s all 0xff (%"PRIu64")",
-					minioncgpu->drv->name, minioncgpu->device_id,
-					*ioseq, what, minioninfo->xffs - minioninfo->last_displayed_xff);
-			minioninfo->last_displayed_xff = minioninfo->xffs;
-		}
-	}
+	if (fail)
+		minion_xff_show(minioncgpu, minioninfo, obuf[1], *ioseq, powercycle, show);
 
 #if MINION_SHOW_IO
 	if (ret > 0) {
@@ -1632,7 +1681,7 @@ static int _do_ioctl(struct minion_info *minioninfo, int pin, uint8_t *obuf, uin
 }
 #endif
 
-static bool _minion_txrx(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, TASK_ITEM *task, MINION_FFL_ARGS)
+static void minion_task_head(struct minion_info *minioninfo, TASK_ITEM *task)
 {
 	struct minion_header *head;
 
@@ -1648,6 +1697,11 @@ static bool _minion_txrx(struct cgpu_info *minioncgpu, struct minion_info *minio
 	if (task->wsiz)
 		memcpy(&(head->data[0]), task->wbuf, task->wsiz);
 	task->osiz = HSIZE() + task->wsiz + task->rsiz;
+}
+
+static bool _minion_txrx(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, TASK_ITEM *task, MINION_FFL_ARGS)
+{
+	minion_task_head(minioninfo, task);
 
 	task->reply = do_ioctl(CHIP_PIN(task->chip), task->obuf, task->osiz, task->rbuf, task->rsiz,
 			       &(task->ioseq));
@@ -1696,6 +1750,126 @@ static int build_cmd(struct cgpu_info *minioncgpu, struct minion_info *minioninf
 	return reply;
 }
 
+static void minion_fifo_submit(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, int first, int last)
+{
+	struct spi_batch *batch = &(minioninfo->spi_batch);
+	uint32_t bytes = batch->bytes;
+	int xfrs = batch->count;
+	bool fail, powercycle, show;
+	uint64_t ioseq;
+	int chip, xfr, ret;
+	time_t now;
+
+#if DO_IO_STATS
+	struct timeval sta, fin, lsta, lfin, tsd;
+#endif
+
+	if (xfrs == 0)
+		return;
+
+	IO_STAT_NOW(&lsta);
+	mutex_lock(&(minioninfo->spi_lock));
+	IO_STAT_NOW(&sta);
+	ret = spi_batch_submit(minioninfo->spifd, batch);
+	ioseq = minioninfo->ioseq;
+	minioninfo->ioseq += xfrs;
+	IO_STAT_NOW(&fin);
+	now = time(NULL);
+	/* Each reply gets the same all 0xff check as a single ioctl
+	 * The bus is reset on the first one found, so the rest of the
+	 * batch, and the chip that failed, are left for the caller to
+	 * read one at a time */
+	fail = false;
+	if (ret >= (int)bytes) {
+		xfr = 0;
+		for (chip = first; chip < last; chip++) {
+			if (!minioninfo->has_chip[chip])
+				continue;
+			fail = minion_xff(minioncgpu, minioninfo,
+					  minioninfo->fifo_obuf[chip],
+					  minioninfo->fifo_rbuf[chip],
+					  (int)(batch->xfr[xfr].len), now,
+					  &powercycle, &show);
+			if (fail) {
+				ioseq += xfr;
+				break;
+			}
+			xfr++;
+		}
+	}
+	if (!fail && minioninfo->spi_reset_count) {
+		// Don't skip over the reset point since this advanced ioseq by xfrs
+		if (minioninfo->spi_reset_io) {
+			if ((ioseq / minioninfo->spi_reset_count) !=
+			    (minioninfo->ioseq / minioninfo->spi_reset_count))
+				minion_init_spi(minioncgpu, minioninfo, 0, 0, true);
+		} else
+			minion_spi_reset_time(minioncgpu, minioninfo, now);
+	}
+	if (opt_minion_spidelay)
+		cgsleep_ms(opt_minion_spidelay);
+	mutex_unlock(&(minioninfo->spi_lock));
+	IO_STAT_NOW(&lfin);
+	IO_STAT_NOW(&tsd);
+
+	IO_STAT_STORE(&sta, &fin, &lsta, &lfin, &tsd, minioninfo->fifo_obuf[first],
+		      bytes, ret, xfrs);
+
+	if (fail) {
+		minion_xff_show(minioncgpu, minioninfo, READ_ADDR(MINION_SYS_FIFO_STA),
+				ioseq, powercycle, show);
+		return;
+	}
+
+	if (ret < (int)bytes)
+		return;
+
+	for (chip = first; chip < last; chip++) {
+		if (minioninfo->has_chip[chip])
+			minioninfo->fifo_ok[chip] = true;
+	}
+}
+
+/*
+ * Read the FIFO status of every chip with one SPI_IOC_MESSAGE(n)
+ * This only works when all the chips share the SPI chip select and are
+ * addressed by the chipid in the header, since with usepins each chip's
+ * pin must be toggled around its own ioctl
+ * Only fifo_ok chips got a reply, the caller reads any others, or any
+ * with a bad reply, one at a time with the usual error handling
+ */
+static void minion_fifo_scan(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, TASK_ITEM *fifo_task)
+{
+	struct spi_batch *batch = &(minioninfo->spi_batch);
+	uint8_t *obuf, *rbuf;
+	int chip, first;
+
+	spi_batch_reset(batch);
+	first = 0;
+	for (chip = 0; chip < (int)MINION_CHIPS; chip++) {
+		minioninfo->fifo_ok[chip] = false;
+		if (!minioninfo->has_chip[chip])
+			continue;
+
+		fifo_task->chip = chip;
+		minion_task_head(minioninfo, fifo_task);
+		obuf = minioninfo->fifo_obuf[chip];
+		rbuf = minioninfo->fifo_rbuf[chip];
+		memcpy(obuf, fifo_task->obuf, fifo_task->osiz);
+		memset(obuf + fifo_task->osiz - fifo_task->rsiz, 0xff, fifo_task->rsiz);
+		memset(rbuf, 0, fifo_task->osiz);
+
+		if (!spi_batch_add(batch, obuf, rbuf, fifo_task->osiz, MINION_SPI_SPEED,
+				   opt_minion_spiusec, true)) {
+			minion_fifo_submit(minioncgpu, minioninfo, first, chip);
+			first = chip;
+			spi_batch_add(batch, obuf, rbuf, fifo_task->osiz, MINION_SPI_SPEED,
+				      opt_minion_spiusec, true);
+		}
+	}
+	minion_fifo_submit(minioncgpu, minioninfo, first, MINION_CHIPS);
+}
+
 static void init_chip(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, int chip)
 {
 	uint8_t rbuf[MINION_BUFSIZ];
@@ -1908,7 +2082,6 @@ static void enable_chip_cores(struct cgpu_info *minioncgpu, struct minion_info *
 	}
 }
 
-#if ENABLE_INT_NONO
 static void enable_interrupt(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, int chip)
 {
 	uint8_t rbuf[MINION_BUFSIZ];
@@ -1935,8 +2108,11 @@ static void enable_interrupt(struct cgpu_info *minioncgpu, struct minion_info *m
 			  chip, WRITE_ADDR(MINION_SYS_QUE_TRIG),
 			  rbuf, 0, data);
 
-//	data[0] = MINION_RESULT_INT;
+#if ENABLE_INT_NONO
 	data[0] = MINION_RESULT_INT | MINION_CMD_INT;
+#else
+	data[0] = MINION_RESULT_INT;
+#endif
 	data[1] = 0x00;
 	data[2] = 0x00;
 	data[3] = 0x00;
@@ -1945,7 +2121,6 @@ static void enable_interrupt(struct cgpu_info *minioncgpu, struct minion_info *m
 			  chip, WRITE_ADDR(MINION_SYS_INT_ENA),
 			  rbuf, 0, data);
 }
-#endif
 
 static void minion_detect_one(struct cgpu_info *minioncgpu, struct minion_info *minioninfo, int pin, int chipid)
 {
@@ -2037,12 +2212,12 @@ static void minion_detect_chips(struct cgpu_info *minioncgpu, struct minion_info
 			}
 		}
 
-#if ENABLE_INT_NONO
 		// After everything is ready
-		for (chip = 0; chip < MINION_CHIPS; chip++)
-			if (minioninfo->has_chip[chip])
-				enable_interrupt(minioncgpu, minioninfo, chip);
-#endif
+		if (minioninfo->gpiointfd >= 0) {
+			for (chip = 0; chip < (int)MINION_CHIPS; chip++)
+				if (minioninfo->has_chip[chip])
+					enable_interrupt(minioncgpu, minioninfo, chip);
+		}
 	}
 }
 
@@ -2187,7 +2362,16 @@ static bool minion_setup_chip_select(struct cgpu_info *minioncgpu, struct minion
 		return true;
 }
 
-#if ENABLE_INT_NONO
+// Read the GPIO interrupt value to rearm poll()
+static void minion_gpio_ack(struct minion_info *minioninfo)
+{
+	char c;
+
+	lseek(minioninfo->gpiointfd, 0, SEEK_SET);
+	if (read(minioninfo->gpiointfd, &c, 1) < 0)
+		applog(LOG_DEBUG, "Minion GPIO interrupt read failed (%d)", errno);
+}
+
 static bool minion_init_gpio_interrupt(struct cgpu_info *minioncgpu, struct minion_info *minioninfo)
 {
 	char pindir[64], ena[64], pin[8], dir[64], edge[64], act[64];
@@ -2338,9 +2522,11 @@ static bool minion_init_gpio_interrupt(struct cgpu_info *minioncgpu, struct mini
 		return false;
 	}
 
+	// A sysfs value has to be read before poll() will wait for a change
+	minion_gpio_ack(minioninfo);
+
 	return true;
 }
-#endif
 
 // Default meaning all cores
 static void default_all_cores(uint8_t *cores)
@@ -2547,13 +2733,28 @@ static void minion_detect(bool hotplug)
 		quithere(1, "Failed to calloc minioninfo");
 	minioncgpu->device_data = (void *)minioninfo;
 
+	minioninfo->gpiointfd = -1;
+
 	if (!minion_init_spi(minioncgpu, minioninfo, MINION_SPI_BUS, MINION_SPI_CHIP, false))
 		goto unalloc;
 
-#if ENABLE_INT_NONO
-	if (!minion_init_gpio_interrupt(minioncgpu, minioninfo))
-		goto unalloc;
-#endif
+	/*
+	 * The interrupt pin is one of the chip select pins,
+	 * and if it can't be setup then just poll for results
+	 */
+	if (opt_minion_interrupt) {
+		if (usepins) {
+			applog(LOG_WARNING, "%s: GPIO interrupt pin %d is a chip select pin, polling instead",
+					    minioncgpu->drv->dname, MINION_GPIO_RESULT_INT_PIN);
+		} else if (!minion_init_gpio_interrupt(minioncgpu, minioninfo)) {
+			if (minioninfo->gpiointfd >= 0) {
+				close(minioninfo->gpiointfd);
+				minioninfo->gpiointfd = -1;
+			}
+			applog(LOG_WARNING, "%s: GPIO interrupt unavailable, polling instead",
+					    minioncgpu->drv->dname);
+		}
+	}
 
 
 	if (usepins) {
@@ -2642,7 +2843,8 @@ static void minion_detect(bool hotplug)
 	return;
 
 cleanup:
-	close(minioninfo->gpiointfd);
+	if (minioninfo->gpiointfd >= 0)
+		close(minioninfo->gpiointfd);
 	close(minioninfo->spifd);
 	mutex_destroy(&(minioninfo->sta_lock));
 	mutex_destroy(&(minioninfo->spi_lock));
@@ -3132,6 +3334,7 @@ static void *minion_spi_write(void *userdata)
 /*
  * SPI/ioctl reply thread
  * ioctl done every interrupt or MINION_REPLY_mS checking for results
+ * With no interrupt it simply sleeps MINION_REPLY_mS between checks
  */
 static void *minion_spi_reply(void *userdata)
 {
@@ -3144,17 +3347,10 @@ static void *minion_spi_reply(void *userdata)
 	bool somelow;
 	struct timeval now;
 
-#if ENABLE_INT_NONO
-	uint64_t ioseq;
 	TASK_ITEM clr_task;
 	struct pollfd pfd;
-	struct minion_header *head;
-	uint8_t rbuf[MINION_BUFSIZ];
-	uint8_t wbuf[MINION_BUFSIZ];
-	uint32_t wsiz, rsiz;
-	int ret, reply;
-	bool gotreplies = false;
-#endif
+	bool hadres, gotint, gotres;
+	int ret;
 
 	applog(MINION_LOG, "%s%i: SPI replying...",
 				minioncgpu->drv->name, minioncgpu->device_id);
@@ -3188,8 +3384,7 @@ static void *minion_spi_reply(void *userdata)
 	res2_task.wsiz = 0;
 	res2_task.rsiz = MINION_RES_DATA_SIZ;
 
-#if ENABLE_INT_NONO
-	// Clear RESULT_INT after reading all results
+	// Clear RESULT_INT after reading a chip's results
 	clr_task.chip = 0;
 	clr_task.write = true;
 	clr_task.address = MINION_SYS_INT_CLR;
@@ -3204,14 +3399,13 @@ static void *minion_spi_reply(void *userdata)
 	pfd.fd = minioninfo->gpiointfd;
 	pfd.events = POLLPRI;
 
-	head = (struct minion_header *)wbuf;
-	SET_HEAD_SIZ(head, MINION_SYS_SIZ);
-	wsiz = HSIZE() + MINION_SYS_SIZ;
-	rsiz = MINION_SYS_SIZ; // for READ, use 0 for WRITE
-#endif
-
 	somelow = false;
+	gotint = false;
 	while (minioncgpu->shutdown == false) {
+		gotres = false;
+		if (!usepins)
+			minion_fifo_scan(minioncgpu, minioninfo, &fifo_task);
+
 		for (chip = 0; chip < (int)MINION_CHIPS; chip++) {
 			if (minioninfo->has_chip[chip]) {
 				int tries = 0;
@@ -3220,7 +3414,14 @@ static void *minion_spi_reply(void *userdata)
 					res = cmd = 0;
 					fifo_task.chip = chip;
 					fifo_task.reply = 0;
-					minion_txrx(&fifo_task);
+					if (tries == 1 && minioninfo->fifo_ok[chip]) {
+						// Already read by minion_fifo_scan()
+						fifo_task.osiz = HSIZE() + fifo_task.rsiz;
+						memcpy(fifo_task.rbuf, minioninfo->fifo_rbuf[chip],
+							fifo_task.osiz);
+						fifo_task.reply = (int)(fifo_task.osiz);
+					} else
+						minion_txrx(&fifo_task);
 					if (fifo_task.reply <= 0) {
 						minioninfo->spi_errors++;
 						minioninfo->fifo_spi_errors[chip]++;
@@ -3305,6 +3506,7 @@ static void *minion_spi_reply(void *userdata)
 				}
 //else
 //applog(LOG_ERR, "%s%i: work reply res %d", minioncgpu->drv->name, minioncgpu->device_id, res);
+				hadres = (res > 0);
 				uint8_t left = res;
 				int peeks = 0;
 				while (left > 0) {
@@ -3444,100 +3646,52 @@ repeek:
 						}
 					}
 				}
+
+				if (hadres && minioninfo->gpiointfd >= 0) {
+					gotres = true;
+					clr_task.chip = chip;
+					minion_txrx(&clr_task);
+				}
 			}
 		}
 
 		if (somelow)
 			cgsem_post(&(minioninfo->scan_work));
 
-#if ENABLE_INT_NONO
-		if (gotreplies)
-			minion_txrx(&clr_task);
-#endif
+		if (gotint && gotres)
+			minioninfo->result_interrupts++;
+		gotint = false;
 
-#if !ENABLE_INT_NONO
-		cgsleep_ms(MINION_REPLY_mS);
-#else
-		// TODO: this is going to require a bit of tuning with 2TH/s mining:
-		// The interrupt size MINION_RESULT_INT_SIZE should be high enough to expect
-		// most chips to have some results but low enough to cause negligible latency
-		// If all chips don't have some results when an interrupt occurs, then it is a waste
-		// since we have to check all chips for results anyway since we don't know which one
-		// caused the interrupt
-		// MINION_REPLY_mS needs to be low enough in the case of bad luck where no chip
-		// finds MINION_RESULT_INT_SIZE results in a short amount of time, so we go check
-		// them all anyway - to avoid high latency when there are only a few results due to low luck
+		if (minioninfo->gpiointfd < 0) {
+			cgsleep_ms(MINION_REPLY_mS);
+			continue;
+		}
+
+		/*
+		 * A chip raises the result interrupt when it has MINION_RESULT_INT_SIZE
+		 * results, so wait for that to read them as soon as they are ready
+		 * The chips share the one rising edge GPIO, and we don't know which
+		 * chip it was, so all chips are checked each time
+		 * The edge is missed if a chip is still asserting it when another
+		 * does, or if few results are found, so MINION_REPLY_mS is also
+		 * the longest it waits before checking all chips anyway
+		 */
 		ret = poll(&pfd, 1, MINION_REPLY_mS);
 		if (ret > 0) {
-			bool gotres;
-			int c;
-
+			gotint = true;
 			minioninfo->interrupts++;
-
-			read(minioninfo->gpiointfd, &c, 1);
-
-//			applog(LOG_ERR, "%s%i: Interrupt2",
-//					minioncgpu->drv->name,
-//					minioncgpu->device_id);
-
-			gotres = false;
-			for (chip = 0; chip < (int)MINION_CHIPS; chip++) {
-				if (minioninfo->has_chip[chip]) {
-					SET_HEAD_READ(head, MINION_SYS_INT_STA);
-					head->chipid = minioninfo->chipid[chip];
-					reply = do_ioctl(CHIP_PIN(chip), wbuf, wsiz, rbuf, rsiz, &ioseq);
-					if (reply != (int)wsiz) {
-						applog(LOG_ERR, "%s: chip %d int status returned %d"
-								" (should be %d)",
-								minioncgpu->drv->dname,
-								chip, reply, (int)wsiz);
-					}
-
-					snprintf(minioninfo->last_interrupt,
-						 sizeof(minioninfo->last_interrupt),
-						 "%d %d 0x%02x%02x%02x%02x%02x%02x%02x%02x %d %d 0x%02x %d %d",
-						 (int)(minioninfo->interrupts), chip,
-						 rbuf[0], rbuf[1], rbuf[2], rbuf[3],
-						 rbuf[4], rbuf[5], rbuf[6], rbuf[7],
-						 (int)wsiz, (int)rsiz, rbuf[wsiz - rsiz],
-						 rbuf[wsiz - rsiz] & MINION_RESULT_INT,
-						 rbuf[wsiz - rsiz] & MINION_CMD_INT);
-
-					if ((rbuf[wsiz - rsiz] & MINION_RESULT_INT) != 0) {
-						gotres = true;
-						(minioninfo->result_interrupts)++;
-//						applog(LOG_ERR, "%s%i: chip %d got RES interrupt",
-//								minioncgpu->drv->name,
-//								minioncgpu->device_id,
-//								chip);
-					}
-
-					if ((rbuf[wsiz - rsiz] & MINION_CMD_INT) != 0) {
-						// Work queue is empty
-						(minioninfo->command_interrupts)++;
-//						applog(LOG_ERR, "%s%i: chip %d got CMD interrupt",
-//								minioncgpu->drv->name,
-//								minioncgpu->device_id,
-//								chip);
-					}
-
-//					char *tmp;
-//					tmp = bin2hex(rbuf, wsiz);
-//					applog(LOG_ERR, "%s%i: chip %d interrupt: %s",
-//							minioncgpu->drv->name,
-//							minioncgpu->device_id,
-//							chip, tmp);
-//					free(tmp);
-
-					// Don't clear either interrupt until after send/recv
-				}
-			}
-
-			// Doing this last means we can't miss an interrupt
-			if (gotres)
-				cgsem_post(&(minioninfo->scan_work));
+			minion_gpio_ack(minioninfo);
+			cgtime(&now);
+			snprintf(minioninfo->last_interrupt,
+				 sizeof(minioninfo->last_interrupt),
+				 "%d %d.%06d", (int)(minioninfo->interrupts),
+				 (int)(now.tv_sec), (int)(now.tv_usec));
+		} else if (ret < 0 && errno != EINTR) {
+			applog(LOG_ERR, "%s%i: GPIO interrupt poll failed (%d), polling instead",
+					minioncgpu->drv->name, minioncgpu->device_id, errno);
+			close(minioninfo->gpiointfd);
+			minioninfo->gpiointfd = -1;
 		}
-#endif
 	}
 
 	return NULL;
@@ -5112,6 +5266,7 @@ static struct api_data *minion_api_stats(struct cgpu_info *minioncgpu)
 			float _davg = (float)((_iostat).total_delay) / (float)((_iostat).count); \
 			float _dlavg = (float)((_iostat).total_dlock) / (float)((_iostat).count); \
 			float _dlwavg = (float)((_iostat).total_dlwait) / (float)((_iostat).count); \
+			float _iavg = (float)((_iostat).total_ioc) / (float)((_iostat).count); \
 			float _bavg = (float)((_iostat).total_bytes) / (float)((_iostat).count); \
 			float _tavg = (float)((_iostat).tsd) / (float)((_iostat).count); \
 			snprintf(data, sizeof(data), "%s Count=%"PRIu64 \
@@ -5120,6 +5275,8 @@ static struct api_data *minion_api_stats(struct cgpu_info *minioncgpu)
 				" DLock=%.0fus DLAvg=%.3f" \
 				" DLMin=%.0f DLMax=%.0f DZ=%"PRIu64 \
 				" DLWait=%.0fus DLWAvg=%.3f" \
+				" Ioc=%"PRIu64" IocAvg=%.3f" \
+				" IocMin=%"PRIu64" IocMax=%"PRIu64 \
 				" Bytes=%"PRIu64" BAvg=%.3f" \
 				" BMin=%"PRIu64" BMax=%"PRIu64" BZ=%"PRIu64 \
 				" TSD=%.0fus TAvg=%.03f", \
@@ -5129,6 +5286,8 @@ static struct api_data *minion_api_stats(struct cgpu_info *minioncgpu)
 				(_iostat).total_dlock, _dlavg, (_iostat).min_dlock, \
 				(_iostat).max_dlock, (_iostat).zero_dlock, \
 				(_iostat).total_dlwait, _dlwavg, \
+				(_iostat).total_ioc, _iavg, (_iostat).min_ioc, \
+				(_iostat).max_ioc, \
 				(_iostat).total_bytes, _bavg, (_iostat).min_bytes, \
 				(_iostat).max_bytes, (_iostat).zero_bytes, \
 				(_iostat).tsd, _tavg); \
@@ -5152,11 +5311,13 @@ static struct api_data *minion_api_stats(struct cgpu_info *minioncgpu)
 #endif
 
 	root = api_add_uint64(root, "Total SPI Errors", &(minioninfo->spi_errors), true);
+	root = api_add_uint64(root, "FIFO Scan Ioctls", &(minioninfo->spi_batch.ioctls), true);
+	root = api_add_uint64(root, "FIFO Scan Transfers", &(minioninfo->spi_batch.xfrs), true);
+	root = api_add_uint64(root, "FIFO Scan Bytes", &(minioninfo->spi_batch.total_bytes), true);
 	root = api_add_uint64(root, "Work Unrolled", &(minioninfo->work_unrolled), true);
 	root = api_add_uint64(root, "Work Rolled", &(minioninfo->work_rolled), true);
 	root = api_add_uint64(root, "Ints", &(minioninfo->interrupts), true);
 	root = api_add_uint64(root, "Res Ints", &(minioninfo->result_interrupts), true);
-	root = api_add_uint64(root, "Cmd Ints", &(minioninfo->command_interrupts), true);
 	root = api_add_string(root, "Last Int", minioninfo->last_interrupt, true);
 	root = api_add_hex32(root, "Next TaskID", &(minioninfo->next_task_id), true);
 
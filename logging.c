@@ -21,6 +21,8 @@ bool opt_log_output = false;
 /* per default priorities higher than LOG_NOTICE are logged */
 int opt_log_level = LOG_NOTICE;
 
+int opt_log_rate = 10;
+
 static void my_log_curses(int prio, const char *datetime, const char *str, bool force)
 {
 	if (opt_quiet && prio != LOG_ERR)
@@ -45,12 +47,30 @@ static void my_log_curses(int prio, const char *datetime, const char *str, bool
 	}
 }
 
-/* high-level logging function, based on global opt_log_level */
+/* Format the datetime prefix, only calling localtime() once per second */
+static void log_datetime(char *datetime, size_t siz, time_t when)
+{
+	static __thread time_t cache_time = -1;
+	static __thread char cache_datetime[64];
+	struct tm *tm;
 
-/*
- * log function
- */
-void _applog(int prio, const char *str, bool force)
+	if (when != cache_time) {
+		tm = localtime(&when);
+		snprintf(cache_datetime, sizeof(cache_datetime), " [%d-%02d-%02d %02d:%02d:%02d] ",
+			tm->tm_year + 1900,
+			tm->tm_mon + 1,
+			tm->tm_mday,
+			tm->tm_hour,
+			tm->tm_min,
+			tm->tm_sec);
+		cache_time = when;
+	}
+
+	strncpy(datetime, cache_datetime, siz);
+	datetime[siz - 1] = '\0';
+}
+
+static void log_output(int prio, const char *str, time_t when, bool simple, bool force)
 {
 #ifdef HAVE_SYSLOG_H
 	if (use_syslog) {
@@ -61,21 +81,11 @@ void _applog(int prio, const char *str, bool force)
 #endif
 	else {
 		char datetime[64];
-		struct timeval tv = {0, 0};
-		struct tm *tm;
 
-		cgtime(&tv);
-
-		const time_t tmp_time = tv.tv_sec;
-		tm = localtime(&tmp_time);
-
-		snprintf(datetime, sizeof(datetime), " [%d-%02d-%02d %02d:%02d:%02d] ",
-			tm->tm_year + 1900,
-			tm->tm_mon + 1,
-			tm->tm_mday,
-			tm->tm_hour,
-			tm->tm_min,
-			tm->tm_sec);
+		if (simple)
+			datetime[0] = '\0';
+		else
+			log_datetime(datetime, sizeof(datetime), when);
 
 		/* Only output to stderr if it's not going to the screen as well */
 		if (!isatty(fileno((FILE *)stderr))) {
@@ -87,22 +97,293 @@ void _applog(int prio, const char *str, bool force)
 	}
 }
 
-void _simplelog(int prio, const char *str, bool force)
+/*
+ * Asynchronous logging with --log-async
+ * Log messages are put in a fixed size lock free queue by any thread and
+ * written out by the log thread, so the caller never waits on the console,
+ * the log file or syslog
+ * This is a bounded multi producer queue where each slot has a sequence
+ * number that says whether it's free to write or ready to read
+ * If the queue is full the message is dropped and counted, and the log
+ * thread reports how many were dropped
+ * Messages that don't fit in a slot are written directly, after what's in
+ * the queue, as if --log-async wasn't used
+ * Forced messages (i.e. quit) are written directly without waiting for the
+ * queue
+ */
+bool opt_log_async = false;
+
+// Must be a power of 2
+#define LOGQ_SIZE 1024
+#define LOGQ_MASK (LOGQ_SIZE - 1)
+// Max time between checks of the queue if a wakeup is missed
+#define LOGQ_WAIT_mS 100
+
+struct logq_slot {
+	volatile unsigned int seq;
+	int prio;
+	bool simple;
+	time_t when;
+	char str[LOGBUFSIZ];
+};
+
+static struct logq_slot *logq;
+static volatile unsigned int logq_head;
+static unsigned int logq_tail;
+static volatile uint64_t logq_dropped;
+static uint64_t logq_dropped_reported;
+static bool logq_running;
+// The log thread is waiting and needs a wakeup
+static volatile bool logq_sleeping;
+static cgsem_t logq_sem;
+static pthread_mutex_t logq_lock;
+static pthread_t logq_thread;
+
+static bool logq_push(int prio, const char *str, time_t when, bool simple)
 {
-#ifdef HAVE_SYSLOG_H
-	if (use_syslog) {
-		syslog(LOG_LOCAL0 | prio, "%s", str);
+	struct logq_slot *slot;
+	unsigned int pos, seq;
+	size_t len;
+	int dif;
+
+	len = strlen(str);
+	if (len >= sizeof(slot->str))
+		return false;
+
+	pos = logq_head;
+	while (42) {
+		slot = &(logq[pos & LOGQ_MASK]);
+		seq = slot->seq;
+		__sync_synchronize();
+		dif = (int)(seq - pos);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&logq_head, pos, pos + 1))
+				break;
+		} else if (dif < 0) {
+			// Full
+			__sync_fetch_and_add(&logq_dropped, 1);
+			return true;
+		}
+		pos = logq_head;
 	}
-#else
-	if (0) {}
-#endif
-	else {
-		/* Only output to stderr if it's not going to the screen as well */
-		if (!isatty(fileno((FILE *)stderr))) {
-			fprintf(stderr, "%s\n", str);	/* atomic write to stderr */
-			fflush(stderr);
+
+	slot->prio = prio;
+	slot->simple = simple;
+	slot->when = when;
+	memcpy(slot->str, str, len + 1);
+	__sync_synchronize();
+	slot->seq = pos + 1;
+
+	/* The seq store must be visible before logq_sleeping is read, to pair
+	 * with logq_thr() setting it before checking the queue again,
+	 * otherwise both can miss the other and the wakeup is lost */
+	__sync_synchronize();
+	if (logq_sleeping && __sync_bool_compare_and_swap(&logq_sleeping, true, false))
+		cgsem_post(&logq_sem);
+
+	return true;
+}
+
+/* Write everything in the queue, returns false if it was empty
+ * Each message is taken off the queue under logq_lock but written after
+ * releasing it, so a console_lock held by a stuck thread can't also block
+ * anything waiting for logq_lock */
+static bool logq_drain(void)
+{
+	struct logq_slot *slot;
+	char str[LOGBUFSIZ];
+	uint64_t dropped;
+	bool did = false;
+	bool simple;
+	time_t when;
+	int prio;
+
+	while (42) {
+		mutex_lock(&logq_lock);
+		slot = &(logq[logq_tail & LOGQ_MASK]);
+		if (slot->seq != logq_tail + 1) {
+			mutex_unlock(&logq_lock);
+			break;
 		}
+		__sync_synchronize();
 
-		my_log_curses(prio, "", str, force);
+		prio = slot->prio;
+		simple = slot->simple;
+		when = slot->when;
+		strcpy(str, slot->str);
+
+		__sync_synchronize();
+		slot->seq = logq_tail + LOGQ_SIZE;
+		logq_tail++;
+		mutex_unlock(&logq_lock);
+
+		log_output(prio, str, when, simple, false);
+		did = true;
 	}
+
+	mutex_lock(&logq_lock);
+	dropped = logq_dropped - logq_dropped_reported;
+	logq_dropped_reported += dropped;
+	mutex_unlock(&logq_lock);
+
+	if (unlikely(dropped)) {
+		snprintf(str, sizeof(str), "Log queue full, dropped %"PRIu64" messages",
+			 dropped);
+		log_output(LOG_WARNING, str, time(NULL), false, false);
+	}
+
+	return did;
+}
+
+static void *logq_thr(void __maybe_unused *userdata)
+{
+	RenameThread("Log");
+
+	while (42) {
+		if (logq_drain())
+			continue;
+
+		/* Check again after flagging we are about to wait, in case
+		 * a message was added before it saw the flag */
+		logq_sleeping = true;
+		__sync_synchronize();
+		if (logq_drain()) {
+			logq_sleeping = false;
+			continue;
+		}
+
+		cgsem_mswait(&logq_sem, LOGQ_WAIT_mS);
+		logq_sleeping = false;
+	}
+
+	return NULL;
+}
+
+void log_async_start(void)
+{
+	unsigned int i;
+
+	if (!opt_log_async || logq_running)
+		return;
+
+	logq = calloc(LOGQ_SIZE, sizeof(*logq));
+	if (unlikely(!logq))
+		quithere(1, "Failed to calloc logq");
+	for (i = 0; i < LOGQ_SIZE; i++)
+		logq[i].seq = i;
+
+	cgsem_init(&logq_sem);
+	mutex_init(&logq_lock);
+
+	if (unlikely(pthread_create(&logq_thread, NULL, logq_thr, NULL)))
+		quit(1, "Failed to create log thread");
+	pthread_detach(logq_thread);
+
+	logq_running = true;
+}
+
+// Write out anything waiting, e.g. before exiting
+void log_async_flush(void)
+{
+	if (logq_running)
+		logq_drain();
+}
+
+// ratelog() call sites that have suppressed at least one message
+static struct lograte * volatile lograte_list;
+
+/* Returns true if a ratelog() message should be logged, and if so sets
+ * suppressed to how many from the same call site weren't logged since the
+ * last one that was. The counters are per second and updated without a lock,
+ * so the limit isn't exact when multiple threads share a call site */
+bool log_ratelimit(struct lograte *rate, int prio, const char *file,
+		   const char *func, const int line, int *suppressed)
+{
+	struct lograte *next;
+	time_t now;
+
+	*suppressed = 0;
+	if (opt_log_rate <= 0)
+		return true;
+
+	now = time(NULL);
+	if (now != rate->when) {
+		rate->when = now;
+		rate->count = 0;
+	}
+
+	if (__sync_fetch_and_add(&rate->count, 1) < opt_log_rate) {
+		*suppressed = __sync_lock_test_and_set(&rate->suppressed, 0);
+		return true;
+	}
+
+	__sync_fetch_and_add(&rate->suppressed, 1);
+
+	if (unlikely(!rate->listed) &&
+	    __sync_bool_compare_and_swap(&rate->listed, false, true)) {
+		rate->prio = prio;
+		rate->file = file;
+		rate->func = func;
+		rate->line = line;
+		do {
+			next = lograte_list;
+			rate->next = next;
+		} while (!__sync_bool_compare_and_swap(&lograte_list, next, rate));
+	}
+
+	return false;
+}
+
+/* Report counts held by call sites that suppressed messages in a second that
+ * has since passed, but haven't logged again to include them. Call sites are
+ * static and never leave the list, so it can be walked without a lock */
+void log_ratelimit_flush(void)
+{
+	struct lograte *rate;
+	time_t now;
+	int count;
+
+	now = time(NULL);
+	for (rate = lograte_list; rate; rate = rate->next) {
+		if (!rate->suppressed || rate->when == now)
+			continue;
+
+		count = __sync_lock_test_and_set(&rate->suppressed, 0);
+		if (count) {
+			applog(rate->prio, "%d similar messages suppressed"
+					   IN_FMT_FFL, count,
+					   rate->file, rate->func, rate->line);
+		}
+	}
+}
+
+/* high-level logging function, based on global opt_log_level */
+
+/*
+ * log function
+ */
+void _applog(int prio, const char *str, bool force)
+{
+	time_t now = time(NULL);
+
+	/* Forced messages don't flush the queue first since that would
+	 * wait on the console_lock the force is there to get past */
+	if (logq_running && !force) {
+		if (logq_push(prio, str, now, false))
+			return;
+		log_async_flush();
+	}
+
+	log_output(prio, str, now, false, force);
+}
+
+void _simplelog(int prio, const char *str, bool force)
+{
+	if (logq_running && !force) {
+		if (logq_push(prio, str, 0, true))
+			return;
+		log_async_flush();
+	}
+
+	log_output(prio, str, 0, true, force);
 }
@@ -4,6 +4,7 @@
 #include "config.h"
 #include <stdbool.h>
 #include <stdarg.h>
+#include <time.h>
 
 #ifdef HAVE_SYSLOG_H
 #include <syslog.h>
@@ -20,16 +21,41 @@ enum {
 /* debug flags */
 extern bool opt_debug;
 extern bool opt_log_output;
+extern bool opt_log_async;
 extern bool opt_realquiet;
 extern bool want_per_device_stats;
 
 /* global log_level, messages with lower or equal prio are logged */
 extern int opt_log_level;
 
+/* max messages per second from each ratelog() call site, 0 means no limit */
+extern int opt_log_rate;
+
 #define LOGBUFSIZ 256
 
 extern void _applog(int prio, const char *str, bool force);
 extern void _simplelog(int prio, const char *str, bool force);
+extern void log_async_start(void);
+extern void log_async_flush(void);
+
+/* ratelog() state, one per call site
+ * A call site is added to the flush list the first time it suppresses a
+ * message, so log_ratelimit_flush() can report counts it is still holding */
+struct lograte {
+	time_t when;
+	int count;
+	int suppressed;
+	bool listed;
+	int prio;
+	const char *file;
+	const char *func;
+	int line;
+	struct lograte *next;
+};
+
+extern bool log_ratelimit(struct lograte *rate, int prio, const char *file,
+			  const char *func, const int line, int *suppressed);
+extern void log_ratelimit_flush(void);
 
 #define IN_FMT_FFL " in %s %s():%d"
 
@@ -43,6 +69,28 @@ extern void _simplelog(int prio, const char *str, bool force);
 	} \
 } while (0)
 
+/* As applog() but for messages that can repeat at a high rate, e.g. per nonce
+ * or per packet. Each call site logs at most opt_log_rate messages a second,
+ * shared by every device using it, and the next message it logs includes how
+ * many were suppressed. If it doesn't log again, log_ratelimit_flush()
+ * reports them once their second has passed */
+#define ratelog(prio, fmt, ...) do { \
+	if (opt_debug || prio != LOG_DEBUG) { \
+		if (use_syslog || opt_log_output || prio <= opt_log_level) { \
+			static struct lograte lograte42; \
+			int suppressed42; \
+			if (log_ratelimit(&lograte42, prio, __FILE__, __func__, __LINE__, &suppressed42)) { \
+				char tmp42[LOGBUFSIZ]; \
+				int len42 = snprintf(tmp42, sizeof(tmp42), fmt, ##__VA_ARGS__); \
+				if (suppressed42 && len42 >= 0 && len42 < (int)sizeof(tmp42)) \
+					snprintf(tmp42 + len42, sizeof(tmp42) - len42, \
+						 " (%d similar suppressed)", suppressed42); \
+				_applog(prio, tmp42, false); \
+			} \
+		} \
+	} \
+} while (0)
+
 #define simplelog(prio, fmt, ...) do { \
 	if (opt_debug || prio != LOG_DEBUG) { \
 		if (use_syslog || opt_log_output || prio <= opt_log_level) { \
@@ -704,7 +704,17 @@ extern void _quit(int status);
  */
 #define LOCK_TRACKING 0
 
-#if LOCK_TRACKING
+/*
+ * Set this to non-zero to enable lock profiling
+ * Unlike LOCK_TRACKING this is cheap enough to leave enabled on a running miner
+ * Each thread keeps its own counters and wait/hold time histograms for each
+ * lock at each call site, without any shared locking, and the API lockstats
+ * command aggregates them across all threads when it is called
+ * LOCK_TRACKING takes precedence if both are enabled
+ */
+#define LOCK_PROFILING 0
+
+#if LOCK_TRACKING || LOCK_PROFILING
 enum cglock_typ {
 	CGLOCK_MUTEX,
 	CGLOCK_RW,
@@ -966,6 +976,8 @@ extern char *opt_kernel_path;
 extern char *opt_socks_proxy;
 extern char *cgminer_path;
 extern bool opt_fail_only;
+extern bool opt_extranonce_subscribe;
+extern bool opt_version_rolling;
 extern bool opt_lowmem;
 extern bool opt_autofan;
 extern bool opt_autoengine;
@@ -1026,6 +1038,7 @@ extern int opt_minion_chipreport;
 extern char *opt_minion_cores;
 extern char *opt_minion_freq;
 extern bool opt_minion_idlecount;
+extern bool opt_minion_interrupt;
 extern int opt_minion_ledcount;
 extern int opt_minion_ledlimit;
 extern bool opt_minion_noautofreq;
@@ -1046,8 +1059,10 @@ extern cgsem_t usb_resource_sem;
 extern bool opt_bfl_noncerange;
 #endif
 extern int swork_id;
+// Held when taking a new swork_id
+extern pthread_mutex_t sshare_lock;
 
-#if LOCK_TRACKING
+#if LOCK_TRACKING || LOCK_PROFILING
 extern pthread_mutex_t lockstat_lock;
 #endif
 
@@ -1111,6 +1126,7 @@ extern void get_intrange(char *arg, int *val1, int *val2);
 extern bool detect_stratum(struct pool *pool, char *url);
 extern void print_summary(void);
 extern void adjust_quota_gcd(void);
+extern void pool_split(struct pool *pool, double *target, double *actual);
 extern struct pool *add_pool(void);
 extern bool add_pool_details(struct pool *pool, bool live, char *url, char *user, char *pass);
 
@@ -1180,6 +1196,18 @@ struct stratum_work {
 #define RBUFSIZE 8192
 #define RECVSIZE (RBUFSIZE - 4)
 
+/* The parts of a solo mining template needed to rebuild a block from a work
+ * item's nonce2, kept for the template before the current one */
+struct gbt_block {
+	int id;
+	unsigned char *coinbase;
+	int coinbase_len;
+	int nonce2_offset;
+	int n2size;
+	unsigned char *txn_bin;
+	int txn_len;
+};
+
 struct pool {
 	int pool_no;
 	int prio;
@@ -1191,9 +1219,14 @@ struct pool {
 	char diff[8];
 	int quota;
 	int quota_gcd;
-	int quota_used;
 	int works;
 
+	/* Load-balance diff1 owed to this pool, and a rolling diff1 and its
+	 * last sample for reporting the actual split */
+	double drr_deficit;
+	double drr_rolling;
+	int64_t drr_last;
+
 	double diff_accepted;
 	double diff_rejected;
 	double diff_stale;
@@ -1242,6 +1275,10 @@ struct pool {
 	pthread_cond_t cr_cond;
 	struct list_head curlring;
 
+	/* Threads serving submit_q, see submit_work_push() */
+	int submit_threads;
+	int submit_idle;
+
 	time_t last_share_time;
 	double last_share_diff;
 	uint64_t best_diff;
@@ -1266,6 +1303,7 @@ struct pool {
 	unsigned char *nonce1bin;
 	uint64_t nonce2;
 	int n2size;
+	uint32_t version_mask; /* BIP310 version bits the pool allows rolled */
 	char *sessionid;
 	bool has_stratum;
 	bool stratum_active;
@@ -1277,6 +1315,7 @@ struct pool {
 	pthread_mutex_t stratum_lock;
 	struct thread_q *stratum_q;
 	int sshares; /* stratum shares submitted waiting on response */
+	int xnsub_id; /* id of mining.extranonce.subscribe awaiting a response */
 
 	/* GBT  variables */
 	bool has_gbt;
@@ -1290,17 +1329,21 @@ struct pool {
 	uint32_t gbt_version;
 	uint32_t curtime;
 	uint32_t gbt_bits;
-	unsigned char *txn_hashes;
+	unsigned char *txn_hashes; /* txids of txn_bin */
+	int *txn_ofs; /* offsets into txn_bin, transactions + 1 */
 	int gbt_txns;
 	int height;
 
 	bool gbt_solo;
+	int gbt_id;
+	struct gbt_block gbt_prev;
 	unsigned char merklebin[16 * 32];
 	int transactions;
-	char *txn_data;
+	unsigned char *txn_bin; /* All transactions, raw */
+	int txn_len;
 	unsigned char scriptsig_base[100];
 	unsigned char script_pubkey[25 + 3];
-	int nValue;
+	int64_t nValue;
 	CURL *gbt_curl;
 	bool gbt_curl_inuse;
 
@@ -1320,6 +1363,9 @@ struct pool {
 	struct timeval tv_lastwork;
 };
 
+/* The BIP320 general purpose version bits requested with mining.configure */
+#define VERSION_ROLL_MASK 0x1fffe000
+
 #define GETWORK_MODE_TESTPOOL 'T'
 #define GETWORK_MODE_POOL 'P'
 #define GETWORK_MODE_LP 'L'
@@ -1341,6 +1387,7 @@ struct work {
 
 	int		rolls;
 	int		drv_rolllimit; /* How much the driver can roll ntime */
+	uint32_t	version_mask; /* Header version bits that may be rolled */
 	uint32_t	nonce; /* For devices that hash sole work */
 
 	struct thr_info	*thr;
@@ -1365,9 +1412,16 @@ struct work {
 	double		sdiff;
 	char		*nonce1;
 
+	/* A work view shares the strings above with its master instead of
+	 * having its own copies, see copy_work_view() */
+	struct work	*master;
+	int		views; /* Number of views of a master */
+	char		view_ntime[12]; /* A view's own ntime if it differs */
+
 	bool		gbt;
 	char		*coinbase;
 	int		gbt_txns;
+	int		gbt_id; /* Solo template to rebuild the coinbase from */
 
 	unsigned int	work_block;
 	uint32_t	id;
@@ -1440,6 +1494,8 @@ extern bool submit_tested_work(struct thr_info *thr, struct work *work);
 extern bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce);
 extern bool submit_noffset_nonce(struct thr_info *thr, struct work *work, uint32_t nonce,
 			  int noffset);
+extern bool submit_version_nonce(struct thr_info *thr, struct work *work, uint32_t nonce,
+			  uint32_t version);
 extern int share_work_tdiff(struct cgpu_info *cgpu);
 extern struct work *get_work(struct thr_info *thr, const int thr_id);
 extern void __add_queued(struct cgpu_info *cgpu, struct work *work);
@@ -1500,6 +1556,9 @@ extern void _free_work(struct work *work);
 extern void set_work_ntime(struct work *work, int ntime);
 extern struct work *copy_work_noffset(struct work *base_work, int noffset);
 #define copy_work(work_in) copy_work_noffset(work_in, 0)
+extern struct work *copy_work_view(struct work *base_work, int noffset, int vroll);
+extern int work_vrolls(const struct work *work);
+extern struct work *copy_work_vroll(struct work *base_work, int vroll);
 extern uint64_t share_diff(const struct work *work);
 extern struct thr_info *get_thread(int thr_id);
 extern struct cgpu_info *get_devices(int id);
@@ -72,7 +72,7 @@ bool isdupnonce(struct cgpu_info *cgpu, struct work *work, uint32_t nonce)
 	while (unique && item) {
 		if (DATAN(item)->work_id == work->id && DATAN(item)->nonce == nonce) {
 			unique = false;
-			applog(LOG_WARNING, "%s%d: Duplicate nonce %08x",
+			ratelog(LOG_WARNING, "%s%d: Duplicate nonce %08x",
 					    cgpu->drv->name, cgpu->device_id, nonce);
 		} else
 			item = item->prev;
@@ -0,0 +1,755 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef WIN32
+#include <fcntl.h>
+#endif
+
+#include "miner.h"
+#include "proxy.h"
+
+int opt_stratum_server;
+char *opt_stratum_server_bind;
+
+// Most unsent data a client can have before it's dropped
+#define PROXY_SENDBUF_MAX (256 * 1024)
+// Max time a client thread waits before checking for unsent data
+#define PROXY_WAIT_mS 100
+
+struct proxy_client {
+	SOCKETTYPE sock;
+	// Extranonce1 suffix and index in clients[]
+	int prefix;
+	// Unique per connection, so a reused prefix doesn't get old replies
+	uint32_t cid;
+	bool subscribed;
+	char *worker;
+	char addr[32];
+	int accepted;
+	int rejected;
+	// Data not yet accepted by the socket, sent by the client's thread
+	char *sendbuf;
+	size_t sendlen;
+	size_t sendsiz;
+	bool dead;
+};
+
+// A client share sent upstream waiting for the pool's response
+struct proxy_share {
+	int id;
+	int prefix;
+	uint32_t cid;
+	json_t *client_id;
+	UT_hash_handle hh;
+};
+
+/* proxy_lock protects all of these, and is held while sending to any client
+ * so messages to a client are never interleaved */
+static pthread_mutex_t proxy_lock;
+static struct proxy_client *clients[PROXY_CLIENTS + 1];
+static struct proxy_share *proxy_shares;
+// The pool, nonce1 and n2size the subscribed clients' extranonce1 came from
+static struct pool *proxy_pool;
+static char *proxy_nonce1;
+static int proxy_n2size;
+static double proxy_diff;
+static unsigned int proxy_id = PROXY_ID_BASE;
+static uint32_t proxy_cids;
+
+// Must be entered under proxy_lock. Disconnect the client
+static void __client_drop(struct proxy_client *client)
+{
+	client->dead = true;
+	client->subscribed = false;
+	client->sendlen = 0;
+	shutdown(client->sock, SHUT_RDWR);
+}
+
+/* Must be entered under proxy_lock. Send what the socket will take now
+ * without waiting, the client's thread sends the rest when it can */
+static bool __client_flush(struct proxy_client *client)
+{
+	ssize_t sent;
+	size_t ssent = 0;
+
+	while (ssent < client->sendlen) {
+#ifdef __APPLE__
+		sent = send(client->sock, client->sendbuf + ssent, client->sendlen - ssent, SO_NOSIGPIPE);
+#elif WIN32
+		sent = send(client->sock, client->sendbuf + ssent, client->sendlen - ssent, 0);
+#else
+		sent = send(client->sock, client->sendbuf + ssent, client->sendlen - ssent, MSG_NOSIGNAL);
+#endif
+		if (sent < 0) {
+			if (interrupted())
+				continue;
+			if (sock_blocks())
+				break;
+			__client_drop(client);
+			return false;
+		}
+		ssent += sent;
+	}
+
+	client->sendlen -= ssent;
+	if (ssent && client->sendlen)
+		memmove(client->sendbuf, client->sendbuf + ssent, client->sendlen);
+	return true;
+}
+
+/* Must be entered under proxy_lock. This never waits on the client, since
+ * it's also called from the pool's stratum thread, so messages are queued
+ * and a client that falls too far behind is shut down, which its thread
+ * sees as a disconnect */
+static bool __client_send(struct proxy_client *client, json_t *val)
+{
+	size_t len;
+	char *s;
+
+	if (client->dead)
+		return false;
+
+	s = json_dumps(val, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if (unlikely(!s))
+		return false;
+
+	if (opt_protocol)
+		applog(LOG_DEBUG, "Stratum server client %d SEND: %s", client->prefix, s);
+
+	len = strlen(s);
+	if (client->sendlen + len + 1 > PROXY_SENDBUF_MAX) {
+		free(s);
+		applog(LOG_INFO, "Stratum server client %d not keeping up, dropping it",
+		       client->prefix);
+		__client_drop(client);
+		return false;
+	}
+	if (client->sendlen + len + 1 > client->sendsiz) {
+		client->sendsiz = client->sendlen + len + 1 + RBUFSIZE;
+		client->sendbuf = realloc(client->sendbuf, client->sendsiz);
+		if (unlikely(!client->sendbuf))
+			quithere(1, "Failed to realloc client sendbuf");
+	}
+	memcpy(client->sendbuf + client->sendlen, s, len);
+	client->sendlen += len;
+	client->sendbuf[client->sendlen++] = '\n';
+	free(s);
+
+	return __client_flush(client);
+}
+
+static void proxy_noblock(SOCKETTYPE fd)
+{
+#ifndef WIN32
+	int flags = fcntl(fd, F_GETFL, 0);
+
+	fcntl(fd, F_SETFL, O_NONBLOCK | flags);
+#else
+	u_long flags = 1;
+
+	ioctlsocket(fd, FIONBIO, &flags);
+#endif
+}
+
+// Reply to a client request, result and error are stolen
+static void client_reply(struct proxy_client *client, json_t *id, json_t *result, json_t *error)
+{
+	json_t *val;
+
+	val = json_object();
+	json_object_set(val, "id", id ? id : json_null());
+	json_object_set_new(val, "result", result ? result : json_null());
+	json_object_set_new(val, "error", error ? error : json_null());
+
+	mutex_lock(&proxy_lock);
+	__client_send(client, val);
+	mutex_unlock(&proxy_lock);
+
+	json_decref(val);
+}
+
+static bool proxy_hex(const char *s)
+{
+	if (!*s || strlen(s) % 2)
+		return false;
+	return strspn(s, "0123456789abcdefABCDEF") == strlen(s);
+}
+
+static json_t *proxy_error(int code, const char *msg)
+{
+	return json_pack("[isn]", code, msg);
+}
+
+static json_t *proxy_difficulty(double diff)
+{
+	return json_pack("{snsss[f]}", "id", "method", "mining.set_difficulty",
+			 "params", diff);
+}
+
+/* Build the pool's current job as a mining.notify with the client's part of
+ * the coinbase, i.e. without the nonce1 and nonce2 */
+static json_t *proxy_job(struct pool *pool, bool clean)
+{
+	json_t *val, *branch;
+	int i, cb1_len, cb2_ofs;
+	char *cb1, *cb2, hex[68];
+
+	branch = json_array();
+
+	cg_rlock(&pool->data_lock);
+	cb1_len = pool->nonce2_offset - pool->n1_len;
+	cb2_ofs = pool->nonce2_offset + pool->n2size;
+	cb1 = bin2hex(pool->coinbase, cb1_len);
+	cb2 = bin2hex(pool->coinbase + cb2_ofs, pool->coinbase_len - cb2_ofs);
+	for (i = 0; i < pool->merkles; i++) {
+		__bin2hex(hex, pool->swork.merkle_bin[i], 32);
+		json_array_append_new(branch, json_string(hex));
+	}
+	val = json_pack("{snsss[ssssosssb]}", "id", "method", "mining.notify",
+			"params", pool->swork.job_id, pool->prev_hash, cb1, cb2,
+			branch, pool->bbversion, pool->nbit, pool->ntime,
+			clean || pool->swork.clean);
+	cg_runlock(&pool->data_lock);
+
+	free(cb2);
+	free(cb1);
+
+	return val;
+}
+
+/* Must be entered under proxy_lock. Disconnect every client except keep,
+ * which may be NULL, and forget their shares since replies can't be sent */
+static void __proxy_drop(struct proxy_client *keep, const char *why)
+{
+	struct proxy_share *share, *tmp;
+	int i, count = 0;
+
+	for (i = 1; i <= PROXY_CLIENTS; i++) {
+		if (clients[i] && clients[i] != keep) {
+			__client_drop(clients[i]);
+			count++;
+		}
+	}
+
+	HASH_ITER(hh, proxy_shares, share, tmp) {
+		if (!keep || share->prefix != keep->prefix) {
+			HASH_DEL(proxy_shares, share);
+			json_decref(share->client_id);
+			free(share);
+		}
+	}
+
+	if (count)
+		applog(LOG_NOTICE, "Stratum server dropping %d client%s: %s",
+		       count, count == 1 ? "" : "s", why);
+}
+
+static void proxy_subscribe(struct proxy_client *client, json_t *id)
+{
+	struct pool *pool = current_pool();
+	json_t *result, *diff, *job;
+	char *nonce1 = NULL, *en1;
+	int n2size = 0;
+	bool ok;
+
+	if (pool->has_stratum && pool->stratum_notify) {
+		cg_rlock(&pool->data_lock);
+		if (pool->nonce1 && pool->coinbase)
+			nonce1 = strdup(pool->nonce1);
+		n2size = pool->n2size;
+		cg_runlock(&pool->data_lock);
+	}
+	if (!nonce1 || n2size < PROXY_N2_MIN) {
+		free(nonce1);
+		applog(LOG_INFO, "Stratum server client %d subscribe with no usable stratum pool",
+		       client->prefix);
+		client_reply(client, id, NULL, proxy_error(20, "No stratum work available"));
+		return;
+	}
+
+	mutex_lock(&proxy_lock);
+	if (pool != proxy_pool || !proxy_nonce1 || strcmp(nonce1, proxy_nonce1) ||
+	    n2size != proxy_n2size) {
+		__proxy_drop(client, "upstream pool changed");
+		proxy_pool = pool;
+		free(proxy_nonce1);
+		proxy_nonce1 = nonce1;
+		proxy_n2size = n2size;
+		proxy_diff = pool->sdiff;
+	} else
+		free(nonce1);
+
+	en1 = malloc(strlen(proxy_nonce1) + 3);
+	if (unlikely(!en1))
+		quithere(1, "Failed to malloc en1");
+	sprintf(en1, "%s%02x", proxy_nonce1, client->prefix);
+	result = json_pack("[[[ss]]si]", "mining.notify", en1, en1, n2size - 1);
+	free(en1);
+
+	job = json_pack("{sososn}", "id", id ? json_incref(id) : json_null(),
+			"result", result, "error");
+	ok = __client_send(client, job);
+	json_decref(job);
+	if (!ok) {
+		mutex_unlock(&proxy_lock);
+		applog(LOG_INFO, "Stratum server client %d subscribe reply failed",
+		       client->prefix);
+		return;
+	}
+
+	client->subscribed = true;
+	diff = proxy_difficulty(proxy_diff);
+	__client_send(client, diff);
+	json_decref(diff);
+	job = proxy_job(pool, true);
+	__client_send(client, job);
+	json_decref(job);
+	mutex_unlock(&proxy_lock);
+
+	applog(LOG_INFO, "Stratum server client %d subscribed to pool %d",
+	       client->prefix, pool->pool_no);
+}
+
+static void proxy_submit(struct proxy_client *client, json_t *id, json_t *params)
+{
+	const char *job_id, *nonce2, *ntime, *nonce;
+	struct proxy_share *share;
+	struct pool *pool;
+	char upnonce2[40];
+	json_t *val;
+	int n2size, id_share;
+	char *s;
+	bool ok;
+
+	job_id = json_string_value(json_array_get(params, 1));
+	nonce2 = json_string_value(json_array_get(params, 2));
+	ntime = json_string_value(json_array_get(params, 3));
+	nonce = json_string_value(json_array_get(params, 4));
+
+	mutex_lock(&proxy_lock);
+	pool = proxy_pool;
+	n2size = proxy_n2size;
+	ok = (client->subscribed && pool);
+	mutex_unlock(&proxy_lock);
+	if (!ok) {
+		client_reply(client, id, NULL, proxy_error(25, "Not subscribed"));
+		return;
+	}
+
+	if (!job_id || !nonce2 || !ntime || !nonce ||
+	    (int)strlen(nonce2) != (n2size - 1) * 2 ||
+	    !proxy_hex(nonce2) || !proxy_hex(ntime) || !proxy_hex(nonce)) {
+		client_reply(client, id, NULL, proxy_error(20, "Invalid share"));
+		return;
+	}
+
+	// The client's nonce2 follows its extranonce1 suffix in the pool's
+	snprintf(upnonce2, sizeof(upnonce2), "%02x%s", client->prefix, nonce2);
+
+	share = calloc(1, sizeof(*share));
+	if (unlikely(!share))
+		quithere(1, "Failed to calloc proxy share");
+	share->prefix = client->prefix;
+	share->cid = client->cid;
+	share->client_id = id ? json_incref(id) : json_null();
+
+	/* Once the share is in proxy_shares, a pool change or the pool's reply
+	 * can free it, so it's only published after the request is built and
+	 * is looked up again by id if the send fails */
+	mutex_lock(&proxy_lock);
+	id_share = (int)proxy_id++;
+	if (unlikely(proxy_id > INT_MAX))
+		proxy_id = PROXY_ID_BASE;
+	val = json_pack("{s[sssss]siss}", "params", pool->rpc_user, job_id, upnonce2,
+			ntime, nonce, "id", id_share, "method", "mining.submit");
+	s = json_dumps(val, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	json_decref(val);
+	if (likely(s)) {
+		share->id = id_share;
+		HASH_ADD_INT(proxy_shares, id, share);
+	}
+	mutex_unlock(&proxy_lock);
+
+	if (unlikely(!s)) {
+		json_decref(share->client_id);
+		free(share);
+		client_reply(client, id, NULL, proxy_error(20, "Invalid share"));
+		return;
+	}
+
+	ratelog(LOG_INFO, "Stratum server submitting share from client %d %s to pool %d",
+		client->prefix, client->worker ? client->worker : "", pool->pool_no);
+
+	if (unlikely(!stratum_send(pool, s, strlen(s)))) {
+		mutex_lock(&proxy_lock);
+		HASH_FIND_INT(proxy_shares, &id_share, share);
+		if (share)
+			HASH_DEL(proxy_shares, share);
+		mutex_unlock(&proxy_lock);
+		if (share) {
+			json_decref(share->client_id);
+			free(share);
+		}
+		client_reply(client, id, NULL, proxy_error(20, "Upstream pool unavailable"));
+	}
+	free(s);
+}
+
+static void proxy_method(struct proxy_client *client, char *s)
+{
+	json_t *val, *id, *params;
+	const char *method;
+	json_error_t err;
+
+	if (opt_protocol)
+		applog(LOG_DEBUG, "Stratum server client %d RECVD: %s", client->prefix, s);
+
+	val = JSON_LOADS(s, &err);
+	if (!val) {
+		applog(LOG_INFO, "Stratum server client %d JSON decode failed(%d): %s",
+		       client->prefix, err.line, err.text);
+		return;
+	}
+
+	id = json_object_get(val, "id");
+	params = json_object_get(val, "params");
+	method = json_string_value(json_object_get(val, "method"));
+	if (!method)
+		goto out;
+
+	if (!strcmp(method, "mining.submit"))
+		proxy_submit(client, id, params);
+	else if (!strcmp(method, "mining.subscribe"))
+		proxy_subscribe(client, id);
+	else if (!strcmp(method, "mining.authorize")) {
+		const char *worker = json_string_value(json_array_get(params, 0));
+
+		if (worker) {
+			free(client->worker);
+			client->worker = strdup(worker);
+		}
+		client_reply(client, id, json_true(), NULL);
+	} else if (!strcmp(method, "mining.extranonce.subscribe")) {
+		/* Clients are dropped rather than sent a new extranonce1 if
+		 * the pool changes */
+		client_reply(client, id, json_false(), NULL);
+	} else
+		client_reply(client, id, NULL, proxy_error(20, "Unsupported method"));
+out:
+	json_decref(val);
+}
+
+static void *proxy_client_thread(void *userdata)
+{
+	struct proxy_client *client = (struct proxy_client *)userdata;
+	char threadname[16], *buf, *nl;
+	int buflen = 0, len;
+
+	pthread_detach(pthread_self());
+
+	snprintf(threadname, sizeof(threadname), "StratumC%d", client->prefix);
+	RenameThread(threadname);
+
+	buf = malloc(RBUFSIZE);
+	if (unlikely(!buf))
+		quithere(1, "Failed to malloc client buf");
+
+	while (42) {
+		struct timeval timeout = {0, PROXY_WAIT_mS * 1000};
+		fd_set rd, wd;
+		bool unsent;
+		int n;
+
+		mutex_lock(&proxy_lock);
+		unsent = (client->sendlen > 0);
+		mutex_unlock(&proxy_lock);
+
+		FD_ZERO(&rd);
+		FD_SET(client->sock, &rd);
+		FD_ZERO(&wd);
+		if (unsent)
+			FD_SET(client->sock, &wd);
+		n = select(client->sock + 1, &rd, unsent ? &wd : NULL, NULL, &timeout);
+		if (n < 0) {
+			if (interrupted())
+				continue;
+			break;
+		}
+
+		if (unsent && FD_ISSET(client->sock, &wd)) {
+			mutex_lock(&proxy_lock);
+			__client_flush(client);
+			mutex_unlock(&proxy_lock);
+		}
+
+		if (!FD_ISSET(client->sock, &rd))
+			continue;
+
+		len = recv(client->sock, buf + buflen, RBUFSIZE - 1 - buflen, 0);
+		if (len <= 0) {
+			if (len < 0 && (interrupted() || sock_blocks()))
+				continue;
+			break;
+		}
+		buflen += len;
+		buf[buflen] = '\0';
+
+		while ((nl = strchr(buf, '\n'))) {
+			*nl++ = '\0';
+			if (*buf)
+				proxy_method(client, buf);
+			buflen -= nl - buf;
+			memmove(buf, nl, buflen + 1);
+		}
+
+		if (unlikely(buflen >= RBUFSIZE - 1)) {
+			applog(LOG_INFO, "Stratum server client %d sent an overlong line",
+			       client->prefix);
+			break;
+		}
+	}
+
+	mutex_lock(&proxy_lock);
+	clients[client->prefix] = NULL;
+	mutex_unlock(&proxy_lock);
+	CLOSESOCKET(client->sock);
+
+	applog(LOG_NOTICE, "Stratum server client %d %s disconnected, %d accepted %d rejected",
+	       client->prefix, client->addr, client->accepted, client->rejected);
+
+	free(buf);
+	free(client->sendbuf);
+	free(client->worker);
+	free(client);
+
+	return NULL;
+}
+
+/* Called after each mining.notify or mining.set_extranonce from a pool to send
+ * the new job to the clients if they are on that pool, or move them to it if
+ * it's now the current pool */
+void proxy_notify(struct pool *pool)
+{
+	struct proxy_client *client;
+	json_t *diff = NULL, *job;
+	bool same;
+	int i;
+
+	if (!opt_stratum_server)
+		return;
+
+	mutex_lock(&proxy_lock);
+	if (pool != proxy_pool) {
+		if (proxy_pool && pool == current_pool()) {
+			__proxy_drop(NULL, "switching upstream pool");
+			proxy_pool = NULL;
+		}
+		goto out;
+	}
+
+	cg_rlock(&pool->data_lock);
+	same = (pool->nonce1 && proxy_nonce1 && !strcmp(pool->nonce1, proxy_nonce1) &&
+		pool->n2size == proxy_n2size);
+	cg_runlock(&pool->data_lock);
+	if (!same) {
+		__proxy_drop(NULL, "upstream extranonce1 changed");
+		proxy_pool = NULL;
+		goto out;
+	}
+
+	if (pool->sdiff != proxy_diff) {
+		proxy_diff = pool->sdiff;
+		diff = proxy_difficulty(proxy_diff);
+	}
+	job = proxy_job(pool, false);
+	for (i = 1; i <= PROXY_CLIENTS; i++) {
+		client = clients[i];
+		if (!client || !client->subscribed)
+			continue;
+		if (diff && !__client_send(client, diff))
+			continue;
+		__client_send(client, job);
+	}
+	json_decref(job);
+	if (diff)
+		json_decref(diff);
+out:
+	mutex_unlock(&proxy_lock);
+}
+
+/* Called with every stratum response, returns true if it was for a client
+ * share, after passing the pool's result on to the client */
+bool proxy_response(struct pool *pool, int id, json_t *res_val, json_t *err_val)
+{
+	struct proxy_client *client = NULL;
+	struct proxy_share *share;
+	bool accepted;
+	json_t *val;
+
+	if (!opt_stratum_server || id < PROXY_ID_BASE)
+		return false;
+
+	accepted = json_is_true(res_val);
+
+	mutex_lock(&proxy_lock);
+	HASH_FIND_INT(proxy_shares, &id, share);
+	if (share) {
+		HASH_DEL(proxy_shares, share);
+		client = clients[share->prefix];
+		if (client && client->cid == share->cid) {
+			val = json_pack("{sOsOsO}", "id", share->client_id,
+					"result", res_val ? res_val : json_null(),
+					"error", err_val ? err_val : json_null());
+			__client_send(client, val);
+			json_decref(val);
+			if (accepted)
+				client->accepted++;
+			else
+				client->rejected++;
+		} else
+			client = NULL;
+	}
+	mutex_unlock(&proxy_lock);
+
+	if (!share) {
+		applog(LOG_INFO, "Pool %d response to unknown stratum server share %d",
+		       pool->pool_no, id);
+		return true;
+	}
+
+	if (client) {
+		applog(LOG_INFO, "%s stratum server client %d share on pool %d",
+		       accepted ? "Accepted" : "Rejected", share->prefix, pool->pool_no);
+	} else {
+		applog(LOG_INFO, "Pool %d %s share from disconnected stratum server client %d",
+		       pool->pool_no, accepted ? "accepted" : "rejected", share->prefix);
+	}
+
+	json_decref(share->client_id);
+	free(share);
+	return true;
+}
+
+static void *proxy_thread(void __maybe_unused *userdata)
+{
+	struct sockaddr_in serv, cli;
+	const char *bindaddr = opt_stratum_server_bind ? opt_stratum_server_bind : PROXY_BIND;
+	struct proxy_client *client;
+	SOCKETTYPE sock, c;
+	socklen_t clisiz;
+	pthread_t pth;
+	int i, optval;
+
+	pthread_detach(pthread_self());
+
+	RenameThread("StratumServer");
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock == INVSOCK) {
+		applog(LOG_ERR, "Stratum server socket failed (%s)", SOCKERRMSG);
+		return NULL;
+	}
+
+	memset(&serv, 0, sizeof(serv));
+	serv.sin_family = AF_INET;
+	serv.sin_addr.s_addr = inet_addr(bindaddr);
+	if (serv.sin_addr.s_addr == INADDR_NONE) {
+		applog(LOG_ERR, "Stratum server invalid bind address '%s'", bindaddr);
+		CLOSESOCKET(sock);
+		return NULL;
+	}
+	serv.sin_port = htons(opt_stratum_server);
+
+	optval = 1;
+	if (SOCKETFAIL(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *)(&optval), sizeof(optval))))
+		applog(LOG_DEBUG, "Stratum server setsockopt SO_REUSEADDR failed (ignored): %s", SOCKERRMSG);
+
+	if (SOCKETFAIL(bind(sock, (struct sockaddr *)(&serv), sizeof(serv)))) {
+		applog(LOG_ERR, "Stratum server bind to %s port %d failed (%s)",
+		       bindaddr, opt_stratum_server, SOCKERRMSG);
+		CLOSESOCKET(sock);
+		return NULL;
+	}
+
+	if (SOCKETFAIL(listen(sock, PROXY_CLIENTS))) {
+		applog(LOG_ERR, "Stratum server listen on port %d failed (%s)",
+		       opt_stratum_server, SOCKERRMSG);
+		CLOSESOCKET(sock);
+		return NULL;
+	}
+
+	applog(LOG_WARNING, "Stratum server listening on %s port %d", bindaddr, opt_stratum_server);
+
+	while (42) {
+		clisiz = sizeof(cli);
+		c = accept(sock, (struct sockaddr *)(&cli), &clisiz);
+		if (SOCKETFAIL(c)) {
+			if (!interrupted()) {
+				applog(LOG_ERR, "Stratum server accept failed (%s)", SOCKERRMSG);
+				cgsleep_ms(1000);
+			}
+			continue;
+		}
+
+		client = calloc(1, sizeof(*client));
+		if (unlikely(!client))
+			quithere(1, "Failed to calloc proxy client");
+		client->sock = c;
+		proxy_noblock(c);
+		snprintf(client->addr, sizeof(client->addr), "%s:%d",
+			 inet_ntoa(cli.sin_addr), (int)ntohs(cli.sin_port));
+
+		mutex_lock(&proxy_lock);
+		for (i = 1; i <= PROXY_CLIENTS; i++) {
+			if (!clients[i]) {
+				clients[i] = client;
+				client->prefix = i;
+				client->cid = ++proxy_cids;
+				break;
+			}
+		}
+		mutex_unlock(&proxy_lock);
+
+		if (!client->prefix) {
+			applog(LOG_WARNING, "Stratum server full, refusing %s", client->addr);
+			CLOSESOCKET(c);
+			free(client);
+			continue;
+		}
+
+		applog(LOG_NOTICE, "Stratum server client %d connected from %s",
+		       client->prefix, client->addr);
+
+		if (unlikely(pthread_create(&pth, NULL, proxy_client_thread, (void *)client))) {
+			applog(LOG_ERR, "Stratum server failed to create client thread");
+			mutex_lock(&proxy_lock);
+			clients[client->prefix] = NULL;
+			mutex_unlock(&proxy_lock);
+			CLOSESOCKET(c);
+			free(client);
+		}
+	}
+
+	return NULL;
+}
+
+void proxy_start(void)
+{
+	pthread_t pth;
+
+	mutex_init(&proxy_lock);
+
+	if (unlikely(pthread_create(&pth, NULL, proxy_thread, NULL)))
+		quit(1, "Failed to create stratum server thread");
+}
@@ -0,0 +1,41 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include "miner.h"
+
+/*
+ * The stratum server hands out work from the current stratum pool to LAN
+ * clients, forwarding their shares upstream on cgminer's own connection
+ * Each client is given one byte of the pool's nonce2 appended to the pool's
+ * nonce1 as its extranonce1, and cgminer keeps that byte zero in its own
+ * work, so the pool's nonce2 size must be at least PROXY_N2_MIN to leave
+ * each client a 2 byte nonce2
+ */
+#define PROXY_N2_MIN 3
+// Client extranonce1 suffixes are 1 to PROXY_CLIENTS
+#define PROXY_CLIENTS 255
+// cgminer's own work uses this suffix
+#define PROXY_PREFIX_LOCAL 0
+// Upstream ids for forwarded shares start here to not clash with cgminer's
+#define PROXY_ID_BASE 0x40000000
+
+// Default address to listen on, there's no authentication of clients
+#define PROXY_BIND "127.0.0.1"
+
+// Port to listen on, 0 = disabled
+extern int opt_stratum_server;
+// Address to listen on, NULL = PROXY_BIND
+extern char *opt_stratum_server_bind;
+
+extern void proxy_start(void);
+extern void proxy_notify(struct pool *pool);
+extern bool proxy_response(struct pool *pool, int id, json_t *res_val, json_t *err_val);
+
+#endif /* PROXY_H */
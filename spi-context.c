@@ -92,3 +92,54 @@ extern bool spi_transfer(struct spi_ctx *ctx, uint8_t *txbuf,
 
 	return ret > 0;
 }
+
+extern void spi_batch_reset(struct spi_batch *batch)
+{
+	batch->count = 0;
+	batch->bytes = 0;
+}
+
+extern bool spi_batch_add(struct spi_batch *batch, uint8_t *txbuf,
+			  uint8_t *rxbuf, uint32_t len, uint32_t speed,
+			  uint16_t delay, bool cs_change)
+{
+	struct spi_ioc_transfer *xfr;
+
+	if (batch->count >= SPI_BATCH_MAX ||
+	    batch->bytes + len > SPI_BATCH_BYTES)
+		return false;
+
+	xfr = &(batch->xfr[batch->count++]);
+	memset(xfr, 0, sizeof(*xfr));
+	xfr->tx_buf = (unsigned long)txbuf;
+	xfr->rx_buf = (unsigned long)rxbuf;
+	xfr->len = len;
+	xfr->speed_hz = speed;
+	xfr->delay_usecs = delay;
+	xfr->cs_change = cs_change ? 1 : 0;
+	batch->bytes += len;
+
+	return true;
+}
+
+extern int spi_batch_submit(int fd, struct spi_batch *batch)
+{
+	int ret;
+
+	if (batch->count == 0)
+		return 0;
+
+	/* cs_change on the last transfer would leave the device selected */
+	batch->xfr[batch->count - 1].cs_change = 0;
+
+	ret = ioctl(fd, SPI_IOC_MESSAGE(batch->count), (void *)(batch->xfr));
+
+	batch->ioctls++;
+	batch->xfrs += batch->count;
+	if (ret > 0)
+		batch->total_bytes += ret;
+
+	spi_batch_reset(batch);
+
+	return ret;
+}
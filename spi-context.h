@@ -45,4 +45,38 @@ extern void spi_exit(struct spi_ctx *ctx);
 extern bool spi_transfer(struct spi_ctx *ctx, uint8_t *txbuf,
 			 uint8_t *rxbuf, int len);
 
+/*
+ * SPI transaction builder
+ * Queue up several transfers and send them all with one
+ * SPI_IOC_MESSAGE(n) ioctl, rather than one ioctl per transfer
+ * spidev limits the total bytes of one message to its bufsiz,
+ * 4096 by default, so spi_batch_add() refuses anything past that
+ * Buffers must remain valid until spi_batch_submit() returns
+ */
+#define SPI_BATCH_MAX		128
+#define SPI_BATCH_BYTES		4096
+
+struct spi_batch {
+	struct spi_ioc_transfer xfr[SPI_BATCH_MAX];
+	int count;
+	uint32_t bytes;
+
+	/* totals of all submitted batches */
+	uint64_t ioctls;
+	uint64_t xfrs;
+	uint64_t total_bytes;
+};
+
+/* clear the queued transfers, keeps the totals */
+extern void spi_batch_reset(struct spi_batch *batch);
+/* queue a transfer, false if the batch is full
+ * cs_change deselects the device after this transfer, as if it
+ * had been sent with its own ioctl */
+extern bool spi_batch_add(struct spi_batch *batch, uint8_t *txbuf,
+			  uint8_t *rxbuf, uint32_t len, uint32_t speed,
+			  uint16_t delay, bool cs_change);
+/* send all queued transfers on fd and reset the batch
+ * returns the ioctl() result i.e. total bytes or < 0 on error */
+extern int spi_batch_submit(int fd, struct spi_batch *batch);
+
 #endif /* SPI_CONTEXT_H */
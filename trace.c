@@ -0,0 +1,211 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux
+#include <sys/prctl.h>
+#endif
+
+#include "miner.h"
+#include "trace.h"
+
+#if WORK_TRACING
+
+typedef struct trace_ev {
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+	int64_t arg;
+} TRACE_EV;
+
+/* Only the owning thread ever writes to a ring, and head is only advanced
+ * after the event is complete, so a reader copies the events then discards
+ * any that may have been overwritten while it was copying */
+typedef struct trace_ring {
+	TRACE_EV ev[TRACE_EVENTS];
+	volatile uint64_t head;
+	int tid;
+	char name[17];
+	struct trace_ring *next;
+} TRACE_RING;
+
+static __thread TRACE_RING *trace_ring;
+static TRACE_RING *trace_head;
+static int trace_tids;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+// Called when a thread with a ring exits, to unlink and free it
+static void trace_ring_free(void *arg)
+{
+	TRACE_RING *ring = (TRACE_RING *)arg, **prev;
+
+	pthread_mutex_lock(&trace_lock);
+	for (prev = &trace_head; *prev; prev = &((*prev)->next)) {
+		if (*prev == ring) {
+			*prev = ring->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&trace_lock);
+
+	trace_ring = NULL;
+	free(ring);
+}
+
+static void trace_key_init(void)
+{
+	if (unlikely(pthread_key_create(&trace_key, trace_ring_free)))
+		quithere(1, "Failed to create trace key");
+}
+
+uint64_t trace_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	cgtime(&tv);
+	return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000ULL;
+#endif
+}
+
+static TRACE_RING *trace_myring(void)
+{
+	TRACE_RING *ring = trace_ring;
+
+	if (unlikely(!ring)) {
+		ring = calloc(1, sizeof(*ring));
+		if (unlikely(!ring))
+			quithere(1, "OOM trace ring");
+
+		pthread_once(&trace_once, trace_key_init);
+
+		pthread_mutex_lock(&trace_lock);
+		ring->tid = ++trace_tids;
+		ring->next = trace_head;
+		trace_head = ring;
+		pthread_mutex_unlock(&trace_lock);
+
+		trace_ring = ring;
+		pthread_setspecific(trace_key, ring);
+	}
+
+	return ring;
+}
+
+void trace_event(const char *name, uint64_t start, int64_t arg)
+{
+	TRACE_RING *ring = trace_myring();
+	TRACE_EV *ev;
+
+	ev = &(ring->ev[ring->head & (TRACE_EVENTS - 1)]);
+	ev->name = name;
+	ev->end = trace_ns();
+	ev->start = start ? start : ev->end;
+	ev->arg = arg;
+	__sync_synchronize();
+	ring->head++;
+
+	/* Threads are usually renamed after they start so get the name
+	 * after the first event rather than when the ring is created */
+	if (unlikely(ring->head == 1)) {
+#if defined(PR_GET_NAME)
+		prctl(PR_GET_NAME, ring->name, 0, 0, 0);
+#else
+		snprintf(ring->name, sizeof(ring->name), "Thread %d", ring->tid);
+#endif
+	}
+}
+
+static void trace_us(char *buf, size_t siz, uint64_t ns)
+{
+	snprintf(buf, siz, "%"PRIu64".%03d", ns / 1000, (int)(ns % 1000));
+}
+
+/* Write every thread's events in Chrome trace event JSON format
+ * Returns the number of events written */
+int trace_write(FILE *fout)
+{
+	char ts[32], dur[32];
+	TRACE_EV *copy, *ev;
+	TRACE_RING *ring, *head;
+	uint64_t h1, h2, first, i;
+	int pid = (int)getpid();
+	int count = 0;
+	bool comma = false;
+
+	copy = malloc(sizeof(*copy) * TRACE_EVENTS);
+	if (unlikely(!copy))
+		quithere(1, "OOM trace copy");
+
+	fprintf(fout, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	// Hold trace_lock so no ring is freed by its thread exiting while in use
+	pthread_mutex_lock(&trace_lock);
+	head = trace_head;
+	for (ring = head; ring; ring = ring->next) {
+		h1 = ring->head;
+		__sync_synchronize();
+		first = (h1 > TRACE_EVENTS) ? (h1 - TRACE_EVENTS) : 0;
+		for (i = first; i < h1; i++)
+			copy[i & (TRACE_EVENTS - 1)] = ring->ev[i & (TRACE_EVENTS - 1)];
+		__sync_synchronize();
+		h2 = ring->head;
+
+		/* Anything up to h2 - TRACE_EVENTS may have been overwritten during
+		 * the copy, including the slot for h2 that may be mid write */
+		if (h2 >= TRACE_EVENTS && first < h2 - TRACE_EVENTS + 1)
+			first = h2 - TRACE_EVENTS + 1;
+
+		if (h1 == 0)
+			continue;
+
+		fprintf(fout, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+			      "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			      comma ? "," : "", pid, ring->tid, ring->name);
+		comma = true;
+
+		for (i = first; i < h1; i++) {
+			ev = &(copy[i & (TRACE_EVENTS - 1)]);
+			trace_us(ts, sizeof(ts), ev->start);
+			if (ev->end == ev->start) {
+				fprintf(fout, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+					      "\"ts\":%s,\"pid\":%d,\"tid\":%d,"
+					      "\"args\":{\"arg\":%"PRId64"}}",
+					      ev->name, ts, pid, ring->tid, ev->arg);
+			} else {
+				trace_us(dur, sizeof(dur), ev->end - ev->start);
+				fprintf(fout, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%s,"
+					      "\"dur\":%s,\"pid\":%d,\"tid\":%d,"
+					      "\"args\":{\"arg\":%"PRId64"}}",
+					      ev->name, ts, dur, pid, ring->tid, ev->arg);
+			}
+			count++;
+		}
+	}
+	pthread_mutex_unlock(&trace_lock);
+
+	fprintf(fout, "]}\n");
+
+	free(copy);
+
+	return count;
+}
+#endif
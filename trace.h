@@ -0,0 +1,47 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Set this to non-zero to compile in the hot path timing trace
+ * Each thread records timestamped events in its own ring buffer with no
+ * locking, keeping only the most recent TRACE_EVENTS events per thread
+ * A thread's ring, and its events, are freed when the thread exits
+ * The API trace command writes all the thread buffers to a file in the
+ * Chrome trace event JSON format, to load into chrome://tracing or Perfetto
+ * If disabled, all the TRACE_ macros compile to nothing
+ */
+#define WORK_TRACING 0
+
+#if WORK_TRACING
+// Per thread ring buffer size, must be a power of 2
+#define TRACE_EVENTS 1024
+// API trace command default filename
+#define DEFAULT_TRACE_FILE "cgminer-trace.json"
+
+extern uint64_t trace_ns(void);
+extern void trace_event(const char *name, uint64_t start, int64_t arg);
+extern int trace_write(FILE *fout);
+
+/* Time the code between TRACE_START(name) and TRACE_END(name, arg)
+ * TRACE_START declares a variable so must be at the start of a block
+ * TRACE_MARK(name, arg) records an instant event */
+#define TRACE_START(_name) uint64_t _trace_##_name = trace_ns()
+#define TRACE_END(_name, _arg) trace_event(#_name, _trace_##_name, (int64_t)(_arg))
+#define TRACE_MARK(_name, _arg) trace_event(#_name, 0, (int64_t)(_arg))
+#else
+#define TRACE_START(_name)
+#define TRACE_END(_name, _arg)
+#define TRACE_MARK(_name, _arg)
+#endif
+
+#endif /* TRACE_H */
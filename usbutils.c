@@ -744,7 +744,7 @@ static const char *nodatareturned = "no data returned ";
  static const char *nodevstr = "=NODEV";
  #define bool_str(boo) ((boo) ? debug_true_str : debug_false_str)
  #define isnodev(err) (NODEV(err) ? nodevstr : BLANK)
- #define USBDEBUG(fmt, ...) applog(LOG_WARNING, fmt, ##__VA_ARGS__)
+ #define USBDEBUG(fmt, ...) ratelog(LOG_WARNING, fmt, ##__VA_ARGS__)
 #else
  #define USBDEBUG(fmt, ...)
 #endif
@@ -322,6 +322,10 @@ struct cg_usb_info {
 	USB_ADD_COMMAND(C_REQUESTQUEJOBSTATUS, "RequestQueJobStatus") \
 	USB_ADD_COMMAND(C_QUEJOB, "QueJob") \
 	USB_ADD_COMMAND(C_QUEJOBSTATUS, "QueJobStatus") \
+	USB_ADD_COMMAND(C_REQUESTQUEJOBS, "RequestQueJobs") \
+	USB_ADD_COMMAND(C_REQUESTQUEJOBSSTATUS, "RequestQueJobsStatus") \
+	USB_ADD_COMMAND(C_QUEJOBS, "QueJobs") \
+	USB_ADD_COMMAND(C_QUEJOBSSTATUS, "QueJobsStatus") \
 	USB_ADD_COMMAND(C_QUEFLUSH, "QueFlush") \
 	USB_ADD_COMMAND(C_QUEFLUSHREPLY, "QueFlushReply") \
 	USB_ADD_COMMAND(C_REQUESTVOLTS, "RequestVolts") \
@@ -42,6 +42,7 @@
 #include "elist.h"
 #include "compat.h"
 #include "util.h"
+#include "proxy.h"
 
 #define DEFAULT_SOCKWAIT 60
 
@@ -1901,6 +1902,150 @@ static bool parse_diff(struct pool *pool, json_t *val)
 	return true;
 }
 
+/* mining.set_extranonce gives a new nonce1 and n2size which apply to the
+ * current job, so splice them into the current coinbase rather than
+ * reconnecting */
+static bool parse_extranonce(struct pool *pool, json_t *val)
+{
+	unsigned char *nonce1bin, *coinbase;
+	int n2size, cb1_len, cb2_ofs, cb2_len;
+	size_t n1_len, alloc_len;
+	char *nonce1;
+
+	nonce1 = json_array_string(val, 0);
+	if (!valid_hex(nonce1)) {
+		applog(LOG_INFO, "Failed to get valid nonce1 in parse_extranonce");
+		free(nonce1);
+		return false;
+	}
+	n2size = json_integer_value(json_array_get(val, 1));
+	if (n2size < 2 || n2size > 16) {
+		applog(LOG_INFO, "Failed to get valid n2size in parse_extranonce");
+		free(nonce1);
+		return false;
+	}
+
+	n1_len = strlen(nonce1) / 2;
+	nonce1bin = calloc(n1_len, 1);
+	if (unlikely(!nonce1bin))
+		quithere(1, "Failed to calloc nonce1bin");
+	hex2bin(nonce1bin, nonce1, n1_len);
+
+	cg_wlock(&pool->data_lock);
+	if (pool->coinbase) {
+		cb1_len = pool->nonce2_offset - pool->n1_len;
+		cb2_ofs = pool->nonce2_offset + pool->n2size;
+		cb2_len = pool->coinbase_len - cb2_ofs;
+		alloc_len = cb1_len + n1_len + n2size + cb2_len;
+		pool->coinbase_len = alloc_len;
+		align_len(&alloc_len);
+		coinbase = calloc(alloc_len, 1);
+		if (unlikely(!coinbase))
+			quithere(1, "Failed to calloc coinbase");
+		memcpy(coinbase, pool->coinbase, cb1_len);
+		memcpy(coinbase + cb1_len, nonce1bin, n1_len);
+		memcpy(coinbase + cb1_len + n1_len + n2size, pool->coinbase + cb2_ofs, cb2_len);
+		free(pool->coinbase);
+		pool->coinbase = coinbase;
+		pool->nonce2_offset = cb1_len + n1_len;
+	}
+	free(pool->nonce1);
+	pool->nonce1 = nonce1;
+	free(pool->nonce1bin);
+	pool->nonce1bin = nonce1bin;
+	pool->n1_len = n1_len;
+	pool->n2size = n2size;
+	pool->nonce2 = 0;
+	cg_wunlock(&pool->data_lock);
+
+	applog(LOG_NOTICE, "Pool %d extranonce changed to %s extran2size %d",
+	       pool->pool_no, nonce1, n2size);
+
+	if (pool == current_pool())
+		opt_work_update = true;
+
+	return true;
+}
+
+static void set_version_mask(struct pool *pool, const char *mask)
+{
+	uint32_t version_mask = 0;
+
+	if (mask && valid_hex((char *)mask))
+		version_mask = strtoul(mask, NULL, 16) & VERSION_ROLL_MASK;
+
+	cg_wlock(&pool->data_lock);
+	pool->version_mask = version_mask;
+	cg_wunlock(&pool->data_lock);
+
+	applog(LOG_INFO, "Pool %d version rolling mask %08x", pool->pool_no, version_mask);
+}
+
+static bool parse_version_mask(struct pool *pool, json_t *val)
+{
+	const char *mask = json_string_value(json_array_get(val, 0));
+
+	if (!mask)
+		return false;
+	set_version_mask(pool, mask);
+	return true;
+}
+
+/* Returns true if s was the response to our mining.configure with id */
+static bool parse_configure(struct pool *pool, const char *s, int id)
+{
+	json_t *val, *res_val, *err_val;
+	json_error_t err;
+
+	val = JSON_LOADS(s, &err);
+	if (!val)
+		return false;
+	if (json_integer_value(json_object_get(val, "id")) != id) {
+		json_decref(val);
+		return false;
+	}
+
+	res_val = json_object_get(val, "result");
+	err_val = json_object_get(val, "error");
+	if (!json_is_true(json_object_get(res_val, "version-rolling")) ||
+	    (err_val && !json_is_null(err_val))) {
+		applog(LOG_INFO, "Pool %d does not support version rolling", pool->pool_no);
+		set_version_mask(pool, NULL);
+	} else
+		set_version_mask(pool, json_string_value(json_object_get(res_val, "version-rolling.mask")));
+
+	json_decref(val);
+	return true;
+}
+
+/* Returns true if s was a method notification sent before the subscribe
+ * reply, BIP310 pools may send mining.set_version_mask then, so apply that
+ * and ignore anything else */
+static bool parse_subscribe_method(struct pool *pool, const char *s)
+{
+	json_t *val;
+	json_error_t err;
+	const char *method;
+
+	val = JSON_LOADS(s, &err);
+	if (!val)
+		return false;
+	method = json_string_value(json_object_get(val, "method"));
+	if (!method) {
+		json_decref(val);
+		return false;
+	}
+
+	if (!strncasecmp(method, "mining.set_version_mask", 23))
+		parse_version_mask(pool, json_object_get(val, "params"));
+	else
+		applog(LOG_DEBUG, "Pool %d ignored %s before the subscribe reply",
+		       pool->pool_no, method);
+
+	json_decref(val);
+	return true;
+}
+
 static void __suspend_stratum(struct pool *pool)
 {
 	clear_sockbuf(pool);
@@ -2035,9 +2180,10 @@ bool parse_method(struct pool *pool, char *s)
 		goto out_decref;
 
 	if (!strncasecmp(buf, "mining.notify", 13)) {
-		if (parse_notify(pool, params))
+		if (parse_notify(pool, params)) {
 			pool->stratum_notify = ret = true;
-		else
+			proxy_notify(pool);
+		} else
 			pool->stratum_notify = ret = false;
 		goto out_decref;
 	}
@@ -2047,6 +2193,18 @@ bool parse_method(struct pool *pool, char *s)
 		goto out_decref;
 	}
 
+	if (!strncasecmp(buf, "mining.set_extranonce", 21)) {
+		ret = parse_extranonce(pool, params);
+		if (ret)
+			proxy_notify(pool);
+		goto out_decref;
+	}
+
+	if (!strncasecmp(buf, "mining.set_version_mask", 23)) {
+		ret = parse_version_mask(pool, params);
+		goto out_decref;
+	}
+
 	if (!strncasecmp(buf, "client.reconnect", 16)) {
 		ret = parse_reconnect(pool, params);
 		goto out_decref;
@@ -2116,6 +2274,17 @@ bool auth_stratum(struct pool *pool)
 	pool->probed = true;
 	successful_connect = true;
 
+	/* The response is handled in parse_stratum_response, pools that
+	 * don't support it may return an error or not respond at all */
+	if (opt_extranonce_subscribe) {
+		mutex_lock(&sshare_lock);
+		pool->xnsub_id = swork_id++;
+		mutex_unlock(&sshare_lock);
+		sprintf(s, "{\"id\": %d, \"method\": \"mining.extranonce.subscribe\", \"params\": []}",
+			pool->xnsub_id);
+		stratum_send(pool, s, strlen(s));
+	}
+
 out:
 	json_decref(val);
 	return ret;
@@ -2541,7 +2710,7 @@ bool initiate_stratum(struct pool *pool)
 	char s[RBUFSIZE], *sret = NULL, *nonce1, *sessionid;
 	json_t *val = NULL, *res_val, *err_val;
 	json_error_t err;
-	int n2size;
+	int n2size, vr_id = 0;
 
 resend:
 	if (!setup_stratum_socket(pool)) {
@@ -2562,11 +2731,30 @@ resend:
 			sprintf(s, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\""PACKAGE"/"VERSION"\"]}", swork_id++);
 	}
 
+	/* BIP310 asks for mining.configure to be sent before the subscribe */
+	cg_wlock(&pool->data_lock);
+	pool->version_mask = 0;
+	cg_wunlock(&pool->data_lock);
+	if (opt_version_rolling) {
+		char vr[256];
+
+		mutex_lock(&sshare_lock);
+		vr_id = swork_id++;
+		mutex_unlock(&sshare_lock);
+		sprintf(vr, "{\"id\": %d, \"method\": \"mining.configure\", \"params\": [[\"version-rolling\"], {\"version-rolling.mask\": \"%08x\", \"version-rolling.min-bit-count\": 2}]}",
+			vr_id, VERSION_ROLL_MASK);
+		if (__stratum_send(pool, vr, strlen(vr)) != SEND_OK) {
+			applog(LOG_DEBUG, "Failed to send configure in initiate_stratum");
+			goto out;
+		}
+	}
+
 	if (__stratum_send(pool, s, strlen(s)) != SEND_OK) {
 		applog(LOG_DEBUG, "Failed to send s in initiate_stratum");
 		goto out;
 	}
 
+recv_subscribe:
 	if (!socket_full(pool, DEFAULT_SOCKWAIT)) {
 		applog(LOG_DEBUG, "Timed out waiting for response in initiate_stratum");
 		goto out;
@@ -2576,6 +2764,18 @@ resend:
 	if (!sret)
 		goto out;
 
+	/* Pools that don't know mining.configure may not answer it at all */
+	if (vr_id && parse_configure(pool, sret, vr_id)) {
+		free(sret);
+		vr_id = 0;
+		goto recv_subscribe;
+	}
+
+	if (parse_subscribe_method(pool, sret)) {
+		free(sret);
+		goto recv_subscribe;
+	}
+
 	recvd = true;
 
 	val = JSON_LOADS(sret, &err);
@@ -0,0 +1,204 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "miner.h"
+#include "verify.h"
+
+typedef struct verify_rec {
+	struct thr_info *thr;
+	struct work *work;
+	uint32_t nonce;
+	verify_cb cb;
+	struct timeval queued;
+} VERIFY_REC;
+
+/* A bounded lock free queue for many producers and consumers
+ * Each slot's seq says whose turn it is: a producer at position pos can
+ * fill it when seq == pos, and a consumer can empty it when seq == pos+1 */
+typedef struct verify_slot {
+	volatile uint64_t seq;
+	VERIFY_REC rec;
+} VERIFY_SLOT;
+
+int opt_verify_threads;
+
+static VERIFY_SLOT *verify_ring;
+static volatile uint64_t verify_in;
+static volatile uint64_t verify_out;
+static cgsem_t verify_sem;
+
+static pthread_mutex_t verify_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct verify_stats verify_drv[DRIVER_MAX];
+
+static bool verify_push(VERIFY_REC *rec)
+{
+	VERIFY_SLOT *slot;
+	uint64_t pos;
+	int64_t dif;
+
+	pos = verify_in;
+	while (42) {
+		slot = &(verify_ring[pos & (VERIFY_QUEUE - 1)]);
+		dif = (int64_t)(slot->seq) - (int64_t)pos;
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&verify_in, pos, pos + 1))
+				break;
+		} else if (dif < 0)
+			return false;
+		pos = verify_in;
+	}
+
+	slot->rec = *rec;
+	__sync_synchronize();
+	slot->seq = pos + 1;
+	return true;
+}
+
+static bool verify_pop(VERIFY_REC *rec)
+{
+	VERIFY_SLOT *slot;
+	uint64_t pos;
+	int64_t dif;
+
+	pos = verify_out;
+	while (42) {
+		slot = &(verify_ring[pos & (VERIFY_QUEUE - 1)]);
+		dif = (int64_t)(slot->seq) - (int64_t)(pos + 1);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&verify_out, pos, pos + 1))
+				break;
+		} else if (dif < 0)
+			return false;
+		pos = verify_out;
+	}
+
+	*rec = slot->rec;
+	__sync_synchronize();
+	slot->seq = pos + VERIFY_QUEUE;
+	return true;
+}
+
+static void *verify_thread(void *userdata)
+{
+	int id = (int)(intptr_t)userdata;
+	struct verify_stats *stats;
+	char threadname[16];
+	struct timeval now;
+	VERIFY_REC rec;
+	double latency;
+	bool valid;
+
+	pthread_detach(pthread_self());
+
+	snprintf(threadname, sizeof(threadname), "Verify/%d", id);
+	RenameThread(threadname);
+
+	while (42) {
+		if (!verify_pop(&rec)) {
+			cgsem_wait(&verify_sem);
+			continue;
+		}
+
+		valid = submit_nonce(rec.thr, rec.work, rec.nonce);
+		rec.cb(rec.thr, rec.work, rec.nonce, valid);
+
+		cgtime(&now);
+		latency = tdiff(&now, &(rec.queued));
+		stats = &(verify_drv[rec.thr->cgpu->drv->drv_id]);
+		mutex_lock(&verify_lock);
+		stats->depth--;
+		stats->verified++;
+		if (valid)
+			stats->valid++;
+		stats->total_latency += latency;
+		if (stats->max_latency < latency)
+			stats->max_latency = latency;
+		mutex_unlock(&verify_lock);
+
+		free_work(rec.work);
+	}
+
+	return NULL;
+}
+
+void verify_start(void)
+{
+	pthread_t pth;
+	uint64_t i;
+	int n;
+
+	if (opt_verify_threads < 1)
+		return;
+
+	verify_ring = calloc(VERIFY_QUEUE, sizeof(*verify_ring));
+	if (unlikely(!verify_ring))
+		quithere(1, "Failed to calloc verify_ring");
+	for (i = 0; i < VERIFY_QUEUE; i++)
+		verify_ring[i].seq = i;
+
+	cgsem_init(&verify_sem);
+
+	for (n = 0; n < opt_verify_threads; n++) {
+		if (unlikely(pthread_create(&pth, NULL, verify_thread, (void *)(intptr_t)n)))
+			quit(1, "Failed to create verify thread %d", n);
+	}
+
+	applog(LOG_NOTICE, "Started %d nonce verify thread%s",
+			   opt_verify_threads, opt_verify_threads == 1 ? "" : "s");
+}
+
+void verify_nonce(struct thr_info *thr, struct work *work, uint32_t nonce, verify_cb cb)
+{
+	struct verify_stats *stats = &(verify_drv[thr->cgpu->drv->drv_id]);
+	VERIFY_REC rec;
+
+	if (!verify_ring) {
+		cb(thr, work, nonce, submit_nonce(thr, work, nonce));
+		return;
+	}
+
+	rec.thr = thr;
+	rec.work = copy_work_view(work, 0, 0);
+	rec.nonce = nonce;
+	rec.cb = cb;
+	cgtime(&(rec.queued));
+
+	// Count it before a verify thread can see it
+	mutex_lock(&verify_lock);
+	stats->name = thr->cgpu->drv->name;
+	stats->queued++;
+	stats->depth++;
+	if (stats->max_depth < stats->depth)
+		stats->max_depth = stats->depth;
+	mutex_unlock(&verify_lock);
+
+	if (unlikely(!verify_push(&rec))) {
+		free_work(rec.work);
+		mutex_lock(&verify_lock);
+		stats->queued--;
+		stats->depth--;
+		stats->full++;
+		mutex_unlock(&verify_lock);
+		cb(thr, work, nonce, submit_nonce(thr, work, nonce));
+		return;
+	}
+
+	cgsem_post(&verify_sem);
+}
+
+void verify_stats_copy(struct verify_stats *stats)
+{
+	mutex_lock(&verify_lock);
+	memcpy(stats, verify_drv, sizeof(verify_drv));
+	mutex_unlock(&verify_lock);
+}
@@ -0,0 +1,48 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "miner.h"
+
+/*
+ * With --verify-threads, drivers can hand their nonces to a pool of
+ * threads that do the SHA256d test and submit, rather than doing it in
+ * the driver's own result thread
+ * Each nonce is queued with a view of its work, so the driver can discard
+ * the work as soon as verify_nonce() returns
+ * The callback is called from a verify thread after submit_nonce() with
+ * the view of the work and whether the nonce was valid
+ * With no verify threads, or if the queue is full, verify_nonce() does it
+ * all immediately, in the caller's thread, with the driver's work
+ */
+
+// Must be a power of 2
+#define VERIFY_QUEUE 4096
+
+typedef void (*verify_cb)(struct thr_info *thr, struct work *work, uint32_t nonce, bool valid);
+
+struct verify_stats {
+	const char *name; // driver name, NULL if it hasn't used verify_nonce()
+	uint64_t queued;
+	uint64_t full; // done in the driver thread since the queue was full
+	uint64_t verified;
+	uint64_t valid;
+	int depth;
+	int max_depth;
+	double total_latency; // seconds from queued to verified
+	double max_latency;
+};
+
+extern int opt_verify_threads;
+
+extern void verify_start(void);
+extern void verify_nonce(struct thr_info *thr, struct work *work, uint32_t nonce, verify_cb cb);
+extern void verify_stats_copy(struct verify_stats *stats);
+
+#endif /* VERIFY_H */